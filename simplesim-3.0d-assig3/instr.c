@@ -5,23 +5,38 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
 
+#include "host.h"
+#include "misc.h"
 #include "instr.h"
+#include "tomasulo.h"
+
+//stdio buffer used for trace files, records are small so batch them up
+#define INSTR_FILE_BUF_SIZE (1 << 20)
 
 //prints a single instruction
-static void print_tom_instr(instruction_t* instr) {
+static void print_tom_instr(instruction_t* instr, tom_timing_t* timing) {
 
   md_print_insn(instr->inst, instr->pc, stdout);
-  myfprintf(stdout, "\t%d\t%d\t%d\t%d\n", 
-	    instr->tom_dispatch_cycle,
-	    instr->tom_issue_cycle,
-	    instr->tom_execute_cycle,
-	    instr->tom_cdb_cycle);
+  myfprintf(stdout, "\t%d\t%d\t%d\t%d\t%d\n", 
+	    timing->dispatch_cycle[instr->index],
+	    timing->issue_cycle[instr->index],
+	    timing->execute_cycle[instr->index],
+	    timing->cdb_cycle[instr->index],
+	    timing->commit_cycle[instr->index]);
 }
 
 
 //prints all the instructions inside the given trace for pipeline
-void print_all_instr(instruction_trace_t* trace, int sim_num_insn) {
+void print_all_instr(instruction_trace_t* trace, tom_timing_t* timing, int sim_num_insn) {
 
   fprintf(stdout, "TOMASULO TABLE\n");
 
@@ -30,7 +45,7 @@ void print_all_instr(instruction_trace_t* trace, int sim_num_insn) {
   while (true) {
  
      if (1) { // if (printed_count > 9999900) {
-        print_tom_instr(&trace->table[index]);
+        print_tom_instr(&trace->table[index], timing);
      }
 
      printed_count++;
@@ -47,6 +62,78 @@ void print_all_instr(instruction_trace_t* trace, int sim_num_insn) {
    }
 }
 
+//writes one column of a timing file
+static void write_timing_column(FILE* fd, void* column, size_t size,
+                                counter_t num_insn, char* fname) {
+
+  if (num_insn > 0 && fwrite(column, size, num_insn, fd) != num_insn)
+    fatal("cannot write timing file `%s'", fname);
+}
+
+//dumps the timing table of a run to a timing file, column by column
+void write_timing_file(char* fname, instruction_trace_t* trace, tom_timing_t* timing) {
+
+  timing_file_header_t header;
+  instruction_trace_t* t;
+  counter_t n = timing->num_insn;
+  FILE* fd = gzopen(fname, "w");
+  int i, col;
+
+  if (fd == NULL)
+    fatal("cannot open timing file `%s'", fname);
+  setvbuf(fd, NULL, _IOFBF, INSTR_FILE_BUF_SIZE);
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TIMING_FILE_MAGIC, sizeof(header.magic));
+  header.version = TIMING_FILE_VERSION;
+  header.byte_order = INSTR_FILE_BYTE_ORDER;
+  header.num_insn = n;
+  header.num_columns = TIMING_FILE_COLUMNS;
+  if (fwrite(&header, sizeof(header), 1, fd) != 1)
+    fatal("cannot write timing file `%s'", fname);
+
+  //the pc and op columns are gathered from the trace a block at a time,
+  //instruction i sits at position i of the trace
+  md_addr_t* pcs = malloc(INSTR_TRACE_SIZE * sizeof(md_addr_t));
+  half_t* ops = malloc(INSTR_TRACE_SIZE * sizeof(half_t));
+  assert(pcs != NULL && ops != NULL);
+
+  for (col = 0; col < 2; col++) {
+    counter_t left = n;
+    int first = 1;
+
+    for (t = trace; t != NULL && left > 0; t = t->next, first = 0) {
+      int count = MIN(INSTR_TRACE_SIZE - first, left);
+
+      for (i = 0; i < count; i++) {
+        if (col == 0)
+          pcs[i] = t->table[first + i].pc;
+        else
+          ops[i] = t->table[first + i].op;
+      }
+      if (col == 0)
+        write_timing_column(fd, pcs, sizeof(md_addr_t), count, fname);
+      else
+        write_timing_column(fd, ops, sizeof(half_t), count, fname);
+      left -= count;
+    }
+    if (left > 0)
+      fatal("timing table is longer than the trace");
+  }
+  free(pcs);
+  free(ops);
+
+  //the cycle columns are stored just like the timing arrays
+  write_timing_column(fd, timing->dispatch_cycle + 1, sizeof(int), n, fname);
+  write_timing_column(fd, timing->issue_cycle + 1, sizeof(int), n, fname);
+  write_timing_column(fd, timing->execute_cycle + 1, sizeof(int), n, fname);
+  write_timing_column(fd, timing->cdb_cycle + 1, sizeof(int), n, fname);
+  write_timing_column(fd, timing->commit_cycle + 1, sizeof(int), n, fname);
+
+  fflush(fd);
+  gzclose(fd);
+}
+
 //inserts the instruction into the trace
 void put_instr(instruction_trace_t* trace, instruction_t* instr) {
 
@@ -78,3 +165,177 @@ instruction_t* get_instr(instruction_trace_t* trace, int index) {
   return &trace->table[index];
 }
 
+//creates a trace file, a .gz suffix compresses it through gzip
+FILE* open_instr_file(char* fname) {
+
+  instruction_file_header_t header;
+  FILE* fd = gzopen(fname, "w");
+
+  if (fd == NULL)
+    fatal("cannot open instruction trace file `%s'", fname);
+  setvbuf(fd, NULL, _IOFBF, INSTR_FILE_BUF_SIZE);
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, INSTR_FILE_MAGIC, sizeof(header.magic));
+  header.version = INSTR_FILE_VERSION;
+  header.byte_order = INSTR_FILE_BYTE_ORDER;
+
+  if (fwrite(&header, sizeof(header), 1, fd) != 1)
+    fatal("cannot write instruction trace file `%s'", fname);
+
+  return fd;
+}
+
+//appends the instruction to an open trace file
+void write_instr(FILE* fd, instruction_t* instr) {
+
+  instruction_record_t rec;
+
+  rec.index = instr->index;
+  rec.pc = instr->pc;
+  rec.addr = instr->addr;
+  rec.op = instr->op;
+  rec.r_out[0] = instr->r_out[0];
+  rec.r_out[1] = instr->r_out[1];
+  rec.r_in[0] = instr->r_in[0];
+  rec.r_in[1] = instr->r_in[1];
+  rec.r_in[2] = instr->r_in[2];
+  rec.pad = 0;
+
+  if (fwrite(&rec, sizeof(rec), 1, fd) != 1)
+    fatal("cannot write instruction trace record %d", instr->index);
+}
+
+//finishes and closes a trace file
+void close_instr_file(FILE* fd) {
+
+  fflush(fd);
+  gzclose(fd);
+}
+
+//expands an on-disk record back into an instruction
+static void decode_instr_record(instruction_record_t* rec, instruction_t* instr) {
+
+  memset(instr, 0, sizeof(instruction_t));
+  instr->index = rec->index;
+  instr->pc = rec->pc;
+  instr->addr = rec->addr;
+  instr->op = (enum md_opcode)rec->op;
+  instr->r_out[0] = rec->r_out[0];
+  instr->r_out[1] = rec->r_out[1];
+  instr->r_in[0] = rec->r_in[0];
+  instr->r_in[1] = rec->r_in[1];
+  instr->r_in[2] = rec->r_in[2];
+}
+
+//checks the header at the start of a trace file
+static void check_instr_header(instruction_file_header_t* header, char* fname) {
+
+  if (memcmp(header->magic, INSTR_FILE_MAGIC, sizeof(header->magic)) != 0)
+    fatal("`%s' is not an instruction trace file", fname);
+  if (header->byte_order != INSTR_FILE_BYTE_ORDER)
+    fatal("instruction trace file `%s' was written on a host with a different byte order", fname);
+  if (header->version != INSTR_FILE_VERSION)
+    fatal("instruction trace file `%s' has version %d, expected %d",
+          fname, header->version, INSTR_FILE_VERSION);
+}
+
+//creates an empty trace, the first entry is skipped as in sim-safe
+static instruction_trace_t* new_instr_trace(void) {
+
+  instruction_trace_t* trace = malloc(sizeof(instruction_trace_t));
+  assert(trace != NULL);
+  memset(trace, 0, sizeof(instruction_trace_t));
+  trace->size++;
+
+  return trace;
+}
+
+//appends a record at the tail of the trace and returns the new tail
+static instruction_trace_t* append_instr_record(instruction_trace_t* tail,
+                                                instruction_record_t* rec) {
+  instruction_t instr;
+
+  decode_instr_record(rec, &instr);
+  put_instr(tail, &instr);
+
+  return (tail->next != NULL) ? tail->next : tail;
+}
+
+//reads a trace file back into an in-memory trace, the number of
+//instructions read is returned in num_insn
+instruction_trace_t* load_instr_file(char* fname, counter_t* num_insn) {
+
+  instruction_file_header_t header;
+  instruction_trace_t* trace = new_instr_trace();
+  instruction_trace_t* tail = trace;
+  char* ext = strrchr(fname, '.');
+  counter_t count = 0;
+
+#ifndef _MSC_VER
+  //uncompressed traces are mapped into memory, which saves the stdio
+  //buffering; the records are still decoded into the trace chunks
+  if (ext == NULL || strcmp(ext, ".gz") != 0) {
+
+    struct stat st;
+    char* base;
+    size_t nrecs, i;
+    int fd = open(fname, O_RDONLY);
+
+    if (fd < 0)
+      fatal("cannot open instruction trace file `%s'", fname);
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(header))
+      fatal("cannot read instruction trace file `%s'", fname);
+
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED)
+      fatal("cannot map instruction trace file `%s'", fname);
+    close(fd);
+
+    memcpy(&header, base, sizeof(header));
+    check_instr_header(&header, fname);
+    if ((st.st_size - sizeof(header)) % sizeof(instruction_record_t) != 0)
+      fatal("instruction trace file `%s' is truncated", fname);
+
+    nrecs = (st.st_size - sizeof(header)) / sizeof(instruction_record_t);
+    for (i = 0; i < nrecs; i++) {
+      instruction_record_t rec;
+      memcpy(&rec, base + sizeof(header) + i * sizeof(rec), sizeof(rec));
+      tail = append_instr_record(tail, &rec);
+    }
+    count = nrecs;
+
+    munmap(base, st.st_size);
+    *num_insn = count;
+    return trace;
+  }
+#endif
+
+  //compressed traces are streamed through the decompressor
+  {
+    instruction_record_t rec;
+    size_t n;
+    FILE* fd = gzopen(fname, "r");
+
+    if (fd == NULL)
+      fatal("cannot open instruction trace file `%s'", fname);
+    setvbuf(fd, NULL, _IOFBF, INSTR_FILE_BUF_SIZE);
+
+    if (fread(&header, sizeof(header), 1, fd) != 1)
+      fatal("cannot read instruction trace file `%s'", fname);
+    check_instr_header(&header, fname);
+
+    while ((n = fread(&rec, 1, sizeof(rec), fd)) == sizeof(rec)) {
+      tail = append_instr_record(tail, &rec);
+      count++;
+    }
+    if (ferror(fd))
+      fatal("cannot read instruction trace file `%s'", fname);
+    if (n != 0)
+      fatal("instruction trace file `%s' is truncated", fname);
+    gzclose(fd);
+  }
+
+  *num_insn = count;
+  return trace;
+}
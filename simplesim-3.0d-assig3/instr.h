@@ -2,6 +2,9 @@
 #ifndef INSTR_H
 #define INSTR_H
 
+#include <stdio.h>
+
+#include "host.h"
 #include "machine.h"
 
 //data structure representing each instruction
@@ -14,16 +17,10 @@ typedef struct my_instruction
   int r_in[3]; //input registers
   enum md_opcode op; //opcode
   md_addr_t pc; //program counter the instruction executes at
+  md_addr_t addr; //effective address of a load or store, 0 otherwise
 
-  //the equivalents of Qj, Qk; these are pointers to the instructions producing the results
-  // for the input registers of this instruction
-  struct my_instruction * Q[3]; 
-
-  //Specify the cycle an instruction **entered** this stage
-  int tom_dispatch_cycle;  //dispatch
-  int tom_issue_cycle;     //issue
-  int tom_execute_cycle;   //execute
-  int tom_cdb_cycle;       //writeback via Common Data Bus (CDB)
+  //the cycles an instruction entered each stage, and the Qj/Qk tags of the
+  //Tomasulo model, are per-run state and live in tomasulo.c (tom_timing_t)
 
 }instruction_t;
 
@@ -36,8 +33,60 @@ typedef struct my_instruction_list
   struct my_instruction_list* next;
 }instruction_trace_t;
 
-//prints all the instructions inside the given trace
-extern void print_all_instr(instruction_trace_t* table, int sim_num_insn);
+//on-disk trace file header, followed by one instruction_record_t per
+//dynamic instruction until the end of the file
+#define INSTR_FILE_MAGIC "TOMTRACE"
+#define INSTR_FILE_VERSION 2
+#define INSTR_FILE_BYTE_ORDER 0x01020304
+
+typedef struct my_instruction_file_header
+{
+  char magic[8];     //INSTR_FILE_MAGIC, not NUL terminated
+  word_t version;    //INSTR_FILE_VERSION
+  word_t byte_order; //INSTR_FILE_BYTE_ORDER as written by the host
+}instruction_file_header_t;
+
+//compact on-disk form of an instruction, only the decoded fields the
+//timing model needs; the raw instruction word and the tom_* cycles are
+//not stored, register numbers fit in a signed byte (DNA is -1)
+typedef struct my_instruction_record
+{
+  word_t index;
+  md_addr_t pc;
+  md_addr_t addr;
+  half_t op;
+  signed char r_out[2];
+  signed char r_in[3];
+  byte_t pad;
+}instruction_record_t;
+
+//timing file header, followed by the timing table of a run column by
+//column, each column holding num_insn entries for instructions 1..num_insn:
+//the md_addr_t pc, the half_t op and the int dispatch, issue, execute,
+//cdb and commit cycles (0 if the instruction never entered the stage)
+#define TIMING_FILE_MAGIC "TOMTIMES"
+#define TIMING_FILE_VERSION 1
+#define TIMING_FILE_COLUMNS 7
+
+typedef struct my_timing_file_header
+{
+  char magic[8];     //TIMING_FILE_MAGIC, not NUL terminated
+  word_t version;    //TIMING_FILE_VERSION
+  word_t byte_order; //INSTR_FILE_BYTE_ORDER as written by the host
+  word_t num_insn;   //entries per column
+  word_t num_columns; //TIMING_FILE_COLUMNS
+}timing_file_header_t;
+
+struct tom_timing;
+
+//prints all the instructions inside the given trace with their cycles
+extern void print_all_instr(instruction_trace_t* table, struct tom_timing* timing,
+                            int sim_num_insn);
+
+//dumps the timing table of a run to a timing file for tomview, a .gz
+//suffix compresses it through gzip
+extern void write_timing_file(char* fname, instruction_trace_t* trace,
+                              struct tom_timing* timing);
 
 //inserts the instruction into the trace
 extern void put_instr(instruction_trace_t* trace, instruction_t* instr);
@@ -45,4 +94,17 @@ extern void put_instr(instruction_trace_t* trace, instruction_t* instr);
 //gets the instruction at the index, from the trace
 extern instruction_t* get_instr(instruction_trace_t* trace, int index);
 
+//creates a trace file, a .gz suffix compresses it through gzip
+extern FILE* open_instr_file(char* fname);
+
+//appends the instruction to an open trace file
+extern void write_instr(FILE* fd, instruction_t* instr);
+
+//finishes and closes a trace file
+extern void close_instr_file(FILE* fd);
+
+//reads a trace file back into an in-memory trace, the number of
+//instructions read is returned in num_insn
+extern instruction_trace_t* load_instr_file(char* fname, counter_t* num_insn);
+
 #endif
@@ -0,0 +1,220 @@
+#!/local/bin/perl
+
+#
+# ipccheck - cross-check the interval IPC of the Tomasulo model against
+#            sim-outorder
+#
+# Both timing models are configured to the same machine and run on the same
+# PISA binary: the Tomasulo model through sim-safe (-tom:ipc), the detailed
+# model through assig4's sim-outorder (-ipc:file).  Each writes the cycle at
+# which every <interval> instructions are done, the IPC of every interval
+# is compared and intervals that differ by more than the tolerance are
+# flagged.  The exit status is non-zero if any interval diverged.
+#
+# The machines cannot match exactly: sim-outorder has per-operation
+# latencies, separate multiplier and memory port resources, and a unified
+# RUU, while the Tomasulo model has one latency per functional unit class
+# and split reservation stations.  The defaults below line up the widths,
+# window sizes and unit counts, turn off caches and TLBs and use perfect
+# branch prediction on both sides; -tomopt and -oooopt add or override
+# options of either simulator.
+#
+
+#
+# config parms
+#
+$tom_sim = "./sim-safe";
+$ooo_sim = "../simplesim-3.0d-assig4/sim-outorder";
+$interval = 100000;
+$tolerance = 0.10;
+$max_inst = 10000000;
+$keep = 0;
+
+# the equivalent machine, one issue per unit, 1-wide front end and commit
+$tom_opts =
+  "-tom:iq 16 -tom:rob 16 -tom:commitw 1 -tom:rsint 16 -tom:rsfp 16 ".
+  "-tom:fuint 4 -tom:fufp 2 -tom:latint 1 -tom:latfp 2 -tom:lsq 8 ".
+  "-tom:bpred 0";
+$ooo_opts =
+  "-fetch:ifqsize 16 -decode:width 1 -issue:width 6 -commit:width 1 ".
+  "-ruu:size 16 -lsq:size 8 -res:ialu 4 -res:imult 1 -res:memport 2 ".
+  "-res:fpalu 2 -res:fpmult 1 -bpred perfect -cache:il1 none ".
+  "-cache:il2 none -cache:dl1 none -cache:dl2 none -tlb:itlb none ".
+  "-tlb:dtlb none -mem:lat 1 1";
+
+#
+# parse commands
+#
+while (@ARGV > 0 && $ARGV[0] =~ /^-/)
+  {
+    $opt = shift(@ARGV);
+    if ($opt eq "-keep")
+      {
+	$keep = 1;
+	next;
+      }
+    if (@ARGV == 0)
+      {
+	print STDERR "** FATAL ** option `$opt' needs an argument\n";
+	exit -1;
+      }
+    $arg = shift(@ARGV);
+    if ($opt eq "-interval") { $interval = $arg; }
+    elsif ($opt eq "-tolerance") { $tolerance = $arg; }
+    elsif ($opt eq "-max") { $max_inst = $arg; }
+    elsif ($opt eq "-tom") { $tom_sim = $arg; }
+    elsif ($opt eq "-ooo") { $ooo_sim = $arg; }
+    elsif ($opt eq "-tomopt") { $tom_opts .= " $arg"; }
+    elsif ($opt eq "-oooopt") { $ooo_opts .= " $arg"; }
+    else
+      {
+	print STDERR "** FATAL ** unknown option `$opt'\n";
+	exit -1;
+      }
+  }
+
+if (@ARGV < 1)
+  {
+     print STDERR
+"Usage: ipccheck {-options} <binary> {<args>}\n".
+"\n".
+"         Runs <binary> on the Tomasulo model (sim-safe) and on sim-outorder\n".
+"         configured to an equivalent machine, and compares their IPC over\n".
+"         every interval of committed instructions.  Options:\n".
+"\n".
+"           -interval <n>    instructions per interval (default $interval)\n".
+"           -tolerance <f>   largest relative IPC difference allowed\n".
+"                            (default $tolerance)\n".
+"           -max <n>         instructions simulated (default $max_inst)\n".
+"           -tom <path>      sim-safe to run (default $tom_sim)\n".
+"           -ooo <path>      sim-outorder to run (default $ooo_sim)\n".
+"           -tomopt <opts>   extra sim-safe options, e.g. \"-tom:rob 32\"\n".
+"           -oooopt <opts>   extra sim-outorder options\n".
+"           -keep            keep the simulator outputs and IPC traces\n".
+"\n".
+"         Example usage:\n".
+"\n".
+"           ipccheck -interval 50000 -tolerance 0.05 test-math\n".
+"\n";
+     exit -1;
+  }
+
+if ($interval < 1 || $tolerance <= 0 || $max_inst < $interval)
+  {
+    print STDERR "** FATAL ** need interval >= 1, tolerance > 0 and max >= interval\n";
+    exit -1;
+  }
+
+$prog = join(" ", @ARGV);
+$base = "ipccheck.$$";
+
+#
+# run both models
+#
+sub run_sim
+  {
+    local($sim, $opts, $ipc_opts, $tag) = @_;
+    local($cmd);
+
+    $cmd = "$sim -max:inst $max_inst $opts $ipc_opts ".
+	   "-redir:sim $base.$tag.out -redir:prog $base.$tag.prog $prog";
+    print STDERR "ipccheck: $cmd\n";
+    if (system($cmd) != 0)
+      {
+	print STDERR "** FATAL ** `$sim' failed, see $base.$tag.out\n";
+	exit -1;
+      }
+  }
+
+&run_sim($tom_sim, $tom_opts,
+	 "-tom:ipc $base.tom.ipc -tom:ipc:interval $interval", "tom");
+&run_sim($ooo_sim, $ooo_opts,
+	 "-ipc:file $base.ooo.ipc -ipc:interval $interval", "ooo");
+
+#
+# read the cycle every interval ended at, returns the interval IPCs
+#
+sub read_ipc
+  {
+    local($fname, $tag) = @_;
+    local(@ipc, $last_insn, $last_cycle);
+
+    if (!open(IPC_FILE, $fname))
+      {
+	# a simulator that only writes its trace at -max:inst writes none
+	# if the program exits first
+	print STDERR "** FATAL ** no IPC trace `$fname', the run ended before ".
+	  "-max $max_inst without writing one, see $base.$tag.out\n";
+	exit -1;
+      }
+    $last_insn = 0;
+    $last_cycle = 0;
+    while (<IPC_FILE>)
+      {
+	if (/^(\d+)\s+(\d+)$/)
+	  {
+	    push(@ipc, ($1 - $last_insn) / ($2 > $last_cycle ? $2 - $last_cycle : 1));
+	    $last_insn = $1;
+	    $last_cycle = $2;
+	  }
+	else
+	  {
+	    print "** WARNING ** could not parse line: `$_'\n";
+	  }
+      }
+    close(IPC_FILE);
+    return @ipc;
+  }
+
+@tom_ipc = &read_ipc("$base.tom.ipc", "tom");
+@ooo_ipc = &read_ipc("$base.ooo.ipc", "ooo");
+
+$n = @tom_ipc < @ooo_ipc ? @tom_ipc : @ooo_ipc;
+if ($n == 0)
+  {
+    print STDERR "** FATAL ** no complete interval, lower -interval or raise -max\n";
+    exit -1;
+  }
+if (@tom_ipc != @ooo_ipc)
+  {
+    printf "** WARNING ** interval counts differ (tomasulo %d, sim-outorder %d), comparing %d\n",
+      scalar(@tom_ipc), scalar(@ooo_ipc), $n;
+  }
+
+#
+# compare interval by interval
+#
+print "Interval IPC of `$prog', $interval instructions per interval.\n";
+print "Intervals differing by more than $tolerance are marked with `*'.\n";
+print "\n";
+printf "%8s %12s %10s %10s %9s\n",
+  "interval", "end_insn", "tomasulo", "outorder", "rel_diff";
+
+$diverged = 0;
+$sum_diff = 0;
+$max_diff = 0;
+for ($i = 0; $i < $n; $i++)
+  {
+    $diff = ($tom_ipc[$i] - $ooo_ipc[$i]) / $ooo_ipc[$i];
+    $adiff = $diff < 0 ? -$diff : $diff;
+    $sum_diff += $adiff;
+    $max_diff = $adiff if ($adiff > $max_diff);
+    if ($adiff > $tolerance)
+      {
+	$diverged++;
+      }
+    printf "%8d %12d %10.4f %10.4f %+9.4f%s\n", $i + 1, ($i + 1) * $interval,
+      $tom_ipc[$i], $ooo_ipc[$i], $diff, $adiff > $tolerance ? " *" : "";
+  }
+
+print "\n";
+printf "%d of %d intervals diverged, mean |rel_diff| %.4f, max %.4f\n",
+  $diverged, $n, $sum_diff / $n, $max_diff;
+
+if (!$keep)
+  {
+    unlink("$base.tom.out", "$base.tom.prog", "$base.tom.ipc",
+	   "$base.ooo.out", "$base.ooo.prog", "$base.ooo.ipc");
+  }
+
+exit($diverged ? 1 : 0);
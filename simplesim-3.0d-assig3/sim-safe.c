@@ -66,6 +66,8 @@
 #include "sim.h"
 
 #include "instr.h"
+#include "tomasulo.h"
+#include "tomcache.h"
 #include "decode.def"
 #include <assert.h>
 
@@ -93,6 +95,30 @@ static counter_t sim_num_tom_cycles = 0;
 /* maximum number of inst's to execute */
 static unsigned int max_insts;
 
+/* ECE552 BEGIN */
+/* file the decoded instruction trace is dumped to, NULL for none */
+static char *tom_trace_fname = NULL;
+static FILE *tom_trace_fd = NULL;
+
+/* file the per-instruction timing table is dumped to, NULL for none */
+static char *tom_timing_fname = NULL;
+
+/* number of critical path instructions listed, -1 to skip the analysis */
+static int tom_crit_top;
+
+/* number of static instructions listed by stall cycles, -1 to skip */
+static int tom_pc_stalls_top;
+
+/* file the interval IPC trace is written to (NULL for none), and the
+   number of instructions per interval */
+static char *tom_ipc_fname = NULL;
+static int tom_ipc_interval;
+
+/* machine simulated by the Tomasulo model, and its statistics */
+static tom_config_t tom_config;
+static tom_stats_t tom_stats;
+/* ECE552 END */
+
 /* register simulator-specific options */
 void
 sim_reg_options(struct opt_odb_t *odb)
@@ -110,13 +136,58 @@ sim_reg_options(struct opt_odb_t *odb)
 	       &max_insts, /* default */0,
 	       /* print */TRUE, /* format */NULL);
 
+  /* ECE552 BEGIN */
+  opt_reg_string(odb, "-tom:trace",
+		 "dump the decoded instruction trace to this file for "
+		 "tomreplay (a .gz suffix compresses it)",
+		 &tom_trace_fname, /* default */NULL,
+		 /* print */TRUE, /* format */NULL);
+
+  opt_reg_string(odb, "-tom:timing",
+		 "dump the per-instruction tomasulo timing table to this file "
+		 "for tomview (a .gz suffix compresses it)",
+		 &tom_timing_fname, /* default */NULL,
+		 /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:crit",
+	      "analyze the dataflow critical path of the trace, listing this "
+	      "many of its static instructions (-1 to skip)",
+	      &tom_crit_top, /* default */-1,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:pcstalls",
+	      "list this many static instructions by tomasulo stall cycles, "
+	      "with the cycles lost to each reason (-1 to skip)",
+	      &tom_pc_stalls_top, /* default */-1,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_string(odb, "-tom:ipc",
+		 "write the cycle every -tom:ipc:interval tomasulo instructions "
+		 "are done to this file (for ipccheck.pl)",
+		 &tom_ipc_fname, /* default */NULL,
+		 /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:ipc:interval",
+	      "instructions per interval of the -tom:ipc trace",
+	      &tom_ipc_interval, /* default */100000,
+	      /* print */TRUE, /* format */NULL);
+
+  tom_reg_options(odb, &tom_config);
+  tom_cache_reg_options(odb);
+  /* ECE552 END */
 }
 
 /* check simulator-specific option values */
 void
 sim_check_options(struct opt_odb_t *odb, int argc, char **argv)
 {
-  /* nada */
+  /* ECE552 BEGIN */
+  tom_check_config(&tom_config);
+  tom_cache_check_options(&tom_config);
+
+  if (tom_ipc_interval < 1)
+    fatal("tomasulo IPC interval must be at least one instruction");
+  /* ECE552 END */
 }
 
 /* register simulator-specific statistics */
@@ -141,6 +212,8 @@ sim_reg_stats(struct stat_sdb_t *sdb)
   stat_reg_counter(sdb, "sim_num_tom_cycles",
 		   "total number of cycles with tomasulo",
 		   &sim_num_tom_cycles, 0, NULL);
+  tom_reg_stats(sdb, &tom_stats, &tom_config);
+  tom_cache_reg_stats(sdb);
   /* ECE552 END */
 
   ld_reg_stats(sdb);
@@ -189,11 +262,18 @@ sim_aux_stats(FILE *stream)		/* output stream */
   /* nada */
 }
 
+/* ECE552 BEGIN */
+static void tom_finish(int exited);
+/* ECE552 END */
+
 /* un-initialize simulator-specific state */
 void
 sim_uninit(void)
 {
-  /* nada */
+  /* ECE552 BEGIN */
+  /* the program may exit before sim_main() reaches -max:inst */
+  tom_finish(/* exited */TRUE);
+  /* ECE552 END */
 }
 
 
@@ -290,6 +370,77 @@ sim_uninit(void)
 
 /* ECE552 BEGIN */
 instruction_trace_t* instruction_trace;
+
+/* run the Tomasulo model on the trace collected so far and write its
+   outputs, once: called when sim_main() reaches -max:inst, or from
+   sim_uninit() if the program exited first, in which case the stats have
+   already been printed without the Tomasulo ones */
+static void
+tom_finish(int exited)
+{
+  if (!instruction_trace)
+    return;
+
+  if (tom_trace_fd)
+    {
+      close_instr_file(tom_trace_fd);
+      tom_trace_fd = NULL;
+    }
+
+  if (tom_ipc_fname)
+    {
+      tom_stats.ipc_interval = tom_ipc_interval;
+      tom_stats.ipc_stream = fopen(tom_ipc_fname, "w");
+      if (!tom_stats.ipc_stream)
+        fatal("cannot open IPC trace file `%s'", tom_ipc_fname);
+    }
+
+  if (tom_pc_stalls_top >= 0)
+    tom_stats.pc_stalls = tom_pc_stalls_create();
+
+  if (tom_timing_fname)
+    {
+      tom_timing_t *timing = tom_timing_create(sim_num_insn);
+
+      sim_num_tom_cycles = tom_run(&tom_config, instruction_trace,
+                                   sim_num_insn, timing, &tom_stats);
+      write_timing_file(tom_timing_fname, instruction_trace, timing);
+      tom_timing_free(timing);
+    }
+  else
+    sim_num_tom_cycles = tom_run(&tom_config, instruction_trace,
+                                 sim_num_insn, /* timing */NULL, &tom_stats);
+
+  if (tom_stats.ipc_stream)
+    {
+      fclose(tom_stats.ipc_stream);
+      tom_stats.ipc_stream = NULL;
+    }
+
+  if (tom_crit_top >= 0 && sim_num_insn > 0)
+    tom_critical_path(&tom_config, instruction_trace, sim_num_insn,
+                      sim_num_tom_cycles, tom_crit_top, stderr);
+
+  if (tom_stats.pc_stalls)
+    {
+      tom_pc_stalls_print(tom_stats.pc_stalls, tom_pc_stalls_top, stderr);
+      tom_pc_stalls_free(tom_stats.pc_stalls);
+      tom_stats.pc_stalls = NULL;
+    }
+
+  /* print_all_instr(instruction_trace, timing, sim_num_insn) prints the
+     timing table as text, tomview renders a -tom:timing dump instead */
+
+  free(instruction_trace);
+  instruction_trace = NULL;
+
+  if (exited)
+    {
+      fprintf(stderr, "\nsim: ** simulation statistics, "
+              "with the Tomasulo model **\n");
+      stat_print_stats(sim_sdb, stderr);
+    }
+}
 /* ECE552 END */
 
 /* start simulation, program loaded, processor precise state initialized */
@@ -311,6 +462,9 @@ sim_main(void)
   memset(instruction_trace, 0, sizeof(instruction_trace_t));
   //skip the first entry
   instruction_trace->size++;
+
+  if (tom_trace_fname)
+    tom_trace_fd = open_instr_file(tom_trace_fname);
   /* ECE552 END */
 
   fprintf(stderr, "sim: ** starting functional simulation **\n");
@@ -374,7 +528,11 @@ sim_main(void)
       }
 
       /* ECE552 BEGIN */
+      /* the memory macros leave the effective address in addr */
+      m_instr.addr = (MD_OP_FLAGS(op) & F_MEM) ? addr : 0;
       put_instr(instruction_trace, &m_instr);
+      if (tom_trace_fd)
+        write_instr(tom_trace_fd, &m_instr);
       /* ECE552 END */
 
       if (fault != md_fault_none)
@@ -415,11 +573,6 @@ sim_main(void)
     }
 
     /* ECE552 BEGIN */
-
-    sim_num_tom_cycles = runTomasulo(instruction_trace);
-  
-    //print_all_instr(instruction_trace, sim_num_insn);
-
-    free(instruction_trace);
+    tom_finish(/* exited */FALSE);
     /* ECE552 END */
 }
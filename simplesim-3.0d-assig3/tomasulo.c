@@ -1,9 +1,10 @@
-
 #include <limits.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "host.h"
@@ -20,8 +21,9 @@
 #include "decode.def"
 
 #include "instr.h"
+#include "tomasulo.h"
 
-/* PARAMETERS OF THE TOMASULO'S ALGORITHM */
+/* PARAMETERS OF THE TOMASULO'S ALGORITHM (defaults, see tom_params) */
 
 #define INSTR_QUEUE_SIZE         16
 
@@ -33,6 +35,26 @@
 #define FU_INT_LATENCY     5
 #define FU_FP_LATENCY      7
 
+//no reorder buffer and perfect branch prediction, as in the assignment
+#define ROB_SIZE           0
+#define COMMIT_WIDTH       1
+#define BPRED              TOM_BPRED_PERFECT
+#define BIMOD_SIZE         2048
+#define REDIRECT_PENALTY   2
+
+//no load/store queue, loads do not wait for older stores
+#define LSQ_SIZE           0
+
+//no physical register file, renaming is bounded by reservation stations
+#define PRF_SIZE           0
+
+//one instruction fetched and dispatched per cycle, issue limited only by
+//the functional units, and a single CDB
+#define FETCH_WIDTH        1
+#define DISPATCH_WIDTH     1
+#define ISSUE_WIDTH        0
+#define NUM_CDBS           1
+
 /* IDENTIFYING INSTRUCTIONS */
 
 //unconditional branch, jump or call
@@ -55,7 +77,10 @@
 #define IS_STORE(op) (MD_OP_FLAGS(op) & F_STORE)
 
 //trap instruction
-#define IS_TRAP(op) (MD_OP_FLAGS(op) & F_TRAP) 
+#define IS_TRAP(op) (MD_OP_FLAGS(op) & F_TRAP)
+
+//size of an instruction, a branch is taken if its successor is elsewhere
+#define INSTR_SIZE sizeof(md_inst_t)
 
 #define USES_INT_FU(op) (IS_ICOMP(op) || IS_LOAD(op) || IS_STORE(op))
 #define USES_FP_FU(op) (IS_FCOMP(op))
@@ -75,93 +100,870 @@
   md_print_insn(instr->inst, instr->pc, out); \
   myfprintf(stdout, "(%d)\n",instr->index);
 
+/* MACHINE PARAMETERS */
+
+//every parameter is a -tom:<name> option and a <name>=<value> sweep key
+static struct tom_param
+{
+  char* name;    //option/sweep key
+  char* desc;    //option description
+  int offset;    //offset of the int field in tom_config_t
+  int def_val;   //default value
+  int min_val;   //smallest legal value
+  int max_val;   //largest legal value
+} tom_params[] = {
+  { "iq", "instruction queue size",
+    offsetof(tom_config_t, instr_queue_size), INSTR_QUEUE_SIZE, 1, INT_MAX },
+  { "rsint", "number of integer reservation stations",
+    offsetof(tom_config_t, reserv_int_size), RESERV_INT_SIZE, 1, INT_MAX },
+  { "rsfp", "number of floating-point reservation stations",
+    offsetof(tom_config_t, reserv_fp_size), RESERV_FP_SIZE, 1, INT_MAX },
+  { "fuint", "number of integer functional units",
+    offsetof(tom_config_t, fu_int_size), FU_INT_SIZE, 1, INT_MAX },
+  { "fufp", "number of floating-point functional units",
+    offsetof(tom_config_t, fu_fp_size), FU_FP_SIZE, 1, INT_MAX },
+  { "latint", "integer functional unit latency (in cycles)",
+    offsetof(tom_config_t, fu_int_latency), FU_INT_LATENCY, 1, INT_MAX },
+  { "latfp", "floating-point functional unit latency (in cycles)",
+    offsetof(tom_config_t, fu_fp_latency), FU_FP_LATENCY, 1, INT_MAX },
+  { "rob", "reorder buffer entries (0 for no reorder buffer)",
+    offsetof(tom_config_t, rob_size), ROB_SIZE, 0, INT_MAX },
+  { "commitw", "instructions committed per cycle from the reorder buffer",
+    offsetof(tom_config_t, commit_width), COMMIT_WIDTH, 1, INT_MAX },
+  { "bpred", "branch predictor (0 perfect, 1 taken, 2 not taken, 3 bimodal)",
+    offsetof(tom_config_t, bpred), BPRED, TOM_BPRED_PERFECT, TOM_BPRED_BIMOD },
+  { "bimod", "bimodal predictor table entries (a power of two)",
+    offsetof(tom_config_t, bimod_size), BIMOD_SIZE, 1, INT_MAX },
+  { "penalty", "cycles from a mispredicted branch resolving to fetch resuming",
+    offsetof(tom_config_t, redirect_penalty), REDIRECT_PENALTY, 0, INT_MAX },
+  { "lsq", "load/store queue entries (0 for no load/store queue)",
+    offsetof(tom_config_t, lsq_size), LSQ_SIZE, 0, INT_MAX },
+  { "prf", "physical registers renamed onto (0 for no physical register file, "
+    "else at least the architectural registers + 2)",
+    offsetof(tom_config_t, prf_size), PRF_SIZE, 0, INT_MAX },
+  { "fetchw", "instructions fetched into the instruction queue per cycle",
+    offsetof(tom_config_t, fetch_width), FETCH_WIDTH, 1, INT_MAX },
+  { "dispw", "instructions moved from the queue to reservation stations per cycle",
+    offsetof(tom_config_t, dispatch_width), DISPATCH_WIDTH, 1, INT_MAX },
+  { "issuew", "instructions entering execute per cycle (0 for one per free unit)",
+    offsetof(tom_config_t, issue_width), ISSUE_WIDTH, 0, INT_MAX },
+  { "cdbs", "common data buses, results written back per cycle",
+    offsetof(tom_config_t, num_cdbs), NUM_CDBS, 1, INT_MAX },
+};
+
+#define NUM_TOM_PARAMS (sizeof(tom_params) / sizeof(tom_params[0]))
+
+//the int field of config described by param
+#define TOM_PARAM(config, param) \
+  ((int*)((char*)(config) + (param)->offset))
+
+/* SLOT MASKS */
+
+//reservation stations of both classes share one slot numbering, sets of
+//slots are bit masks so the oldest member of a set is found with
+//find-first-set and a few word operations instead of sorting
+typedef unsigned long long tom_mask_t;
+
+#define MASK_BITS 64
+#define MASK_WORDS(n) (((n) + MASK_BITS - 1) / MASK_BITS)
+
+#define MASK_SET(m, i)   ((m)[(i) / MASK_BITS] |= 1ULL << ((i) % MASK_BITS))
+#define MASK_CLEAR(m, i) ((m)[(i) / MASK_BITS] &= ~(1ULL << ((i) % MASK_BITS)))
+#define MASK_TEST(m, i)  (((m)[(i) / MASK_BITS] >> ((i) % MASK_BITS)) & 1)
+
+//index of the lowest set bit of a non-zero word, and number of set bits
+#ifdef __GNUC__
+#define WORD_FFS(w) __builtin_ctzll(w)
+#define WORD_POPCOUNT(w) __builtin_popcountll(w)
+#else
+static int word_ffs(tom_mask_t w) {
+  int i = 0;
+  while (!(w & 1)) { w >>= 1; i++; }
+  return i;
+}
+static int word_popcount(tom_mask_t w) {
+  int n = 0;
+  for (; w; w &= w - 1) n++;
+  return n;
+}
+#define WORD_FFS(w) word_ffs(w)
+#define WORD_POPCOUNT(w) word_popcount(w)
+#endif
+
+//visits every set bit i of mask m (words long), lowest first
+#define FOR_EACH_SLOT(i, m, words, w, bits) \
+  for ((w) = 0; (w) < (words); (w)++) \
+    for ((bits) = (m)[w]; (bits) && ((i) = (w) * MASK_BITS + WORD_FFS(bits), 1); \
+         (bits) &= (bits) - 1)
+
 /* VARIABLES */
 
-//instruction queue for tomasulo
-static instruction_t* instr_queue[INSTR_QUEUE_SIZE];
-//number of instructions in the instruction queue
-static int instr_queue_size = 0;
+//a reservation station entry (each entry contains a pointer to an instruction)
+typedef struct tom_rs_entry
+{
+  instruction_t* instr;  //NULL if the entry is free
+
+  //the equivalents of Qj, Qk are the entry's row of the dependency matrix
+
+  int execute_cycle;     //cycle the instruction entered execute, 0 if not yet
+  int rob_entry;         //reorder buffer entry of the instruction, -1 if none
+  int latency;           //cycles the instruction executes for
+
+  //with a physical register file, the registers read (until execute), the
+  //registers written and the ones they replace in the rename table (-1 if none)
+  int src_phys[3];
+  int dest_phys[2];
+  int prev_phys[2];
+}tom_rs_entry_t;
+
+//a reorder buffer entry, instructions commit in order once complete
+typedef struct tom_rob_entry
+{
+  instruction_t* instr;
+  int complete_cycle;    //cycle the instruction completed, 0 if not yet
+  int prev_phys[2];      //physical registers released at commit (-1 if none)
+}tom_rob_entry_t;
+
+//state of one run of the model; everything that changes while simulating
+//lives here so concurrent runs can share a read-only trace
+typedef struct tom_state
+{
+  tom_config_t* config;
+  tom_timing_t* timing;  //per-instruction results, NULL if not recorded
+  tom_stats_t* stats;    //statistics, NULL if not collected
+  instruction_trace_t* trace;
+  counter_t num_insn;
+
+  //instruction queue for tomasulo
+  instruction_t** instr_queue;
+  //number of instructions in the instruction queue
+  int instr_queue_size;
+  int oldest_instr_index;
+
+  //reservation stations, slots [0, reserv_int_size) are the integer ones
+  //and the floating-point ones follow
+  tom_rs_entry_t* reserv;
+  int num_slots;
+  int words;             //mask words covering num_slots
+
+  tom_mask_t* int_slots; //the integer reservation stations
+  tom_mask_t* fp_slots;  //the floating-point reservation stations
+  tom_mask_t* busy;      //slots holding an instruction
+  tom_mask_t* ready;     //operands available, waiting for a functional unit
+  tom_mask_t* executing; //holding a functional unit (until the CDB)
+  tom_mask_t* loads;     //slots holding a load
+  tom_mask_t* stores;    //slots holding a store
+  tom_mask_t* stores_waiting; //stores whose address is not known yet
+
+  //age matrix, row i has a bit set for every slot holding an instruction
+  //older than the one in slot i
+  tom_mask_t* older;
+
+  //dependency matrix, row i has a bit set for every column producing an
+  //operand slot i still waits for; columns [0, num_slots) are reservation
+  //stations and column num_slots + b is the result on CDB b (a result moves
+  //there when it gets the bus, so its station can be reused at once). The
+  //transpose is kept as well, waiters of column c lists the slots with bit
+  //c set, so a broadcast only visits the slots it wakes up
+  tom_mask_t* deps;
+  int dep_words;         //mask words covering a row of deps
+  tom_mask_t* waiters;
+
+  //functional units in use; units of a class are identical, so a count
+  int fu_int_busy;
+  int fu_fp_busy;
+
+  //common data buses, the index of the instruction on each (0 if idle)
+  int* commonDataBus;
+
+  //The map table keeps track of which reservation station (or the CDB)
+  //produces the value for each register, as its dependency matrix column
+  //plus one (0 if the register file holds the value)
+  int map_table[MD_TOTAL_REGS];
+
+  //the index of the last instruction fetched
+  int fetch_index;
+
+  //reorder buffer, a circular buffer in program order (NULL if disabled)
+  tom_rob_entry_t* rob;
+  int rob_head;
+  int rob_count;
+
+  //branch predictor and its state
+  tom_bpred_t* bpred;
+  void* bpred_state;
+
+  //load/store queue entries in use, every load and store in a
+  //reservation station holds one when there is a load/store queue
+  int lsq_count;
+
+  //memory latency model and its state
+  tom_mem_t* mem;
+  void* mem_state;
+
+  //physical register file (with prf_size > 0): the physical register each
+  //architectural register is renamed to, a FIFO free list, and for every
+  //physical register whether its value is still being produced, how many
+  //reservation stations have yet to read it and whether a younger mapping
+  //of its architectural register has replaced it
+  int rename_table[MD_TOTAL_REGS];
+  int* free_list;
+  int free_head;
+  int free_count;
+  bool* prf_pending;
+  int* prf_readers;
+  bool* prf_superseded;
+
+  //index of a fetched mispredicted branch that has not resolved (0 if
+  //none), fetch stops until it has executed and resume_cycle is reached
+  int mispredict_index;
+  int resume_cycle;
+
+  //the last mispredicted branch, the fetch stalls are charged to it
+  instruction_t* mispredict_instr;
+
+  //instructions done so far, for the interval IPC trace
+  int done_count;
+
+  //per-cycle scratch masks
+  tom_mask_t* candidates;
+  tom_mask_t* selectable;
+  tom_mask_t* finished;
+}tom_state_t;
+
+//row i of the age matrix
+#define OLDER_ROW(s, i) (&(s)->older[(i) * (s)->words])
+
+//row i of the dependency matrix, the slots waiting for column c, and the
+//column of the result on CDB b
+#define DEP_ROW(s, i) (&(s)->deps[(i) * (s)->dep_words])
+#define WAITERS(s, c) (&(s)->waiters[(c) * (s)->words])
+#define CDB_COL(s, b) ((s)->num_slots + (b))
+
+//true if instructions are renamed onto a physical register file
+#define HAS_PRF(s) ((s)->config->prf_size > 0)
+
+//true if slot i is one of the integer reservation stations
+#define IS_INT_SLOT(s, i) ((i) < (s)->config->reserv_int_size)
+
+//adds n to a stall or event counter, if statistics are collected
+#define STAT_ADD(s, counter, n) \
+  do { if ((s)->stats) (s)->stats->counter += (n); } while (0)
+
+//records the cycle an instruction entered a stage, if timing is kept
+#define SET_TIMING(s, stage, instr, cycle) \
+  do { if ((s)->timing) (s)->timing->stage[(instr)->index] = (cycle); } while (0)
+
+/* MACHINE CONFIGURATION */
+
+//fills in the default machine (the assignment's configuration)
+void tom_default_config(tom_config_t* config) {
+
+  int i;
+  for (i = 0; i < NUM_TOM_PARAMS; i++)
+    *TOM_PARAM(config, &tom_params[i]) = tom_params[i].def_val;
+
+  config->bpred_hook = NULL;
+  config->mem_hook = NULL;
+}
+
+//registers a -tom:<param> option for every machine parameter
+void tom_reg_options(struct opt_odb_t* odb, tom_config_t* config) {
+
+  int i;
+  char buf[128];
+
+  for (i = 0; i < NUM_TOM_PARAMS; i++) {
+    sprintf(buf, "-tom:%s", tom_params[i].name);
+    opt_reg_int(odb, mystrdup(buf), tom_params[i].desc,
+                TOM_PARAM(config, &tom_params[i]), tom_params[i].def_val,
+                /* print */TRUE, /* format */NULL);
+  }
+  config->bpred_hook = NULL;
+  config->mem_hook = NULL;
+}
+
+//checks that the machine parameters are usable, fatal() otherwise
+void tom_check_config(tom_config_t* config) {
+
+  int i;
+  for (i = 0; i < NUM_TOM_PARAMS; i++) {
+    if (*TOM_PARAM(config, &tom_params[i]) < tom_params[i].min_val)
+      fatal("tomasulo parameter `%s' must be at least %d",
+            tom_params[i].name, tom_params[i].min_val);
+    if (*TOM_PARAM(config, &tom_params[i]) > tom_params[i].max_val)
+      fatal("tomasulo parameter `%s' must be at most %d",
+            tom_params[i].name, tom_params[i].max_val);
+  }
+
+  if (config->bimod_size & (config->bimod_size - 1))
+    fatal("tomasulo parameter `bimod' must be a power of two");
+
+  //every architectural register holds a physical one, renaming needs a free
+  //one per destination, two for MULT/DIV (HI and LO)
+  if (config->prf_size > 0 && config->prf_size < MD_TOTAL_REGS + 2)
+    fatal("tomasulo parameter `prf' must be 0 or at least %d", MD_TOTAL_REGS + 2);
+}
+
+//sets the parameters listed as `name=value' pairs in str
+void tom_parse_config(tom_config_t* config, char* str) {
+
+  char name[128];
+  int value, len, i;
+
+  while (sscanf(str, " %127[^= \t\n]=%d%n", name, &value, &len) == 2) {
+    for (i = 0; i < NUM_TOM_PARAMS; i++) {
+      if (!strcmp(name, tom_params[i].name))
+        break;
+    }
+    if (i == NUM_TOM_PARAMS)
+      fatal("unknown tomasulo parameter `%s'", name);
+
+    *TOM_PARAM(config, &tom_params[i]) = value;
+    str += len;
+  }
+
+  //anything left over that is not whitespace is malformed
+  while (*str == ' ' || *str == '\t' || *str == '\n' || *str == '\r')
+    str++;
+  if (*str != '\0')
+    fatal("bad tomasulo parameters near `%s', expected <name>=<value>", str);
+}
+
+//prints the parameters as `name=value' pairs, in tom_parse_config() form
+void tom_print_config(tom_config_t* config, FILE* stream) {
+
+  int i;
+  for (i = 0; i < NUM_TOM_PARAMS; i++)
+    fprintf(stream, "%s%s=%d", i ? " " : "", tom_params[i].name,
+            *TOM_PARAM(config, &tom_params[i]));
+}
+
+/* PER-INSTRUCTION TIMING */
+
+//allocates zeroed timing arrays for num_insn instructions
+tom_timing_t* tom_timing_create(counter_t num_insn) {
+
+  tom_timing_t* timing = calloc(1, sizeof(tom_timing_t));
+  if (!timing)
+    fatal("out of virtual memory");
+
+  timing->num_insn = num_insn;
+  timing->dispatch_cycle = calloc(num_insn + 1, sizeof(int));
+  timing->issue_cycle = calloc(num_insn + 1, sizeof(int));
+  timing->execute_cycle = calloc(num_insn + 1, sizeof(int));
+  timing->cdb_cycle = calloc(num_insn + 1, sizeof(int));
+  timing->commit_cycle = calloc(num_insn + 1, sizeof(int));
+  if (!timing->dispatch_cycle || !timing->issue_cycle
+      || !timing->execute_cycle || !timing->cdb_cycle
+      || !timing->commit_cycle)
+    fatal("out of virtual memory");
+
+  return timing;
+}
+
+//frees timing arrays
+void tom_timing_free(tom_timing_t* timing) {
+
+  free(timing->dispatch_cycle);
+  free(timing->issue_cycle);
+  free(timing->execute_cycle);
+  free(timing->cdb_cycle);
+  free(timing->commit_cycle);
+  free(timing);
+}
+
+/* STATISTICS */
+
+//registers the statistics of runs of the given machine
+void tom_reg_stats(struct stat_sdb_t* sdb, tom_stats_t* stats, tom_config_t* config) {
+
+  memset(stats, 0, sizeof(tom_stats_t));
+
+  stats->iq_occupancy =
+    stat_reg_dist(sdb, "tom_iq_occupancy",
+                  "instruction queue occupancy (per cycle)",
+                  /* init */0, /* arr sz */config->instr_queue_size + 1,
+                  /* bucket sz */1, PF_COUNT|PF_PDF, NULL, NULL, NULL);
+  stats->rs_int_occupancy =
+    stat_reg_dist(sdb, "tom_rs_int_occupancy",
+                  "busy integer reservation stations (per cycle)",
+                  /* init */0, /* arr sz */config->reserv_int_size + 1,
+                  /* bucket sz */1, PF_COUNT|PF_PDF, NULL, NULL, NULL);
+  stats->rs_fp_occupancy =
+    stat_reg_dist(sdb, "tom_rs_fp_occupancy",
+                  "busy floating-point reservation stations (per cycle)",
+                  /* init */0, /* arr sz */config->reserv_fp_size + 1,
+                  /* bucket sz */1, PF_COUNT|PF_PDF, NULL, NULL, NULL);
+  stats->fu_int_busy =
+    stat_reg_dist(sdb, "tom_fu_int_busy",
+                  "busy integer functional units (per cycle)",
+                  /* init */0, /* arr sz */config->fu_int_size + 1,
+                  /* bucket sz */1, PF_COUNT|PF_PDF, NULL, NULL, NULL);
+  stats->fu_fp_busy =
+    stat_reg_dist(sdb, "tom_fu_fp_busy",
+                  "busy floating-point functional units (per cycle)",
+                  /* init */0, /* arr sz */config->fu_fp_size + 1,
+                  /* bucket sz */1, PF_COUNT|PF_PDF, NULL, NULL, NULL);
+  if (config->prf_size > 0)
+    stats->prf_occupancy =
+      stat_reg_dist(sdb, "tom_prf_occupancy",
+                    "physical registers renamed to in-flight results (per cycle)",
+                    /* init */0, /* arr sz */config->prf_size - MD_TOTAL_REGS + 1,
+                    /* bucket sz */1, PF_COUNT|PF_PDF, NULL, NULL, NULL);
+
+  stat_reg_counter(sdb, "tom_stall_rs_full",
+                   "cycles the queue head waited for a reservation station",
+                   &stats->stall_rs_full, 0, NULL);
+  stat_reg_counter(sdb, "tom_stall_rob_full",
+                   "cycles the queue head waited for a reorder buffer entry",
+                   &stats->stall_rob_full, 0, NULL);
+  stat_reg_counter(sdb, "tom_stall_lsq_full",
+                   "cycles the queue head waited for a load/store queue entry",
+                   &stats->stall_lsq_full, 0, NULL);
+  stat_reg_counter(sdb, "tom_stall_prf_full",
+                   "cycles the queue head waited for a free physical register",
+                   &stats->stall_prf_full, 0, NULL);
+  stat_reg_counter(sdb, "tom_stall_raw",
+                   "instruction-cycles waiting for operands (RAW)",
+                   &stats->stall_raw, 0, NULL);
+  stat_reg_counter(sdb, "tom_stall_mem_order",
+                   "load-cycles waiting for older store addresses",
+                   &stats->stall_mem_order, 0, NULL);
+  stat_reg_counter(sdb, "tom_stall_fu_busy",
+                   "instruction-cycles ready but all functional units busy",
+                   &stats->stall_fu_busy, 0, NULL);
+  stat_reg_counter(sdb, "tom_stall_cdb",
+                   "instruction-cycles finished but the CDB taken",
+                   &stats->stall_cdb, 0, NULL);
+  stat_reg_counter(sdb, "tom_stall_fetch",
+                   "fetch cycles lost to branch mispredictions",
+                   &stats->stall_fetch, 0, NULL);
+
+  stat_reg_counter(sdb, "tom_branches",
+                   "conditional branches fetched",
+                   &stats->branches, 0, NULL);
+  stat_reg_counter(sdb, "tom_mispredicts",
+                   "conditional branches mispredicted",
+                   &stats->mispredicts, 0, NULL);
+  stat_reg_formula(sdb, "tom_bpred_rate",
+                   "branch prediction rate (i.e., 1 - mispredicts/branches)",
+                   "1 - tom_mispredicts / tom_branches", NULL);
+  stat_reg_counter(sdb, "tom_forwards",
+                   "loads given their value by an older store",
+                   &stats->forwards, 0, NULL);
+}
+
+//column headers of the per-PC stall table, in enum tom_stall order
+static char* tom_stall_names[NUM_TOM_STALLS] = {
+  "rs", "rob", "lsq", "prf", "raw", "mem", "fu", "cdb", "fetch"
+};
+
+//allocates an empty per-PC stall table
+tom_pc_stall_table_t* tom_pc_stalls_create(void) {
+
+  tom_pc_stall_table_t* table = calloc(1, sizeof(tom_pc_stall_table_t));
+  if (!table)
+    fatal("out of virtual memory");
+  return table;
+}
+
+//returns the entry of the static instruction at pc, adding it if needed
+static tom_pc_stalls_t* pc_stalls_lookup(tom_pc_stall_table_t* table, md_addr_t pc) {
+
+  if (2 * (table->used + 1) > table->size) {
+    tom_pc_stall_table_t bigger;
+    int i;
+
+    bigger.size = table->size ? 2 * table->size : 1024;
+    bigger.used = 0;
+    bigger.entries = calloc(bigger.size, sizeof(tom_pc_stalls_t));
+    if (!bigger.entries)
+      fatal("out of virtual memory");
+
+    for (i = 0; i < table->size; i++) {
+      if (table->entries[i].total) {
+        *pc_stalls_lookup(&bigger, table->entries[i].pc) = table->entries[i];
+      }
+    }
+    free(table->entries);
+    *table = bigger;
+  }
+
+  unsigned int h = (pc / sizeof(md_inst_t)) * 2654435761u;
+  for (int i = h & (table->size - 1); ; i = (i + 1) & (table->size - 1)) {
+    tom_pc_stalls_t* e = &table->entries[i];
+    if (e->total == 0) {
+      e->pc = pc;
+      table->used++;
+      return e;
+    }
+    if (e->pc == pc)
+      return e;
+  }
+}
+
+//most stall cycles first
+static int pc_stalls_compare(const void* a, const void* b) {
+
+  const tom_pc_stalls_t* x = a;
+  const tom_pc_stalls_t* y = b;
+
+  if (x->total != y->total)
+    return (x->total < y->total) ? 1 : -1;
+  return (x->pc < y->pc) ? -1 : (x->pc > y->pc);
+}
+
+//prints the top static instructions of the table by stall cycles, with
+//their cycles lost to each reason, to stream
+void tom_pc_stalls_print(tom_pc_stall_table_t* table, int top, FILE* stream) {
+
+  tom_pc_stalls_t* pcs = calloc(table->used + 1, sizeof(tom_pc_stalls_t));
+  counter_t sum = 0;
+  int n = 0, i, r;
+
+  if (!pcs)
+    fatal("out of virtual memory");
+  for (i = 0; i < table->size; i++) {
+    if (table->entries[i].total) {
+      pcs[n++] = table->entries[i];
+      sum += table->entries[i].total;
+    }
+  }
+  qsort(pcs, n, sizeof(tom_pc_stalls_t), pc_stalls_compare);
+
+  fprintf(stream, "\ntomasulo stalls by static instruction (%d static "
+          "instructions, %.0f stall cycles)\n", n, (double)sum);
+  if (top > 0 && n > 0) {
+    fprintf(stream, "  %10s  %-10s %10s %6s", "pc", "op", "total", "%");
+    for (r = 0; r < NUM_TOM_STALLS; r++)
+      fprintf(stream, " %9s", tom_stall_names[r]);
+    fprintf(stream, "\n");
+    for (i = 0; i < n && i < top; i++) {
+      fprintf(stream, "  0x%08x  %-10s %10.0f %6.2f", (word_t)pcs[i].pc,
+              MD_OP_NAME(pcs[i].op), (double)pcs[i].total,
+              100.0 * pcs[i].total / sum);
+      for (r = 0; r < NUM_TOM_STALLS; r++)
+        fprintf(stream, " %9.0f", (double)pcs[i].stalls[r]);
+      fprintf(stream, "\n");
+    }
+  }
+
+  free(pcs);
+}
+
+//frees a per-PC stall table
+void tom_pc_stalls_free(tom_pc_stall_table_t* table) {
+
+  free(table->entries);
+  free(table);
+}
+
+/* BRANCH PREDICTION */
 
-//reservation stations (each reservation station entry contains a pointer to an instruction)
-static instruction_t* reservINT[RESERV_INT_SIZE];
-static instruction_t* reservFP[RESERV_FP_SIZE];
+//the perfect predictor is never asked, the model knows every direction
+static int bpred_taken(void* state, instruction_t* instr) { return 1; }
+static int bpred_nottaken(void* state, instruction_t* instr) { return 0; }
+static void bpred_static_update(void* state, instruction_t* instr, int taken) { }
 
-//functional units
-static instruction_t* fuINT[FU_INT_SIZE];
-static instruction_t* fuFP[FU_FP_SIZE];
+//bimodal predictor, a table of 2-bit saturating counters indexed by pc
+typedef struct tom_bimod
+{
+  int size;
+  unsigned char* counters;
+}tom_bimod_t;
+
+#define BIMOD_INDEX(b, pc) (((pc) / INSTR_SIZE) & ((b)->size - 1))
+
+static void* bpred_bimod_create(tom_config_t* config) {
+
+  tom_bimod_t* b = calloc(1, sizeof(tom_bimod_t));
+  if (!b)
+    fatal("out of virtual memory");
+
+  b->size = config->bimod_size;
+  b->counters = malloc(b->size);
+  if (!b->counters)
+    fatal("out of virtual memory");
+
+  //weakly taken
+  memset(b->counters, 2, b->size);
+  return b;
+}
+
+static int bpred_bimod_predict(void* state, instruction_t* instr) {
+
+  tom_bimod_t* b = state;
+  return b->counters[BIMOD_INDEX(b, instr->pc)] >= 2;
+}
 
-//common data bus
-static instruction_t* commonDataBus = NULL;
+static void bpred_bimod_update(void* state, instruction_t* instr, int taken) {
 
-//The map table keeps track of which instruction produces the value for each register
-static instruction_t* map_table[MD_TOTAL_REGS];
+  tom_bimod_t* b = state;
+  unsigned char* c = &b->counters[BIMOD_INDEX(b, instr->pc)];
 
-//the index of the last instruction fetched
-static int fetch_index = 0;
+  if (taken && *c < 3)
+    (*c)++;
+  else if (!taken && *c > 0)
+    (*c)--;
+}
 
-/* ECE552: Assignment 3 BEGIN CODE */
-static int available_index = 0;
-static int oldest_instr_index = 0;
+static void bpred_bimod_destroy(void* state) {
 
-/* ECE552: Assignment 3 END CODE */
+  tom_bimod_t* b = state;
+  free(b->counters);
+  free(b);
+}
+
+//built-in predictors, indexed by TOM_BPRED_*
+static tom_bpred_t tom_bpreds[] = {
+  { "perfect", NULL, NULL, NULL, NULL },
+  { "taken", NULL, bpred_taken, bpred_static_update, NULL },
+  { "nottaken", NULL, bpred_nottaken, bpred_static_update, NULL },
+  { "bimod", bpred_bimod_create, bpred_bimod_predict, bpred_bimod_update,
+    bpred_bimod_destroy },
+};
 
 /* FUNCTIONAL UNITS */
 
 /* RESERVATION STATIONS */
 
  /* ECE552: Assignment 3 BEGIN CODE */
-void addToInstrQ(instruction_t* instr)
+static void addToInstrQ(tom_state_t* s, instruction_t* instr)
+{
+  int available_index = (s->oldest_instr_index + s->instr_queue_size) % s->config->instr_queue_size;
+  s->instr_queue[available_index] = instr;
+  s->instr_queue_size++;
+}
+
+static void removeFromInstrQ(tom_state_t* s)
+{
+  s->instr_queue[s->oldest_instr_index] = NULL;
+  s->oldest_instr_index = (s->oldest_instr_index + 1) % s->config->instr_queue_size;
+  s->instr_queue_size--;
+}
+
+//true if no bit of mask m is set
+static bool mask_empty(tom_state_t* s, tom_mask_t* m)
+{
+  for(int w = 0; w < s->words; w++)
+    if(m[w])
+      return false;
+  return true;
+}
+
+//number of bits set in both a and b
+static int mask_count(tom_state_t* s, tom_mask_t* a, tom_mask_t* b)
+{
+  int n = 0;
+  for(int w = 0; w < s->words; w++)
+    n += WORD_POPCOUNT(a[w] & b[w]);
+  return n;
+}
+
+//true if a and b have a set bit in common
+static bool mask_intersects(tom_state_t* s, tom_mask_t* a, tom_mask_t* b)
+{
+  for(int w = 0; w < s->words; w++)
+    if(a[w] & b[w])
+      return true;
+  return false;
+}
+
+//the slot of cand holding the oldest instruction (the one with no older
+//slot in cand), -1 if cand is empty
+static int selectOldest(tom_state_t* s, tom_mask_t* cand)
+{
+  int i, w;
+  tom_mask_t bits;
+
+  FOR_EACH_SLOT(i, cand, s->words, w, bits)
+  {
+    tom_mask_t* row = OLDER_ROW(s, i);
+    bool oldest = true;
+
+    for(int k = 0; k < s->words && oldest; k++)
+      if(row[k] & cand[k])
+        oldest = false;
+
+    if(oldest)
+      return i;
+  }
+  return -1;
+}
+
+//frees the reservation station entry in slot i and the functional unit it holds
+static void releaseRS(tom_state_t* s, int i)
+{
+  if(IS_INT_SLOT(s, i))
+    s->fu_int_busy--;
+  else
+    s->fu_fp_busy--;
+
+  //a load leaves the load/store queue with its value, a store once it is written
+  if(s->config->lsq_size > 0 && (IS_LOAD(s->reserv[i].instr->op) || IS_STORE(s->reserv[i].instr->op)))
+    s->lsq_count--;
+
+  MASK_CLEAR(s->executing, i);
+  MASK_CLEAR(s->loads, i);
+  MASK_CLEAR(s->stores, i);
+  MASK_CLEAR(s->busy, i);
+  s->reserv[i].instr = NULL;
+}
+
+//appends instr to the reorder buffer, returns its entry (-1 if no ROB)
+static int allocateROB(tom_state_t* s, instruction_t* instr)
+{
+  if(s->rob == NULL)
+    return -1;
+
+  int entry = (s->rob_head + s->rob_count) % s->config->rob_size;
+  s->rob[entry].instr = instr;
+  s->rob[entry].complete_cycle = 0;
+  s->rob[entry].prev_phys[0] = s->rob[entry].prev_phys[1] = -1;
+  s->rob_count++;
+  return entry;
+}
+
+//marks a reorder buffer entry complete, it may commit from the next cycle
+static void completeROB(tom_state_t* s, int entry, int current_cycle)
+{
+  if(entry >= 0)
+    s->rob[entry].complete_cycle = current_cycle;
+}
+
+//a mispredicted branch has resolved, fetch goes down the correct path
+//after the redirect penalty
+static void redirectFetch(tom_state_t* s, int current_cycle)
 {
-  available_index = (oldest_instr_index + instr_queue_size) % INSTR_QUEUE_SIZE;
-  instr_queue[available_index] = instr;
-  instr_queue_size++;
+  s->mispredict_index = 0;
+  s->resume_cycle = current_cycle + s->config->redirect_penalty;
 }
 
-void removeFromInstrQ()
+//counts an instruction done, committed or (without a reorder buffer)
+//completed, and traces the cycle every ipc_interval instructions
+static void instrDone(tom_state_t* s, int current_cycle)
 {
-  instr_queue[oldest_instr_index] = NULL;
-  oldest_instr_index = (oldest_instr_index + 1) % INSTR_QUEUE_SIZE;
-  instr_queue_size--;
+  s->done_count++;
+  if(s->stats && s->stats->ipc_stream && s->done_count % s->stats->ipc_interval == 0)
+    fprintf(s->stats->ipc_stream, "%d %d\n", s->done_count, current_cycle);
+}
+
+//charges a stall cycle of the given reason to the static instruction of
+//instr, if there is a per-PC stall table
+static void stallPC(tom_state_t* s, enum tom_stall reason, instruction_t* instr)
+{
+  if(!s->stats || !s->stats->pc_stalls || instr == NULL)
+    return;
+
+  tom_pc_stalls_t* e = pc_stalls_lookup(s->stats->pc_stalls, instr->pc);
+  e->op = instr->op;
+  e->stalls[reason]++;
+  e->total++;
+}
+
+//charges a stall cycle to the instruction in every slot of m
+static void stallSlots(tom_state_t* s, enum tom_stall reason, tom_mask_t* m)
+{
+  int i, w;
+  tom_mask_t bits;
+
+  if(!s->stats || !s->stats->pc_stalls)
+    return;
+  FOR_EACH_SLOT(i, m, s->words, w, bits)
+    stallPC(s, reason, s->reserv[i].instr);
+}
+
+//returns physical register p to the free list once its value is written,
+//read by every reservation station waiting for it and no longer mapped
+static void freePhysReg(tom_state_t* s, int p)
+{
+  if(p < 0 || s->prf_pending[p] || s->prf_readers[p] != 0 || !s->prf_superseded[p])
+    return;
+
+  s->prf_superseded[p] = false;
+  s->free_list[(s->free_head + s->free_count) % s->config->prf_size] = p;
+  s->free_count++;
+}
+
+//marks physical register p replaced by a younger mapping that is now
+//complete (committed, with a reorder buffer)
+static void supersedePhysReg(tom_state_t* s, int p)
+{
+  if(p < 0)
+    return;
+
+  s->prf_superseded[p] = true;
+  freePhysReg(s, p);
+}
+
+//number of free physical registers instr needs to be renamed
+static int physRegsNeeded(instruction_t* instr)
+{
+  return (instr->r_out[0] != DNA) + (instr->r_out[1] != DNA);
+}
+
+//renames the registers of the instruction in rs onto physical registers,
+//the sources are looked up before the destinations take free ones
+static void renameRegs(tom_state_t* s, tom_rs_entry_t* rs)
+{
+  instruction_t* instr = rs->instr;
+
+  for(int j = 0; j < 3; j++)
+  {
+    rs->src_phys[j] = -1;
+    if(instr->r_in[j] != DNA)
+    {
+      rs->src_phys[j] = s->rename_table[instr->r_in[j]];
+      s->prf_readers[rs->src_phys[j]]++;
+    }
+  }
+
+  for(int j = 0; j < 2; j++)
+  {
+    rs->dest_phys[j] = rs->prev_phys[j] = -1;
+    if(instr->r_out[j] != DNA)
+    {
+      int p = s->free_list[s->free_head];
+      s->free_head = (s->free_head + 1) % s->config->prf_size;
+      s->free_count--;
+
+      s->prf_pending[p] = true;
+      rs->dest_phys[j] = p;
+      rs->prev_phys[j] = s->rename_table[instr->r_out[j]];
+      s->rename_table[instr->r_out[j]] = p;
+    }
+  }
+
+  //with a reorder buffer the replaced registers are released at commit
+  if(rs->rob_entry >= 0)
+    memcpy(s->rob[rs->rob_entry].prev_phys, rs->prev_phys, sizeof(rs->prev_phys));
 }
  /* ECE552: Assignment 3 END CODE */
 
-/* 
- * Description: 
+/*
+ * Description:
  * 	Checks if simulation is done by finishing the very last instruction
  *      Remember that simulation is done only if the entire pipeline is empty
  * Inputs:
- * 	sim_insn: the total number of instructions simulated
+ * 	s: the state of the run
  * Returns:
  * 	True: if simulation is finished
  */
-static bool is_simulation_done(counter_t sim_insn) {
+static bool is_simulation_done(tom_state_t* s) {
 
   /* ECE552: Assignment 3 BEGIN CODE */
-  if(instr_queue_size != 0)
+  if(s->instr_queue_size != 0)
     return false;
 
-  if(fetch_index <= sim_insn)
+  if(s->fetch_index <= s->num_insn)
     return false;
 
-  for(int i = 0; i < RESERV_INT_SIZE; i++)
-  {
-    if(reservINT[i] != NULL)
-      return false;
-  }
-
-  for(int i = 0; i < RESERV_FP_SIZE; i++)
-  {
-    if(reservFP[i] != NULL)
-      return false;
-  }
-
-  for(int i = 0; i < FU_INT_SIZE; i++)
-  {
-    if(fuINT[i] != NULL)
-      return false;
-  }
+  //functional units are only held by busy reservation stations
+  if(!mask_empty(s, s->busy))
+    return false;
 
-  if(fuFP[0] != NULL)
+  if(s->rob_count != 0)
     return false;
 
   /* ECE552: Assignment 3 END CODE */
@@ -169,467 +971,812 @@ static bool is_simulation_done(counter_t sim_insn) {
   return true; //ECE552: you can change this as needed; we've added this so the code provided to you compiles
 }
 
-/* 
- * Description: 
- * 	Retires the instruction from writing to the Common Data Bus
+/*
+ * Description:
+ * 	Commits completed instructions from the head of the reorder buffer,
+ *      in program order and at most commit_width of them (if there is a ROB)
  * Inputs:
  * 	current_cycle: the cycle we are at
  * Returns:
  * 	None
  */
-void CDB_To_retire(int current_cycle) {
+static void ROB_To_commit(tom_state_t* s, int current_cycle) {
 
   /* ECE552: Assignment 3 BEGIN CODE */
-
-  if(commonDataBus != NULL)
+  for(int i = 0; i < s->config->commit_width && s->rob_count != 0; i++)
   {
-    //update Q values in RS and MT to NULL if a match exists
-    for(int i = 0; i < RESERV_INT_SIZE; i++)
+    tom_rob_entry_t* head = &s->rob[s->rob_head];
+
+    //an instruction commits at the earliest in the cycle after it completes
+    if(head->complete_cycle == 0 || head->complete_cycle >= current_cycle)
+      break;
+
+    SET_TIMING(s, commit_cycle, head->instr, current_cycle);
+    instrDone(s, current_cycle);
+    if(HAS_PRF(s))
     {
-      if(reservINT[i] != NULL)
-      {
-        for(int j = 0; j < 3; j++)
-        {
-          if(reservINT[i]->Q[j] == commonDataBus)
-            reservINT[i]->Q[j] = NULL;
-        }
-      }
+      supersedePhysReg(s, head->prev_phys[0]);
+      supersedePhysReg(s, head->prev_phys[1]);
     }
+    head->instr = NULL;
+    s->rob_head = (s->rob_head + 1) % s->config->rob_size;
+    s->rob_count--;
+  }
+  /* ECE552: Assignment 3 END CODE */
+}
+
+/*
+ * Description:
+ * 	Retires the instruction from writing to the Common Data Bus
+ * Inputs:
+ * 	current_cycle: the cycle we are at
+ * Returns:
+ * 	None
+ */
+static void CDB_To_retire(tom_state_t* s, int current_cycle) {
+
+  /* ECE552: Assignment 3 BEGIN CODE */
+
+  bool broadcast = false;
+
+  for(int b = 0; b < s->config->num_cdbs; b++)
+  {
+    if(s->commonDataBus[b] == 0)
+      continue;
+
+    int i, w, c = CDB_COL(s, b);
+    tom_mask_t bits;
+    tom_mask_t* waiters = WAITERS(s, c);
 
-    for(int i = 0; i < RESERV_FP_SIZE; i++)
+    //clear the column of the CDB in the dependency matrix, waking up the
+    //entries whose row is left empty
+    FOR_EACH_SLOT(i, waiters, s->words, w, bits)
     {
-      if(reservFP[i] != NULL)
-      {
-        for(int j = 0; j < 3; j++)
-        {
-          if(reservFP[i]->Q[j] == commonDataBus)
-            reservFP[i]->Q[j] = NULL;
-        }
-      }
+      tom_mask_t* row = DEP_ROW(s, i);
+      bool empty = true;
+
+      MASK_CLEAR(row, c);
+      for(int k = 0; k < s->dep_words && empty; k++)
+        if(row[k])
+          empty = false;
+
+      if(empty)
+        MASK_SET(s->ready, i);
     }
+    memset(waiters, 0, s->words * sizeof(tom_mask_t));
 
+    s->commonDataBus[b] = 0;
+    broadcast = true;
+  }
+
+  //and the MT entries of every CDB, all of them are free again
+  if(broadcast)
+  {
     for(int i = 0; i < MD_TOTAL_REGS; i++)
     {
-      if(map_table[i] == commonDataBus)
-        map_table[i] = NULL;
+      if(s->map_table[i] > CDB_COL(s, 0))
+        s->map_table[i] = 0;
     }
   }
 
-  commonDataBus = NULL;
-
   /* ECE552: Assignment 3 END CODE */
 
 }
 
 
-/* 
- * Description: 
- * 	Moves an instruction from the execution stage to common data bus (if possible)
+//moves column i of the dependency matrix (and the MT entries naming it) to
+//the column of CDB b, the result of slot i is broadcast from there
+static void broadcastColumn(tom_state_t* s, int i, int b)
+{
+  int j, w, c = CDB_COL(s, b);
+  tom_mask_t bits;
+  tom_mask_t* waiters = WAITERS(s, i);
+
+  FOR_EACH_SLOT(j, waiters, s->words, w, bits)
+  {
+    MASK_CLEAR(DEP_ROW(s, j), i);
+    MASK_SET(DEP_ROW(s, j), c);
+  }
+  memcpy(WAITERS(s, c), waiters, s->words * sizeof(tom_mask_t));
+  memset(waiters, 0, s->words * sizeof(tom_mask_t));
+
+  for(j = 0; j < MD_TOTAL_REGS; j++)
+  {
+    if(s->map_table[j] == i + 1)
+      s->map_table[j] = c + 1;
+  }
+}
+
+/*
+ * Description:
+ * 	Moves instructions from the execution stage to the common data buses (if possible),
+ *      the oldest finished ones first
  * Inputs:
  * 	current_cycle: the cycle we are at
  * Returns:
  * 	None
  */
-void execute_To_CDB(int current_cycle) {
+static void execute_To_CDB(tom_state_t* s, int current_cycle) {
 
   /* ECE552: Assignment 3 BEGIN CODE */
 
-  //4 is max instr that are able to be finished at a time
-  instruction_t* finish_execute[4] = {NULL};
+  tom_mask_t* finished = s->finished;
+  int i, w;
+  tom_mask_t bits;
+
+  memset(finished, 0, s->words * sizeof(tom_mask_t));
 
-  int finish_index = 0;
-  
-  //go through all functional units and check to see if an instr is finished execution
-  for(int i = 0; i < FU_INT_SIZE; i++)
+  //go through all executing instrs and check to see if they finished execution
+  FOR_EACH_SLOT(i, s->executing, s->words, w, bits)
   {
-    if(fuINT[i] != NULL)
+    if(current_cycle >= s->reserv[i].execute_cycle + s->reserv[i].latency)
     {
-      //if finished execution this cycle
-      if(current_cycle  >= (fuINT[i]->tom_execute_cycle + FU_INT_LATENCY))
+      //stores and branches do not write the CDB and complete here, a
+      //mispredicted branch redirects fetch; clear out RS entry and FU entry
+      if(!WRITES_CDB(s->reserv[i].instr->op))
       {
-        finish_execute[finish_index] = fuINT[i];
-        finish_index++;
+        if(s->reserv[i].instr->index == s->mispredict_index)
+          redirectFetch(s, current_cycle);
+        if(s->reserv[i].rob_entry < 0)
+          instrDone(s, current_cycle);
+        completeROB(s, s->reserv[i].rob_entry, current_cycle);
+        releaseRS(s, i);
       }
+      else
+        MASK_SET(finished, i);
     }
   }
 
-  //if FP finished execute in current cycle, place it in free spot in finish_execute
-  if(fuFP[0] != NULL)
+  //the oldest finished instrs get the CDBs, the others keep their FU
+  for(int b = 0; b < s->config->num_cdbs; b++)
   {
-    if(current_cycle >= (fuFP[0]->tom_execute_cycle + FU_FP_LATENCY))
+    i = selectOldest(s, finished);
+    if(i < 0)
+      break;
+
+    instruction_t* instr = s->reserv[i].instr;
+
+    SET_TIMING(s, cdb_cycle, instr, current_cycle);
+    s->commonDataBus[b] = instr->index;
+    broadcastColumn(s, i, b);
+    if(s->reserv[i].rob_entry < 0)
+      instrDone(s, current_cycle);
+    completeROB(s, s->reserv[i].rob_entry, current_cycle);
+
+    //the result is in its physical registers, without a reorder buffer
+    //the registers it replaced are released now
+    if(HAS_PRF(s))
     {
-      for(int i = 0; i < 4; i++)
+      tom_rs_entry_t* rs = &s->reserv[i];
+      for(int j = 0; j < 2; j++)
       {
-        if(finish_execute[i] == NULL)
+        if(rs->dest_phys[j] >= 0)
         {
-          finish_execute[i] = fuFP[0];
-          break;
+          s->prf_pending[rs->dest_phys[j]] = false;
+          freePhysReg(s, rs->dest_phys[j]);
         }
+        if(rs->rob_entry < 0)
+          supersedePhysReg(s, rs->prev_phys[j]);
       }
     }
+
+    //clear RS entry and FU entry
+    MASK_CLEAR(finished, i);
+    releaseRS(s, i);
   }
 
-  //bubble sort execution queue from oldest to youngest instr
-  for(int i = 0; i < 3; i++)
+  //the others lost the CDB this cycle
+  STAT_ADD(s, stall_cdb, mask_count(s, finished, finished));
+  stallSlots(s, TOM_STALL_CDB, finished);
+  /* ECE552: Assignment 3 END CODE */
+}
+
+/*
+ * Description:
+ * 	Returns the cycles a load or store spends accessing memory once its
+ *      address is computed; a load gets its value from the youngest older
+ *      store to the same doubleword still in the load/store queue instead
+ * Inputs:
+ *      i: the slot of the load or store
+ * 	current_cycle: the cycle we are at
+ * Returns:
+ * 	The extra cycles on top of the functional unit latency
+ */
+static int memoryLatency(tom_state_t* s, int i, int current_cycle) {
+
+  /* ECE552: Assignment 3 BEGIN CODE */
+  instruction_t* instr = s->reserv[i].instr;
+
+  if(IS_LOAD(instr->op) && s->config->lsq_size > 0)
   {
-    for(int j = 0; j < 3 - i; j++)
+    tom_mask_t* row = OLDER_ROW(s, i);
+    int j, w;
+    tom_mask_t bits;
+
+    //older stores have all computed their addresses by now (see issue_To_execute)
+    FOR_EACH_SLOT(j, s->stores, s->words, w, bits)
     {
-      if(finish_execute[j] != NULL && finish_execute[j + 1] != NULL)
+      if(MASK_TEST(row, j) && (s->reserv[j].instr->addr >> 3) == (instr->addr >> 3))
       {
-        if(finish_execute[j]->index > finish_execute[j + 1]->index)
-        {
-          instruction_t* temp = finish_execute[j];
-          finish_execute[j] = finish_execute[j + 1];
-          finish_execute[j + 1] = temp;
-        }
+        STAT_ADD(s, forwards, 1);
+        return 0;
       }
     }
   }
 
-  bool found_oldest = false;
+  if(s->mem == NULL)
+    return 0;
+
+  int latency = s->mem->access(s->mem_state, instr, IS_STORE(instr->op) != 0, current_cycle);
 
-  //loop through instr that have finished executing find oldest instr and take out stores
-  for(int i = 0; i < 4; i++)
+  //stores are buffered, only loads wait for memory
+  return IS_STORE(instr->op) ? 0 : latency;
+  /* ECE552: Assignment 3 END CODE */
+}
+
+//starts executing the instruction in slot i on a functional unit of its
+//class, the operands are read on the way
+static void startExecute(tom_state_t* s, int i, int current_cycle)
+{
+  bool is_int = IS_INT_SLOT(s, i);
+
+  MASK_CLEAR(s->ready, i);
+  MASK_SET(s->executing, i);
+  MASK_CLEAR(s->stores_waiting, i);
+  if(is_int)
+    s->fu_int_busy++;
+  else
+    s->fu_fp_busy++;
+
+  //operands are read from the physical registers on the way to execute
+  if(HAS_PRF(s))
   {
-    if(finish_execute[i] != NULL)
+    for(int j = 0; j < 3; j++)
     {
-      if(IS_STORE(finish_execute[i]->op))
-      {
-        //clear out RS entry
-        for(int j = 0; j < RESERV_INT_SIZE; j++)
-        {
-          if(reservINT[j] != NULL && (reservINT[j]->index == finish_execute[i]->index))
-            reservINT[j] = NULL;
-        }
-
-        //clear out FU entry
-        for(int j = 0; j < FU_INT_SIZE; j++)
-        {
-          if(fuINT[j] != NULL && (fuINT[j]->index == finish_execute[i]->index))
-            fuINT[j] = NULL;
-        }
-      }
-      else if(!found_oldest && commonDataBus == NULL)
+      int p = s->reserv[i].src_phys[j];
+      if(p >= 0)
       {
-        found_oldest = true;
-        
-        finish_execute[i]->tom_cdb_cycle = current_cycle;
-        commonDataBus = finish_execute[i];
-
-        //clear RS entry and FU entry
-        for(int j = 0; j < RESERV_INT_SIZE; j++)
-        {
-          if(reservINT[j] != NULL)
-          {
-            if(reservINT[j]->index == finish_execute[i]->index)
-            reservINT[j] = NULL;
-          }
-        }
-
-        for(int j = 0; j < RESERV_FP_SIZE; j++)
-          if(reservFP[j] != NULL)
-          {
-            if(reservFP[j]->index == finish_execute[i]->index)
-            reservFP[j] = NULL;
-          }
-
-        for(int j = 0; j < FU_INT_SIZE; j++)
-          if(fuINT[j] != NULL)
-          {
-            if(fuINT[j]->index == finish_execute[i]->index)
-              fuINT[j] = NULL;
-          }
-
-        if(fuFP[0] != NULL && fuFP[0]->index == finish_execute[i]->index)
-          fuFP[0] = NULL;
+        s->prf_readers[p]--;
+        freePhysReg(s, p);
       }
     }
   }
-  /* ECE552: Assignment 3 END CODE */
+
+  s->reserv[i].execute_cycle = current_cycle;
+  s->reserv[i].latency = is_int ? s->config->fu_int_latency : s->config->fu_fp_latency;
+  if(IS_LOAD(s->reserv[i].instr->op) || IS_STORE(s->reserv[i].instr->op))
+    s->reserv[i].latency += memoryLatency(s, i, current_cycle);
+  SET_TIMING(s, execute_cycle, s->reserv[i].instr, current_cycle);
 }
 
-/* 
- * Description: 
+/*
+ * Description:
  * 	Moves instruction(s) from the issue to the execute stage (if possible). We prioritize old instructions
- *      (in program order) over new ones, if they both contend for the same functional unit.
+ *      (in program order) over new ones, if they both contend for the same functional unit
+ *      or for the issue width.
  *      All RAW dependences need to have been resolved with stalls before an instruction enters execute.
  * Inputs:
  * 	current_cycle: the cycle we are at
  * Returns:
  * 	None
  */
-void issue_To_execute(int current_cycle) {
+static void issue_To_execute(tom_state_t* s, int current_cycle) {
 
   /* ECE552: Assignment 3 BEGIN CODE */
-  instruction_t* ready_to_execute_INT[RESERV_INT_SIZE] = {NULL};
-  instruction_t* ready_to_execute_FP[RESERV_FP_SIZE] = {NULL};
+  tom_mask_t* cand = s->candidates;
+  tom_mask_t* sel = s->selectable;
+  int i, w, issued = 0;
+  tom_mask_t bits;
 
-  int oldest_int_index = 0;
-  int oldest_fp_index = 0;
-
-  //check for RAW hazards to store instr ready to execute
-  for(int i = 0; i < RESERV_INT_SIZE; i++)
+  //instrs still waiting for an operand
+  if(s->stats)
   {
-    if(reservINT[i] != NULL)
+    for(w = 0; w < s->words; w++)
     {
-      instruction_t* curr_instr = reservINT[i];
-      if(curr_instr->Q[0] == NULL && curr_instr->Q[1] == NULL && curr_instr->Q[2] == NULL && curr_instr->tom_execute_cycle == 0)
-      {
-          ready_to_execute_INT[oldest_int_index] = reservINT[i];
-          oldest_int_index++;
-      }
+      sel[w] = s->busy[w] & ~s->ready[w] & ~s->executing[w];
+      s->stats->stall_raw += WORD_POPCOUNT(sel[w]);
     }
+    stallSlots(s, TOM_STALL_RAW, sel);
   }
 
-  for(int i = 0; i < RESERV_FP_SIZE; i++)
+  memcpy(cand, s->ready, s->words * sizeof(tom_mask_t));
+
+  //with a load/store queue a load waits until every older store knows its
+  //address, so it cannot miss a value it should get from one of them
+  if(s->config->lsq_size > 0)
   {
-    if(reservFP[i] != NULL)
+    FOR_EACH_SLOT(i, cand, s->words, w, bits)
     {
-      instruction_t* curr_instr = reservFP[i];
-      if(curr_instr->Q[0] == NULL && curr_instr->Q[1] == NULL && curr_instr->Q[2] == NULL && curr_instr->tom_execute_cycle == 0)
+      if(MASK_TEST(s->loads, i) && mask_intersects(s, OLDER_ROW(s, i), s->stores_waiting))
       {
-        ready_to_execute_FP[oldest_fp_index] = reservFP[i];
-        oldest_fp_index++;
+        STAT_ADD(s, stall_mem_order, 1);
+        stallPC(s, TOM_STALL_MEM_ORDER, s->reserv[i].instr);
+        MASK_CLEAR(cand, i);
       }
     }
   }
 
-  //bubble sort execution queues from oldest to youngest instr
-  for(int i = 0; i < RESERV_INT_SIZE - 1; i++)
-    for(int j = 0; j < RESERV_INT_SIZE - 1 - i; j++)
-      if(ready_to_execute_INT[j] != NULL && ready_to_execute_INT[j + 1] != NULL)
-        if(ready_to_execute_INT[j]->index > ready_to_execute_INT[j + 1]->index)
-        {
-          instruction_t* temp = ready_to_execute_INT[j];
-          ready_to_execute_INT[j] = ready_to_execute_INT[j + 1];
-          ready_to_execute_INT[j + 1] = temp;
-        }
+  //the oldest candidate of a class with a free functional unit goes next
+  while(s->config->issue_width == 0 || issued < s->config->issue_width)
+  {
+    tom_mask_t int_mask = s->fu_int_busy < s->config->fu_int_size ? ~0ULL : 0;
+    tom_mask_t fp_mask = s->fu_fp_busy < s->config->fu_fp_size ? ~0ULL : 0;
 
-  for(int i = 0; i < RESERV_FP_SIZE - 1; i++)
-    for(int j = 0; j < RESERV_FP_SIZE - 1 - i; j++)
-      if(ready_to_execute_FP[j] != NULL && ready_to_execute_FP[j + 1] != NULL)
-        if(ready_to_execute_FP[j]->index > ready_to_execute_FP[j + 1]->index)
-        {
-          instruction_t* temp = ready_to_execute_FP[j];
-          ready_to_execute_FP[j] = ready_to_execute_FP[j + 1];
-          ready_to_execute_FP[j + 1] = temp;
-        }
+    if(!int_mask && !fp_mask)
+      break;
+    for(w = 0; w < s->words; w++)
+      sel[w] = cand[w] & ((s->int_slots[w] & int_mask) | (s->fp_slots[w] & fp_mask));
+
+    i = selectOldest(s, sel);
+    if(i < 0)
+      break;
+
+    MASK_CLEAR(cand, i);
+    startExecute(s, i, current_cycle);
+    issued++;
+  }
+
+  //the ready instrs left over found every functional unit busy (or the
+  //issue width used up)
+  STAT_ADD(s, stall_fu_busy, mask_count(s, cand, cand));
+  stallSlots(s, TOM_STALL_FU_BUSY, cand);
+  /* ECE552: Assignment 3 END CODE */
+}
+
+/*
+ * Description:
+ * 	Allocates a free reservation station entry from the given set of
+ *      reservation stations to the oldest instruction in the queue
+ * Inputs:
+ *      slots: the reservation stations of the class
+ * 	current_cycle: the cycle we are at
+ * Returns:
+ * 	True: if an entry was allocated
+ */
+static bool allocateRS(tom_state_t* s, tom_mask_t* slots, int current_cycle) {
 
-  //save the index of ready to execute queues
-  int oldest_index_int = 0;
-  int oldest_index_fp = 0;
+  /* ECE552: Assignment 3 BEGIN CODE */
+
+  //find an available entry of the class
+  int i = -1;
+  for(int w = 0; w < s->words && i < 0; w++)
+    if(~s->busy[w] & slots[w])
+      i = w * MASK_BITS + WORD_FFS(~s->busy[w] & slots[w]);
 
-  //check FU availabilty
-  for(int i = 0; i < FU_INT_SIZE; i++)
+  //entry found
+  if(i >= 0)
   {
-    if(fuINT[i] == NULL && ready_to_execute_INT[oldest_index_int])
+    instruction_t* instr = s->instr_queue[s->oldest_instr_index];
+    tom_rs_entry_t* rs = &s->reserv[i];
+
+    //update issue cycle and allocate RS entry for instr
+    SET_TIMING(s, issue_cycle, instr, current_cycle);
+    rs->instr = instr;
+    rs->execute_cycle = 0;
+    rs->rob_entry = allocateROB(s, instr);
+
+    //check if map table values for src operands contain a tag and set the
+    //producing columns in the entry's dependency row
+    tom_mask_t* row = DEP_ROW(s, i);
+    bool waiting = false;
+
+    memset(row, 0, s->dep_words * sizeof(tom_mask_t));
+    for(int j = 0; j < 3; j++)
     {
-      fuINT[i] = ready_to_execute_INT[oldest_index_int];
-      fuINT[i]->tom_execute_cycle = current_cycle;
-      oldest_index_int++;
+      if(instr->r_in[j] != DNA && s->map_table[instr->r_in[j]] != 0)
+      {
+        int c = s->map_table[instr->r_in[j]] - 1;
+        MASK_SET(row, c);
+        MASK_SET(WAITERS(s, c), i);
+        waiting = true;
+      }
     }
-  }
 
-  for(int i = 0; i < FU_FP_SIZE; i++)
-  {
-    if(fuFP[i] == NULL && ready_to_execute_FP[oldest_index_fp])
+    //update tag of result register in the map table w/ RS entry
+    for(int j = 0; j < 2; j++)
+      if(instr->r_out[j] != DNA)
+        s->map_table[instr->r_out[j]] = i + 1;
+
+    if(HAS_PRF(s))
+      renameRegs(s, rs);
+
+    //instrs are allocated in program order, so everything already in a
+    //reservation station is older than this one, and this one is younger
+    //than everything left in them
+    memcpy(OLDER_ROW(s, i), s->busy, s->words * sizeof(tom_mask_t));
+    for(int k = 0; k < s->num_slots; k++)
+      MASK_CLEAR(OLDER_ROW(s, k), i);
+
+    MASK_SET(s->busy, i);
+    if(IS_LOAD(instr->op))
+      MASK_SET(s->loads, i);
+    if(IS_STORE(instr->op))
     {
-      fuFP[i] = ready_to_execute_FP[oldest_index_fp];
-      fuFP[i]->tom_execute_cycle = current_cycle;
-      oldest_index_fp++;
+      MASK_SET(s->stores, i);
+      MASK_SET(s->stores_waiting, i);
     }
+    if(s->config->lsq_size > 0 && (IS_LOAD(instr->op) || IS_STORE(instr->op)))
+      s->lsq_count++;
+
+    if(!waiting)
+      MASK_SET(s->ready, i);
+
+    removeFromInstrQ(s);
   }
   /* ECE552: Assignment 3 END CODE */
+
+  return i >= 0;
 }
 
-/* 
- * Description: 
- * 	Moves instruction(s) from the dispatch stage to the issue stage
+/*
+ * Description:
+ * 	Moves instruction(s) from the dispatch stage to the issue stage, in
+ *      program order and at most dispatch_width of them
  * Inputs:
  * 	current_cycle: the cycle we are at
  * Returns:
  * 	None
  */
-void dispatch_To_issue(int current_cycle) {
+static void dispatch_To_issue(tom_state_t* s, int current_cycle) {
 
   /* ECE552: Assignment 3 BEGIN CODE */
 
-  if(instr_queue_size != 0)
+  for(int n = 0; n < s->config->dispatch_width && s->instr_queue_size != 0; n++)
   {
-    if(IS_COND_CTRL(instr_queue[oldest_instr_index]->op) || IS_UNCOND_CTRL(instr_queue[oldest_instr_index]->op))
-      removeFromInstrQ();
-    else if(USES_INT_FU(instr_queue[oldest_instr_index]->op))
+    instruction_t* instr = s->instr_queue[s->oldest_instr_index];
+
+    //a full reorder buffer stalls dispatch
+    if(s->rob != NULL && s->rob_count == s->config->rob_size)
+    {
+      STAT_ADD(s, stall_rob_full, 1);
+      stallPC(s, TOM_STALL_ROB_FULL, instr);
+      return;
+    }
+
+    //so does a full load/store queue for loads and stores
+    if(s->config->lsq_size > 0 && s->lsq_count == s->config->lsq_size
+       && (IS_LOAD(instr->op) || IS_STORE(instr->op)))
     {
-      //go through all RS to see if there is available entry
-      for(int i = 0; i < RESERV_INT_SIZE; i++)
+      STAT_ADD(s, stall_lsq_full, 1);
+      stallPC(s, TOM_STALL_LSQ_FULL, instr);
+      return;
+    }
+
+    //and running out of physical registers for the results
+    if(HAS_PRF(s) && !IS_COND_CTRL(instr->op) && !IS_UNCOND_CTRL(instr->op)
+       && s->free_count < physRegsNeeded(instr))
+    {
+      STAT_ADD(s, stall_prf_full, 1);
+      stallPC(s, TOM_STALL_PRF_FULL, instr);
+      return;
+    }
+
+    if(IS_COND_CTRL(instr->op) && s->bpred->predict != NULL)
+    {
+      //a predicted branch compares its operands on an integer functional
+      //unit, it resolves once it has executed (see execute_To_CDB)
+      if(!allocateRS(s, s->int_slots, current_cycle))
       {
-        //entry found
-        if(reservINT[i] == NULL)
-        {
-          //update issue cycle and allocate RS entry for instr
-          instr_queue[oldest_instr_index]->tom_issue_cycle = current_cycle;
-          reservINT[i] = instr_queue[oldest_instr_index];
-
-          //check if map table values for src operands contain a tag and update
-          for(int j = 0; j < 3; j++)
-            if(reservINT[i]->r_in[j] != DNA)
-              if(map_table[reservINT[i]->r_in[j]] != NULL)
-                reservINT[i]->Q[j] = map_table[reservINT[i]->r_in[j]];
-
-          //update tag of result register in the map table w/ RS entry
-          for(int j = 0; j < 2; j++)
-            if(reservINT[i]->r_out[j] != DNA)
-              map_table[reservINT[i]->r_out[j]] = reservINT[i];
-        
-          removeFromInstrQ();
-          break;
-        }
+        STAT_ADD(s, stall_rs_full, 1);
+        stallPC(s, TOM_STALL_RS_FULL, instr);
+        return;
       }
     }
-    else if(USES_FP_FU(instr_queue[oldest_instr_index]->op))
+    else if(IS_COND_CTRL(instr->op) || IS_UNCOND_CTRL(instr->op))
+    {
+      //jumps, and branches under perfect prediction, use no functional
+      //unit, they complete here
+      if(s->rob == NULL)
+        instrDone(s, current_cycle);
+      completeROB(s, allocateROB(s, instr), current_cycle);
+      removeFromInstrQ(s);
+    }
+    else if(USES_INT_FU(instr->op))
     {
-      //go through all RS to see if there is available entry
-      for(int i = 0; i < RESERV_FP_SIZE; i++)
+      if(!allocateRS(s, s->int_slots, current_cycle))
       {
-        //entry found
-        if(reservFP[i] == NULL)
-        {
-          //update issue cycle and allocate RS entry for instr
-          instr_queue[oldest_instr_index]->tom_issue_cycle = current_cycle;
-          reservFP[i] = instr_queue[oldest_instr_index];
-
-          //check if map table values for src operands contain a tag and update
-          for(int j = 0; j < 3; j++)
-            if(reservFP[i]->r_in[j] != DNA)
-              if(map_table[reservFP[i]->r_in[j]] != NULL)
-                reservFP[i]->Q[j] = map_table[reservFP[i]->r_in[j]];
-
-          //update tag of result register in the map table w/ RS entry
-          for(int j = 0; j < 2; j++)
-            if(reservFP[i]->r_out[j] != DNA)
-              map_table[reservFP[i]->r_out[j]] = reservFP[i];
-
-          removeFromInstrQ();
-          break;
-        }
+        STAT_ADD(s, stall_rs_full, 1);
+        stallPC(s, TOM_STALL_RS_FULL, instr);
+        return;
+      }
+    }
+    else if(USES_FP_FU(instr->op))
+    {
+      if(!allocateRS(s, s->fp_slots, current_cycle))
+      {
+        STAT_ADD(s, stall_rs_full, 1);
+        stallPC(s, TOM_STALL_RS_FULL, instr);
+        return;
       }
-    } 
+    }
   }
-  /* ECE552: Assignment 3 END CODE */ 
+  /* ECE552: Assignment 3 END CODE */
 }
 
-/* 
- * Description: 
- * 	Grabs an instruction from the instruction trace (if possible)
+/*
+ * Description:
+ * 	Predicts the direction of a fetched conditional branch and stops fetch
+ *      if the prediction is wrong; the trace tells the real direction, the
+ *      branch is taken if the next instruction is not the one after it
  * Inputs:
- *      trace: instruction trace with all the instructions executed
+ *      instr: the branch
  * Returns:
  * 	None
  */
-void fetch(instruction_trace_t* trace) {
+static void predictBranch(tom_state_t* s, instruction_t* instr) {
+
+  /* ECE552: Assignment 3 BEGIN CODE */
+  if(s->bpred->predict == NULL)
+    return;
+
+  int taken = 0;
+  if(instr->index < s->num_insn)
+    taken = get_instr(s->trace, instr->index + 1)->pc != instr->pc + INSTR_SIZE;
+
+  int predicted = s->bpred->predict(s->bpred_state, instr) != 0;
+  s->bpred->update(s->bpred_state, instr, taken);
+
+  STAT_ADD(s, branches, 1);
+  if(predicted != taken)
+  {
+    STAT_ADD(s, mispredicts, 1);
+    s->mispredict_index = instr->index;
+    s->mispredict_instr = instr;
+  }
+  /* ECE552: Assignment 3 END CODE */
+}
+
+/*
+ * Description:
+ * 	Grabs an instruction from the instruction trace (if possible)
+ * Inputs:
+ *      current_cycle: the cycle we are at
+ * Returns:
+ * 	True: if an instruction was fetched
+ */
+static bool fetch(tom_state_t* s, int current_cycle) {
 
   /* ECE552: Assignment 3 BEGIN CODE */
 
   //if intr_queue isn't full, we can grab next instr
-  if(instr_queue_size < INSTR_QUEUE_SIZE)
+  if(s->instr_queue_size < s->config->instr_queue_size)
   {
-    fetch_index++;
+    s->fetch_index++;
+
+    //traps are not modeled, they are done as soon as they are passed over
+    while(s->fetch_index <= s->num_insn && IS_TRAP(get_instr(s->trace, s->fetch_index)->op))
+    {
+      instrDone(s, current_cycle);
+      s->fetch_index++;
+    }
 
-    if(fetch_index <= sim_num_insn)
+    if(s->fetch_index <= s->num_insn)
     {
-      while(IS_TRAP(get_instr(trace, fetch_index)->op))
-        fetch_index++;
+      instruction_t* instr = get_instr(s->trace, s->fetch_index);
+      SET_TIMING(s, dispatch_cycle, instr, current_cycle);
+      addToInstrQ(s, instr);
 
-      instruction_t* instr = get_instr(trace, fetch_index);
-      addToInstrQ(instr);
+      if(IS_COND_CTRL(instr->op))
+        predictBranch(s, instr);
+      return true;
     }
   }
 
    /* ECE552: Assignment 3 END CODE */
+  return false;
 }
 
-/* 
- * Description: 
- * 	Calls fetch and dispatches an instruction at the same cycle (if possible)
+/*
+ * Description:
+ * 	Calls fetch and dispatches up to fetch_width instructions at the same
+ *      cycle (if possible)
  * Inputs:
- *      trace: instruction trace with all the instructions executed
  * 	current_cycle: the cycle we are at
  * Returns:
  * 	None
  */
-void fetch_To_dispatch(instruction_trace_t* trace, int current_cycle) {
-
-  fetch(trace);
+static void fetch_To_dispatch(tom_state_t* s, int current_cycle) {
 
   /* ECE552: Assignment 3 BEGIN CODE */
 
-  available_index = (oldest_instr_index + instr_queue_size - 1) % INSTR_QUEUE_SIZE;
-  instruction_t* youngest_instr = instr_queue[available_index];
+  //fetch waits for a mispredicted branch to resolve and redirect
+  if(s->mispredict_index != 0 || current_cycle < s->resume_cycle)
+  {
+    STAT_ADD(s, stall_fetch, 1);
+    stallPC(s, TOM_STALL_FETCH, s->mispredict_instr);
+    return;
+  }
+
+  //the fetched instructions enter dispatch in this cycle, fetch stops
+  //past a mispredicted branch
+  for(int n = 0; n < s->config->fetch_width && s->mispredict_index == 0; n++)
+  {
+    if(!fetch(s, current_cycle))
+      break;
+  }
 
-  if(youngest_instr != NULL)
-    youngest_instr->tom_dispatch_cycle = current_cycle; 
-       
   /* ECE552: Assignment 3 END CODE */
 }
 
-/* 
- * Description: 
- * 	Performs a cycle-by-cycle simulation of the 4-stage pipeline
+//adds this cycle's occupancy of the queue, reservation stations and
+//functional units to the distributions
+static void sampleOccupancy(tom_state_t* s) {
+
+  stat_add_sample(s->stats->iq_occupancy, s->instr_queue_size);
+  stat_add_sample(s->stats->rs_int_occupancy, mask_count(s, s->busy, s->int_slots));
+  stat_add_sample(s->stats->rs_fp_occupancy, mask_count(s, s->busy, s->fp_slots));
+  stat_add_sample(s->stats->fu_int_busy, s->fu_int_busy);
+  stat_add_sample(s->stats->fu_fp_busy, s->fu_fp_busy);
+  if(s->stats->prf_occupancy)
+    stat_add_sample(s->stats->prf_occupancy,
+                    s->config->prf_size - MD_TOTAL_REGS - s->free_count);
+}
+
+//allocates a zeroed array with n entries
+static void* alloc_array(int n, size_t size) {
+
+  void* p = calloc(n, size);
+  if (!p)
+    fatal("out of virtual memory");
+  return p;
+}
+
+/*
+ * Description:
+ * 	Performs a cycle-by-cycle simulation of the 4-stage pipeline (5 stages with a
+ *      reorder buffer)
  * Inputs:
+ *      config: the machine to simulate
  *      trace: instruction trace with all the instructions executed
+ *      num_insn: the number of instructions in the trace
+ *      timing: per-instruction stage cycles are recorded here (may be NULL)
+ *      stats: statistics are collected here (may be NULL)
  * Returns:
  * 	The total number of cycles it takes to execute the instructions.
- * Extra Notes:
- * 	sim_num_insn: the number of instructions in the trace
  */
-counter_t runTomasulo(instruction_trace_t* trace)
+counter_t tom_run(tom_config_t* config, instruction_trace_t* trace,
+                  counter_t num_insn, tom_timing_t* timing, tom_stats_t* stats)
 {
-  //initialize instruction queue
-  int i;
-  for (i = 0; i < INSTR_QUEUE_SIZE; i++) {
-    instr_queue[i] = NULL;
-  }
+  tom_state_t state;
+  tom_state_t* s = &state;
 
-  //initialize reservation stations
-  for (i = 0; i < RESERV_INT_SIZE; i++) {
-      reservINT[i] = NULL;
-  }
+  memset(s, 0, sizeof(tom_state_t));
+  s->config = config;
+  s->timing = timing;
+  s->stats = stats;
+  s->trace = trace;
+  s->num_insn = num_insn;
 
-  for(i = 0; i < RESERV_FP_SIZE; i++) {
-      reservFP[i] = NULL;
+  //initialize instruction queue
+  s->instr_queue = alloc_array(config->instr_queue_size, sizeof(instruction_t*));
+
+  //initialize reservation stations and the slot masks
+  s->num_slots = config->reserv_int_size + config->reserv_fp_size;
+  s->words = MASK_WORDS(s->num_slots);
+  s->reserv = alloc_array(s->num_slots, sizeof(tom_rs_entry_t));
+
+  s->int_slots = alloc_array(s->words, sizeof(tom_mask_t));
+  s->fp_slots = alloc_array(s->words, sizeof(tom_mask_t));
+  s->busy = alloc_array(s->words, sizeof(tom_mask_t));
+  s->ready = alloc_array(s->words, sizeof(tom_mask_t));
+  s->executing = alloc_array(s->words, sizeof(tom_mask_t));
+  s->loads = alloc_array(s->words, sizeof(tom_mask_t));
+  s->stores = alloc_array(s->words, sizeof(tom_mask_t));
+  s->stores_waiting = alloc_array(s->words, sizeof(tom_mask_t));
+  s->candidates = alloc_array(s->words, sizeof(tom_mask_t));
+  s->selectable = alloc_array(s->words, sizeof(tom_mask_t));
+  s->finished = alloc_array(s->words, sizeof(tom_mask_t));
+  s->older = alloc_array(s->num_slots * s->words, sizeof(tom_mask_t));
+  s->dep_words = MASK_WORDS(s->num_slots + config->num_cdbs);
+  s->deps = alloc_array(s->num_slots * s->dep_words, sizeof(tom_mask_t));
+  s->waiters = alloc_array((s->num_slots + config->num_cdbs) * s->words, sizeof(tom_mask_t));
+  s->commonDataBus = alloc_array(config->num_cdbs, sizeof(int));
+
+  for (int i = 0; i < s->num_slots; i++) {
+    if (i < config->reserv_int_size)
+      MASK_SET(s->int_slots, i);
+    else
+      MASK_SET(s->fp_slots, i);
   }
 
-  //initialize functional units
-  for (i = 0; i < FU_INT_SIZE; i++) {
-    fuINT[i] = NULL;
+  //functional units start free (memset above)
+
+  //initialize reorder buffer, if there is one
+  if (config->rob_size > 0)
+    s->rob = alloc_array(config->rob_size, sizeof(tom_rob_entry_t));
+
+  //initialize branch predictor
+  s->bpred = config->bpred_hook ? config->bpred_hook : &tom_bpreds[config->bpred];
+  if (s->bpred->create)
+    s->bpred_state = s->bpred->create(config);
+
+  //initialize memory latency model, if there is one
+  s->mem = config->mem_hook;
+  if (s->mem && s->mem->create)
+    s->mem_state = s->mem->create(config);
+
+  //initialize the physical register file, architectural register r starts
+  //out in physical register r and the rest are free
+  if (config->prf_size > 0) {
+    s->free_list = alloc_array(config->prf_size, sizeof(int));
+    s->prf_pending = alloc_array(config->prf_size, sizeof(bool));
+    s->prf_readers = alloc_array(config->prf_size, sizeof(int));
+    s->prf_superseded = alloc_array(config->prf_size, sizeof(bool));
+
+    for (int r = 0; r < MD_TOTAL_REGS; r++)
+      s->rename_table[r] = r;
+    for (int p = MD_TOTAL_REGS; p < config->prf_size; p++)
+      s->free_list[s->free_count++] = p;
   }
 
-  for (i = 0; i < FU_FP_SIZE; i++) {
-    fuFP[i] = NULL;
-  }
+  //map_table starts with no producers (memset above)
 
-  //initialize map_table to no producers
-  int reg;
-  for (reg = 0; reg < MD_TOTAL_REGS; reg++) {
-    map_table[reg] = NULL;
-  }
-  
   int cycle = 1;
   while (true) {
-    
+
      /* ECE552: Assignment 3 BEGIN CODE */
-     CDB_To_retire(cycle);
-     execute_To_CDB(cycle);
-     issue_To_execute(cycle);
-     dispatch_To_issue(cycle);
-     fetch_To_dispatch(trace, cycle);
-     
+     ROB_To_commit(s, cycle);
+     CDB_To_retire(s, cycle);
+     execute_To_CDB(s, cycle);
+     issue_To_execute(s, cycle);
+     dispatch_To_issue(s, cycle);
+     fetch_To_dispatch(s, cycle);
+
+     if (stats)
+       sampleOccupancy(s);
+
      cycle++;
 
-     if (is_simulation_done(sim_num_insn))
+     if (is_simulation_done(s))
         break;
     /* ECE552: Assignment 3 END CODE */
   }
-  
+
+  free(s->instr_queue);
+  free(s->reserv);
+  free(s->int_slots);
+  free(s->fp_slots);
+  free(s->busy);
+  free(s->ready);
+  free(s->executing);
+  free(s->loads);
+  free(s->stores);
+  free(s->stores_waiting);
+  free(s->candidates);
+  free(s->selectable);
+  free(s->finished);
+  free(s->older);
+  free(s->deps);
+  free(s->commonDataBus);
+  free(s->waiters);
+  free(s->rob);
+  free(s->free_list);
+  free(s->prf_pending);
+  free(s->prf_readers);
+  free(s->prf_superseded);
+  if (s->bpred->destroy)
+    s->bpred->destroy(s->bpred_state);
+  if (s->mem && s->mem->destroy)
+    s->mem->destroy(s->mem_state);
+
   return cycle;
 }
+
+/*
+ * Description:
+ * 	Performs a cycle-by-cycle simulation of the 4-stage pipeline on the
+ *      default machine
+ * Inputs:
+ *      trace: instruction trace with all the instructions executed
+ * Returns:
+ * 	The total number of cycles it takes to execute the instructions.
+ * Extra Notes:
+ * 	sim_num_insn: the number of instructions in the trace
+ */
+counter_t runTomasulo(instruction_trace_t* trace)
+{
+  tom_config_t config;
+
+  tom_default_config(&config);
+  return tom_run(&config, trace, sim_num_insn, NULL, NULL);
+}
@@ -0,0 +1,222 @@
+#ifndef TOMASULO_H
+#define TOMASULO_H
+
+#include "host.h"
+#include "options.h"
+#include "stats.h"
+#include "instr.h"
+
+struct tom_config;
+
+//branch predictor hook; the model asks for a direction when it fetches a
+//conditional branch and tells the outcome right after, a wrong direction
+//stops fetch until the branch resolves plus the redirect penalty. With a
+//predictor, conditional branches wait in an integer reservation station
+//for their operands and resolve when they finish executing on an integer
+//functional unit; without one (perfect prediction) they use neither
+typedef struct tom_bpred
+{
+  char* name;
+  //creates the predictor state of one run (may return NULL)
+  void* (*create)(struct tom_config* config);
+  //returns non-zero if the branch is predicted taken
+  int (*predict)(void* state, instruction_t* instr);
+  //trains the predictor with the actual direction
+  void (*update)(void* state, instruction_t* instr, int taken);
+  //frees the predictor state (may be NULL)
+  void (*destroy)(void* state);
+}tom_bpred_t;
+
+//memory latency hook; the model asks for the latency of every load and
+//store when it starts executing (after forwarding from the load/store
+//queue is ruled out), and adds it to the integer functional unit latency
+typedef struct tom_mem
+{
+  char* name;
+  //non-zero if the state is global, runs must then not proceed in parallel
+  int shared;
+  //creates the memory state of one run (may return NULL)
+  void* (*create)(struct tom_config* config);
+  //returns the extra cycles the access takes
+  int (*access)(void* state, instruction_t* instr, int is_store, tick_t now);
+  //frees the memory state (may be NULL)
+  void (*destroy)(void* state);
+}tom_mem_t;
+
+//built-in branch predictors, selected by the bpred parameter
+#define TOM_BPRED_PERFECT   0
+#define TOM_BPRED_TAKEN     1
+#define TOM_BPRED_NOTTAKEN  2
+#define TOM_BPRED_BIMOD     3
+
+//machine parameters of one run of the Tomasulo model
+typedef struct tom_config
+{
+  int instr_queue_size;  //instruction queue entries
+  int reserv_int_size;   //integer reservation stations
+  int reserv_fp_size;    //floating-point reservation stations
+  int fu_int_size;       //integer functional units
+  int fu_fp_size;        //floating-point functional units
+  int fu_int_latency;    //integer functional unit latency
+  int fu_fp_latency;     //floating-point functional unit latency
+  int rob_size;          //reorder buffer entries, 0 for no reorder buffer
+  int commit_width;      //instructions committed per cycle
+  int bpred;             //built-in branch predictor (TOM_BPRED_*)
+  int bimod_size;        //bimodal predictor table entries
+  int redirect_penalty;  //cycles from a mispredict resolving to fetch
+  int lsq_size;          //load/store queue entries, 0 for no load/store queue
+  int prf_size;          //physical registers, 0 for renaming onto RS tags only
+  int fetch_width;       //instructions fetched per cycle
+  int dispatch_width;    //instructions moved to reservation stations per cycle
+  int issue_width;       //instructions entering execute per cycle, 0 for no limit
+  int num_cdbs;          //common data buses
+
+  //branch predictor used instead of the built-in one if not NULL
+  tom_bpred_t* bpred_hook;
+
+  //memory latency model, NULL for none (loads and stores take the
+  //integer functional unit latency)
+  tom_mem_t* mem_hook;
+}tom_config_t;
+
+//per-instruction results of one run, one array per stage indexed by the
+//instruction index, so the decoded trace itself is never written and can be
+//shared by several runs at once
+typedef struct tom_timing
+{
+  counter_t num_insn;    //arrays hold num_insn + 1 entries
+  int* dispatch_cycle;   //cycle the instruction entered dispatch
+  int* issue_cycle;      //cycle the instruction entered issue
+  int* execute_cycle;    //cycle the instruction entered execute
+  int* cdb_cycle;        //cycle the instruction wrote back via the CDB
+  int* commit_cycle;     //cycle the instruction committed (with a ROB)
+}tom_timing_t;
+
+//stall reasons, the columns of the per-PC stall table
+enum tom_stall
+{
+  TOM_STALL_RS_FULL,
+  TOM_STALL_ROB_FULL,
+  TOM_STALL_LSQ_FULL,
+  TOM_STALL_PRF_FULL,
+  TOM_STALL_RAW,
+  TOM_STALL_MEM_ORDER,
+  TOM_STALL_FU_BUSY,
+  TOM_STALL_CDB,
+  TOM_STALL_FETCH,
+  NUM_TOM_STALLS
+};
+
+//stall cycles of one static instruction, by reason
+typedef struct tom_pc_stalls
+{
+  md_addr_t pc;
+  enum md_opcode op;
+  counter_t total;
+  counter_t stalls[NUM_TOM_STALLS];
+}tom_pc_stalls_t;
+
+//open-addressing table of the static instructions that stalled
+typedef struct tom_pc_stall_table
+{
+  tom_pc_stalls_t* entries;
+  int size;              //a power of two
+  int used;
+}tom_pc_stall_table_t;
+
+//statistics of one run; the occupancy distributions get a sample every
+//cycle, the stall counters count instruction-cycles lost to each reason
+typedef struct tom_stats
+{
+  struct stat_stat_t* iq_occupancy;     //instructions in the queue
+  struct stat_stat_t* rs_int_occupancy; //busy integer reservation stations
+  struct stat_stat_t* rs_fp_occupancy;  //busy floating-point reservation stations
+  struct stat_stat_t* fu_int_busy;      //busy integer functional units
+  struct stat_stat_t* fu_fp_busy;       //busy floating-point functional units
+  struct stat_stat_t* prf_occupancy;    //renamed physical registers (NULL without a PRF)
+
+  counter_t stall_rs_full;   //queue head waiting for a reservation station
+  counter_t stall_rob_full;  //queue head waiting for a reorder buffer entry
+  counter_t stall_lsq_full;  //queue head waiting for a load/store queue entry
+  counter_t stall_prf_full;  //queue head waiting for a free physical register
+  counter_t stall_raw;       //waiting for operands (RAW hazards)
+  counter_t stall_mem_order; //loads waiting for older store addresses
+  counter_t stall_fu_busy;   //ready, waiting for a functional unit
+  counter_t stall_cdb;       //finished, waiting for the CDB
+  counter_t stall_fetch;     //fetch cycles lost to branch mispredictions
+
+  counter_t branches;        //conditional branches fetched
+  counter_t mispredicts;     //conditional branches mispredicted
+  counter_t forwards;        //loads given their value by an older store
+
+  //interval IPC trace, set up after tom_reg_stats(): every ipc_interval
+  //instructions done (committed, or completed without a reorder buffer) a
+  //line "<instructions> <cycle>" goes to ipc_stream, if it is not NULL
+  int ipc_interval;
+  FILE* ipc_stream;
+
+  //per-PC stall table, set up after tom_reg_stats(): if it is not NULL
+  //every stall cycle counted above is also charged to the static
+  //instruction that lost it, fetch stalls to the mispredicted branch
+  tom_pc_stall_table_t* pc_stalls;
+}tom_stats_t;
+
+//fills in the default machine (the assignment's configuration)
+extern void tom_default_config(tom_config_t* config);
+
+//registers a -tom:<param> option for every machine parameter
+extern void tom_reg_options(struct opt_odb_t* odb, tom_config_t* config);
+
+//checks that the machine parameters are usable, fatal() otherwise
+extern void tom_check_config(tom_config_t* config);
+
+//sets the parameters listed as `name=value' pairs in str, e.g.
+//"rsint=8 fuint=4", leaves all other parameters untouched
+extern void tom_parse_config(tom_config_t* config, char* str);
+
+//prints the parameters as `name=value' pairs, in tom_parse_config() form
+extern void tom_print_config(tom_config_t* config, FILE* stream);
+
+//allocates zeroed timing arrays for num_insn instructions
+extern tom_timing_t* tom_timing_create(counter_t num_insn);
+
+//frees timing arrays
+extern void tom_timing_free(tom_timing_t* timing);
+
+//registers the statistics of runs of the given machine, their values are
+//collected by passing stats to tom_run()
+extern void tom_reg_stats(struct stat_sdb_t* sdb, tom_stats_t* stats,
+                          tom_config_t* config);
+
+//allocates an empty per-PC stall table
+extern tom_pc_stall_table_t* tom_pc_stalls_create(void);
+
+//prints the top static instructions of the table by stall cycles, with
+//their cycles lost to each reason, to stream
+extern void tom_pc_stalls_print(tom_pc_stall_table_t* table, int top,
+                                FILE* stream);
+
+//frees a per-PC stall table
+extern void tom_pc_stalls_free(tom_pc_stall_table_t* table);
+
+//simulates the first num_insn instructions of the trace on the given
+//machine, records per-instruction cycles into timing and statistics into
+//stats if they are not NULL; the trace is only read, so runs may proceed
+//in parallel
+extern counter_t tom_run(tom_config_t* config, instruction_trace_t* trace,
+                         counter_t num_insn, tom_timing_t* timing,
+                         tom_stats_t* stats);
+
+//bounds the cycles of the trace by its dataflow critical path under the
+//configured latencies, with unlimited resources and with the configured
+//fetch width, and prints them against the achieved cycles together
+//with the top static instructions on the path to stream (see tomcrit.c)
+extern void tom_critical_path(tom_config_t* config, instruction_trace_t* trace,
+                              counter_t num_insn, counter_t achieved, int top,
+                              FILE* stream);
+
+//performs a cycle-by-cycle simulation of the trace with Tomasulo's
+//algorithm on the default machine, returns the total number of cycles
+extern counter_t runTomasulo(instruction_trace_t* trace);
+
+#endif
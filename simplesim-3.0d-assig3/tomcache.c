@@ -0,0 +1,251 @@
+/* tomcache.c - data cache latency model for the Tomasulo timing model */
+
+/*
+ * This module plugs a data cache hierarchy into the Tomasulo model of
+ * tomasulo.c as its memory latency model (tom_mem_t).  The caches are those
+ * of the assignment 4 cache module, configured as in sim-outorder: a level 1
+ * data cache, an optional level 2 cache behind it and main memory.  Since
+ * the integer functional unit latency already covers an address computation
+ * and a level 1 hit, a load is only charged the cycles it takes beyond a
+ * level 1 hit; stores update the caches but are buffered.
+ *
+ * The block access functions below keep global state, so there is one
+ * hierarchy, reset at the start of every run, and runs using it must not
+ * proceed in parallel.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "misc.h"
+#include "machine.h"
+#include "options.h"
+#include "stats.h"
+#include "cache.h"
+
+#include "instr.h"
+#include "tomasulo.h"
+#include "tomcache.h"
+
+/* l1 data cache config, i.e., {<config>|none} */
+static char *cache_dl1_opt;
+
+/* l1 data cache hit latency (in cycles) */
+static int cache_dl1_lat;
+
+/* l1 data cache prefetcher, i.e., {<name>[:<arg>]|none} */
+static char *cache_dl1_prefetch;
+
+/* l2 data cache config, i.e., {<config>|none} */
+static char *cache_dl2_opt;
+
+/* l2 data cache hit latency (in cycles) */
+static int cache_dl2_lat;
+
+/* memory access latency (<first_chunk> <inter_chunk>) */
+static int mem_nelt = 2;
+static int mem_lat[2] =
+  { /* lat to first chunk */18, /* lat between remaining chunks */2 };
+
+/* memory access bus width (in bytes) */
+static int mem_bus_width;
+
+/* level 1 and level 2 data caches */
+static struct cache_t *cache_dl1 = NULL;
+static struct cache_t *cache_dl2 = NULL;
+
+/* PC of the load or store accessing the caches, for the prefetchers */
+static md_addr_t access_pc = 0;
+
+/* current PC as seen by the cache module's prefetchers */
+md_addr_t
+get_PC(void)
+{
+  return access_pc;
+}
+
+/* memory access latency, assumed to not cross a page boundary */
+static unsigned int			/* total latency of access */
+mem_access_latency(int blk_sz)		/* block size accessed */
+{
+  int chunks = (blk_sz + (mem_bus_width - 1)) / mem_bus_width;
+
+  return (/* first chunk latency */mem_lat[0] +
+	  (/* remainder chunk latency */mem_lat[1] * (chunks - 1)));
+}
+
+/* l1 data cache block miss handler function */
+static unsigned int			/* latency of block access */
+dl1_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
+	      md_addr_t baddr,		/* block address to access */
+	      int bsize,		/* size of block to access */
+	      struct cache_blk_t *blk,	/* ptr to block in upper level */
+	      tick_t now,		/* time of access */
+	      int prefetch)		/* 1 if the access is a prefetch */
+{
+  unsigned int lat;
+
+  if (cache_dl2)
+    {
+      /* access next level of data cache hierarchy */
+      lat = cache_access(cache_dl2, cmd, baddr, NULL, bsize,
+			 /* now */now, /* pudata */NULL, /* repl addr */NULL,
+			 prefetch);
+      /* unlimited write buffers */
+      return (cmd == Read) ? lat : 0;
+    }
+
+  /* access main memory, unlimited write buffers */
+  return (cmd == Read) ? mem_access_latency(bsize) : 0;
+}
+
+/* l2 data cache block miss handler function */
+static unsigned int			/* latency of block access */
+dl2_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
+	      md_addr_t baddr,		/* block address to access */
+	      int bsize,		/* size of block to access */
+	      struct cache_blk_t *blk,	/* ptr to block in upper level */
+	      tick_t now,		/* time of access */
+	      int prefetch)		/* 1 if the access is a prefetch */
+{
+  /* this is a miss to the lowest level, so access main memory, unlimited
+     write buffers */
+  return (cmd == Read) ? mem_access_latency(bsize) : 0;
+}
+
+/* start of a run at cycle 0, the caches start out empty and idle, with no
+   bus or fill times or prefetcher state left from an earlier run */
+static void *
+cache_model_create(tom_config_t *config)
+{
+  cache_reset(cache_dl1);
+  if (cache_dl2)
+    cache_reset(cache_dl2);
+  return NULL;
+}
+
+/* cycles a load or store takes beyond a level 1 hit */
+static int
+cache_model_access(void *state, instruction_t *instr, int is_store, tick_t now)
+{
+  unsigned int lat;
+
+  access_pc = instr->pc;
+  lat = cache_access(cache_dl1, is_store ? Write : Read, (instr->addr & ~3),
+		     NULL, 4, now, /* pudata */NULL, /* repl addr */NULL,
+		     /* prefetch */0);
+
+  return (lat > cache_dl1_lat) ? (int)(lat - cache_dl1_lat) : 0;
+}
+
+static tom_mem_t cache_model =
+  { "cache", /* shared */TRUE, cache_model_create, cache_model_access, NULL };
+
+/* register the cache options */
+void
+tom_cache_reg_options(struct opt_odb_t *odb)
+{
+  opt_reg_string(odb, "-tom:dl1",
+		 "tomasulo l1 data cache config, i.e., {<config>|none}, "
+		 "none charges loads the integer FU latency only",
+		 &cache_dl1_opt, "none", /* print */TRUE, NULL);
+
+  opt_reg_note(odb,
+"  The tomasulo cache config parameter <config> has the format of\n"
+"  sim-outorder's -cache:dl1, i.e., <name>:<nsets>:<bsize>:<assoc>:<repl>\n"
+"\n"
+"    Examples:   -tom:dl1 dl1:128:32:4:l -tom:dl2 ul2:1024:64:4:l\n"
+	       );
+
+  opt_reg_int(odb, "-tom:dl1lat",
+	      "tomasulo l1 data cache hit latency (in cycles)",
+	      &cache_dl1_lat, /* default */1,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_string(odb, "-tom:dl1pf",
+		 "tomasulo l1 data cache prefetcher, i.e., "
+		 "{<name>[:<arg>]|none} (see -cache:dl1pf of sim-outorder)",
+		 &cache_dl1_prefetch, "none", /* print */TRUE, NULL);
+
+  opt_reg_string(odb, "-tom:dl2",
+		 "tomasulo l2 data cache config, i.e., {<config>|none}",
+		 &cache_dl2_opt, "none", /* print */TRUE, NULL);
+
+  opt_reg_int(odb, "-tom:dl2lat",
+	      "tomasulo l2 data cache hit latency (in cycles)",
+	      &cache_dl2_lat, /* default */6,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int_list(odb, "-tom:mem:lat",
+		   "tomasulo memory access latency (<first_chunk> <inter_chunk>)",
+		   mem_lat, mem_nelt, &mem_nelt, mem_lat,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_int(odb, "-tom:mem:width",
+	      "tomasulo memory access bus width (in bytes)",
+	      &mem_bus_width, /* default */8,
+	      /* print */TRUE, /* format */NULL);
+}
+
+/* check the cache options and create the caches */
+void
+tom_cache_check_options(tom_config_t *config)
+{
+  char name[128], c;
+  int nsets, bsize, assoc;
+
+  if (cache_dl1_lat < 1)
+    fatal("tomasulo l1 data cache latency must be greater than zero");
+  if (cache_dl2_lat < 1)
+    fatal("tomasulo l2 data cache latency must be greater than zero");
+  if (mem_nelt != 2)
+    fatal("bad tomasulo memory access latency (<first_chunk> <inter_chunk>)");
+  if (mem_lat[0] < 1 || mem_lat[1] < 1)
+    fatal("all tomasulo memory access latencies must be greater than zero");
+  if (mem_bus_width < 1 || (mem_bus_width & (mem_bus_width-1)) != 0)
+    fatal("tomasulo memory bus width must be positive non-zero and a power of two");
+
+  /* use a level 1 D-cache? */
+  if (!mystricmp(cache_dl1_opt, "none"))
+    {
+      /* the level 2 D-cache cannot be defined */
+      if (mystricmp(cache_dl2_opt, "none"))
+	fatal("the tomasulo l1 data cache must defined if the l2 cache is defined");
+      return;
+    }
+
+  if (sscanf(cache_dl1_opt, "%[^:]:%d:%d:%d:%c",
+	     name, &nsets, &bsize, &assoc, &c) != 5)
+    fatal("bad tomasulo l1 D-cache parms: <name>:<nsets>:<bsize>:<assoc>:<repl>");
+  cache_dl1 = cache_create(name, nsets, bsize, /* balloc */FALSE,
+			   /* usize */0, assoc, cache_char2policy(c),
+			   dl1_access_fn, /* hit lat */cache_dl1_lat,
+			   cache_dl1_prefetch);
+
+  /* is the level 2 D-cache defined? */
+  if (mystricmp(cache_dl2_opt, "none"))
+    {
+      if (sscanf(cache_dl2_opt, "%[^:]:%d:%d:%d:%c",
+		 name, &nsets, &bsize, &assoc, &c) != 5)
+	fatal("bad tomasulo l2 D-cache parms: "
+	      "<name>:<nsets>:<bsize>:<assoc>:<repl>");
+      cache_dl2 = cache_create(name, nsets, bsize, /* balloc */FALSE,
+			       /* usize */0, assoc, cache_char2policy(c),
+			       dl2_access_fn, /* hit lat */cache_dl2_lat,
+			       /* prefetch */"none");
+    }
+
+  config->mem_hook = &cache_model;
+}
+
+/* register the cache statistics */
+void
+tom_cache_reg_stats(struct stat_sdb_t *sdb)
+{
+  if (cache_dl1)
+    cache_reg_stats(cache_dl1, sdb);
+  if (cache_dl2)
+    cache_reg_stats(cache_dl2, sdb);
+}
@@ -0,0 +1,22 @@
+#ifndef TOMCACHE_H
+#define TOMCACHE_H
+
+#include "host.h"
+#include "options.h"
+#include "stats.h"
+#include "tomasulo.h"
+
+//data cache hierarchy giving the Tomasulo model its load latencies, built
+//on the cache module of the assignment 4 tree (see CACHE_DIR in Makefile)
+
+//registers the -tom:dl1, -tom:dl2 and -tom:mem:* options
+extern void tom_cache_reg_options(struct opt_odb_t* odb);
+
+//checks the options and creates the caches; unless -tom:dl1 is none the
+//cache model becomes the memory latency model of config
+extern void tom_cache_check_options(tom_config_t* config);
+
+//registers the statistics of the caches, if there are any
+extern void tom_cache_reg_stats(struct stat_sdb_t* sdb);
+
+#endif
@@ -0,0 +1,236 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "misc.h"
+#include "machine.h"
+#include "decode.def"
+
+#include "instr.h"
+#include "tomasulo.h"
+
+/* DATAFLOW CRITICAL PATH */
+
+//Bounds the cycles the Tomasulo model can take on a trace by replaying its
+//register dataflow with unlimited reservation stations, functional units
+//and CDBs, under the configured functional unit latencies:
+//  - the dataflow bound also fetches every instruction at once, so it is
+//    the length of the longest dependence chain
+//  - the fetch-limited bound fetches fetch_width instructions per cycle,
+//    as the model does, so it adds the front end but no structural limits
+//Both use the model's pipeline timing: an instruction fetched in cycle f
+//executes at f+2 at the earliest, writes the CDB latency cycles after it
+//executes, and its consumers execute in the next cycle. Branches do not
+//produce values in the model, traps are never fetched.
+//Both also assume perfect memory and branch prediction: loads and stores
+//take the integer latency with no cache misses and no ordering behind
+//older stores, and fetch never stalls on a mispredicted branch. The gap
+//between the achieved cycles and the fetch-limited bound is thus not only
+//the queue/RS/FU/CDB limits but also the memory hook latency, the LSQ
+//ordering and the mispredict penalties when those are configured.
+
+//instruction classes, as in tomasulo.c
+#define IS_UNCOND_CTRL(op) (MD_OP_FLAGS(op) & F_CALL || \
+                         MD_OP_FLAGS(op) & F_UNCOND)
+#define IS_COND_CTRL(op) (MD_OP_FLAGS(op) & F_COND)
+#define IS_TRAP(op) (MD_OP_FLAGS(op) & F_TRAP)
+#define USES_FP_FU(op) (MD_OP_FLAGS(op) & F_FCOMP)
+
+//counts of one static instruction on the critical path
+typedef struct crit_pc
+{
+  md_addr_t pc;
+  enum md_opcode op;
+  counter_t count;
+}crit_pc_t;
+
+//open-addressing table of the static instructions on the critical path
+typedef struct crit_pc_table
+{
+  crit_pc_t* entries;
+  int size;              //a power of two
+  int used;
+}crit_pc_table_t;
+
+static crit_pc_t* crit_pc_lookup(crit_pc_table_t* table, md_addr_t pc) {
+
+  if (2 * (table->used + 1) > table->size) {
+    crit_pc_table_t bigger;
+    int i;
+
+    bigger.size = table->size ? 2 * table->size : 1024;
+    bigger.used = 0;
+    bigger.entries = calloc(bigger.size, sizeof(crit_pc_t));
+    if (!bigger.entries)
+      fatal("out of virtual memory");
+
+    for (i = 0; i < table->size; i++) {
+      if (table->entries[i].count) {
+        *crit_pc_lookup(&bigger, table->entries[i].pc) = table->entries[i];
+      }
+    }
+    free(table->entries);
+    *table = bigger;
+  }
+
+  unsigned int h = (pc / sizeof(md_inst_t)) * 2654435761u;
+  for (int i = h & (table->size - 1); ; i = (i + 1) & (table->size - 1)) {
+    crit_pc_t* e = &table->entries[i];
+    if (e->count == 0) {
+      e->pc = pc;
+      table->used++;
+      return e;
+    }
+    if (e->pc == pc)
+      return e;
+  }
+}
+
+//most frequent first
+static int crit_pc_compare(const void* a, const void* b) {
+
+  const crit_pc_t* x = a;
+  const crit_pc_t* y = b;
+
+  if (x->count != y->count)
+    return (x->count < y->count) ? 1 : -1;
+  return (x->pc < y->pc) ? -1 : (x->pc > y->pc);
+}
+
+//replays the dataflow of the trace, instructions are fetched fetch_width per
+//cycle if fetch_limited, all at once otherwise; returns the bound in cycles
+//(counted like tom_run()) and leaves the cycle each instruction writes the
+//CDB and the producer that held it back last (0 if none) in cdb and pred
+static counter_t crit_replay(tom_config_t* config, instruction_trace_t* trace,
+                             counter_t num_insn, bool fetch_limited,
+                             int* cdb, int* pred, int* last) {
+
+  //producer of each register, and the cycle its value is on the CDB
+  int producer[MD_TOTAL_REGS];
+  int fetched = 0, end = 0;
+  instruction_trace_t* t = trace;
+  int pos = 1;
+
+  memset(producer, 0, sizeof(producer));
+  *last = 0;
+
+  for (int i = 1; i <= num_insn; i++, pos++) {
+
+    if (pos == INSTR_TRACE_SIZE) {
+      t = t->next;
+      pos = 0;
+    }
+    instruction_t* instr = &t->table[pos];
+
+    cdb[i] = 0;
+    pred[i] = 0;
+    if (IS_TRAP(instr->op))
+      continue;
+
+    int fetch_cycle = fetch_limited ? 1 + fetched++ / config->fetch_width : 1;
+    if (IS_UNCOND_CTRL(instr->op) || IS_COND_CTRL(instr->op)) {
+      end = MAX(end, fetch_cycle + 1);
+      continue;
+    }
+
+    int execute = fetch_cycle + 2;
+    for (int j = 0; j < 3; j++) {
+      if (instr->r_in[j] == DNA || producer[instr->r_in[j]] == 0)
+        continue;
+
+      int p = producer[instr->r_in[j]];
+      if (cdb[p] + 1 > execute) {
+        execute = cdb[p] + 1;
+        pred[i] = p;
+      }
+    }
+
+    cdb[i] = execute + (USES_FP_FU(instr->op) ? config->fu_fp_latency : config->fu_int_latency);
+    if (*last == 0 || cdb[i] > cdb[*last])
+      *last = i;
+    end = MAX(end, cdb[i]);
+
+    for (int j = 0; j < 2; j++) {
+      if (instr->r_out[j] != DNA)
+        producer[instr->r_out[j]] = i;
+    }
+  }
+
+  return end + 1;
+}
+
+//analyzes the dataflow critical path of the first num_insn instructions of
+//the trace, prints the bounds against the achieved cycles and the top
+//static instructions on the critical path to stream
+void tom_critical_path(tom_config_t* config, instruction_trace_t* trace,
+                       counter_t num_insn, counter_t achieved, int top,
+                       FILE* stream) {
+
+  int* cdb = calloc(num_insn + 1, sizeof(int));
+  int* pred = calloc(num_insn + 1, sizeof(int));
+  crit_pc_table_t table;
+  counter_t dataflow, fetch, length = 0;
+  int last, i;
+  char label[64];
+
+  if (!cdb || !pred)
+    fatal("out of virtual memory");
+  memset(&table, 0, sizeof(table));
+
+  fetch = crit_replay(config, trace, num_insn, /* fetch_limited */true, cdb, pred, &last);
+  dataflow = crit_replay(config, trace, num_insn, /* fetch_limited */false, cdb, pred, &last);
+
+  //walk the dataflow critical path back from the last value produced
+  for (i = last; i != 0; i = pred[i]) {
+    instruction_t* instr = get_instr(trace, i);
+    crit_pc_t* e = crit_pc_lookup(&table, instr->pc);
+
+    e->op = instr->op;
+    e->count++;
+    length++;
+  }
+
+  fprintf(stream, "\ntomasulo critical path analysis (%.0f instructions)\n",
+          (double)num_insn);
+  fprintf(stream, "  %-44s %12.0f cycles, CPI %.4f\n",
+          "dataflow bound (unlimited resources)", (double)dataflow,
+          num_insn ? (double)dataflow / num_insn : 0.0);
+  sprintf(label, "fetch-limited bound (%d fetched/cycle)", config->fetch_width);
+  fprintf(stream, "  %-44s %12.0f cycles, CPI %.4f\n",
+          label, (double)fetch, num_insn ? (double)fetch / num_insn : 0.0);
+  fprintf(stream, "  %-44s %12.0f cycles, CPI %.4f\n",
+          "achieved (configured machine)", (double)achieved,
+          num_insn ? (double)achieved / num_insn : 0.0);
+  fprintf(stream, "  %-44s %12.0f cycles (%.1f%%): structural, memory "
+          "and mispredict\n",
+          "achieved minus fetch-limited bound", (double)(achieved - fetch),
+          achieved ? 100.0 * (achieved - fetch) / achieved : 0.0);
+
+  //the most frequent static instructions on the path
+  crit_pc_t* pcs = calloc(table.used + 1, sizeof(crit_pc_t));
+  int n = 0;
+  if (!pcs)
+    fatal("out of virtual memory");
+  for (i = 0; i < table.size; i++) {
+    if (table.entries[i].count)
+      pcs[n++] = table.entries[i];
+  }
+  qsort(pcs, n, sizeof(crit_pc_t), crit_pc_compare);
+
+  fprintf(stream, "  critical path: %.0f instructions, %d static instructions\n",
+          (double)length, n);
+  if (top > 0 && n > 0) {
+    fprintf(stream, "  %10s  %-10s %12s %8s\n", "pc", "op", "count", "%path");
+    for (i = 0; i < n && i < top; i++)
+      fprintf(stream, "  0x%08x  %-10s %12.0f %8.2f\n", (word_t)pcs[i].pc,
+              MD_OP_NAME(pcs[i].op), (double)pcs[i].count,
+              100.0 * pcs[i].count / length);
+  }
+
+  free(pcs);
+  free(table.entries);
+  free(cdb);
+  free(pred);
+}
@@ -0,0 +1,327 @@
+/* tomreplay.c - replay a recorded instruction trace through the Tomasulo model */
+
+/*
+ * This driver runs the Tomasulo timing model of tomasulo.c over an
+ * instruction trace dumped by sim-safe with `-tom:trace <file>', so timing
+ * model iterations do not have to repeat the functional simulation.
+ * Uncompressed traces are mapped into memory, traces with a .gz suffix are
+ * streamed through gzip.
+ *
+ * With `-sweep <file>' every line of the file names one machine as
+ * <name>=<value> pairs (e.g., "rsint=8 fuint=4") on top of the -tom:*
+ * options, and all machines are simulated in parallel over the one
+ * read-only trace, producing a cycles/CPI table.
+ *
+ * With `-crit <n>' a single replay is followed by a dataflow critical path
+ * analysis of the trace (see tomcrit.c) listing its n most frequent static
+ * instructions.  With `-pcstalls <n>' it is followed by the n static
+ * instructions that lost the most cycles to stalls, by reason.
+ *
+ * Loads are charged data cache latencies when a cache hierarchy is given
+ * with -tom:dl1 (see tomcache.c); the caches are shared, so such a sweep
+ * runs on one thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "host.h"
+#include "misc.h"
+#include "machine.h"
+#include "options.h"
+#include "stats.h"
+#include "sim.h"
+
+#include "instr.h"
+#include "tomasulo.h"
+#include "tomcache.h"
+
+/* number of instructions in the replayed trace, read by the timing model */
+counter_t sim_num_insn = 0;
+
+/* total cycles taken by the timing model */
+static counter_t sim_num_tom_cycles = 0;
+
+/* index of the trace file name in argv, set by orphan_fn() */
+static int trace_index = -1;
+
+/* dump help information */
+static int help_me;
+
+/* machine simulated by a single replay, and the base of every sweep point */
+static tom_config_t tom_config;
+
+/* statistics of a single replay */
+static tom_stats_t tom_stats;
+
+/* file listing the machines of a parameter sweep, one per line */
+static char *sweep_fname = NULL;
+
+/* file the per-instruction timing table of a single replay is dumped to */
+static char *timing_fname = NULL;
+
+/* number of critical path instructions listed, -1 to skip the analysis */
+static int crit_top;
+
+/* number of static instructions listed by stall cycles, -1 to skip */
+static int pc_stalls_top;
+
+/* number of worker threads for a sweep, 0 for one per online processor */
+static int sweep_threads;
+
+/* one machine of a parameter sweep */
+struct sweep_point_t
+{
+  tom_config_t config;		/* machine simulated */
+  counter_t cycles;		/* resulting cycle count */
+};
+
+/* sweep points, and the next one not yet claimed by a worker */
+static struct sweep_point_t *sweep;
+static int sweep_size = 0;
+static int sweep_next = 0;
+static pthread_mutex_t sweep_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* trace shared by all sweep workers */
+static instruction_trace_t *sweep_trace;
+
+static int
+orphan_fn(int i, int argc, char **argv)
+{
+  trace_index = i;
+  return /* done */FALSE;
+}
+
+/* read the sweep file, every non-empty line (up to a `#') is one machine */
+static void
+read_sweep(char *fname)
+{
+  char line[1024], *p;
+  int alloc = 0;
+  FILE *fd = fopen(fname, "r");
+
+  if (!fd)
+    fatal("cannot open sweep file `%s'", fname);
+
+  while (fgets(line, sizeof(line), fd))
+    {
+      if ((p = strchr(line, '#')) != NULL)
+	*p = '\0';
+      for (p = line; *p == ' ' || *p == '\t'; p++)
+	;
+      if (*p == '\0' || *p == '\n' || *p == '\r')
+	continue;
+
+      if (sweep_size == alloc)
+	{
+	  alloc = alloc ? 2 * alloc : 64;
+	  sweep = realloc(sweep, alloc * sizeof(struct sweep_point_t));
+	  if (!sweep)
+	    fatal("out of virtual memory");
+	}
+      sweep[sweep_size].config = tom_config;
+      tom_parse_config(&sweep[sweep_size].config, p);
+      tom_check_config(&sweep[sweep_size].config);
+      sweep[sweep_size].cycles = 0;
+      sweep_size++;
+    }
+  fclose(fd);
+
+  if (sweep_size == 0)
+    fatal("sweep file `%s' lists no machines", fname);
+}
+
+/* sweep worker, simulates unclaimed sweep points until none are left */
+static void *
+sweep_worker(void *arg)
+{
+  int i;
+
+  while (TRUE)
+    {
+      pthread_mutex_lock(&sweep_lock);
+      i = sweep_next++;
+      pthread_mutex_unlock(&sweep_lock);
+
+      if (i >= sweep_size)
+	break;
+      sweep[i].cycles =
+	tom_run(&sweep[i].config, sweep_trace, sim_num_insn, /* timing */NULL,
+		/* stats */NULL);
+    }
+  return NULL;
+}
+
+/* simulate all sweep points on NTHREADS threads and print the CPI table */
+static void
+run_sweep(instruction_trace_t *trace, int nthreads, FILE *stream)
+{
+  pthread_t *threads;
+  int i;
+
+  if (nthreads > sweep_size)
+    nthreads = sweep_size;
+
+  sweep_trace = trace;
+  sweep_next = 0;
+
+  threads = calloc(nthreads, sizeof(pthread_t));
+  if (!threads)
+    fatal("out of virtual memory");
+
+  fprintf(stderr, "tomreplay: ** sweeping %d machines on %d threads **\n",
+	  sweep_size, nthreads);
+  for (i = 0; i < nthreads; i++)
+    {
+      if (pthread_create(&threads[i], NULL, sweep_worker, NULL) != 0)
+	fatal("cannot create sweep thread");
+    }
+  for (i = 0; i < nthreads; i++)
+    pthread_join(threads[i], NULL);
+  free(threads);
+
+  fprintf(stream, "# %10s %8s  %s\n", "cycles", "CPI", "machine");
+  for (i = 0; i < sweep_size; i++)
+    {
+      fprintf(stream, "%12.0f %8.4f  ", (double)sweep[i].cycles,
+	      sim_num_insn ? (double)sweep[i].cycles / sim_num_insn : 0.0);
+      tom_print_config(&sweep[i].config, stream);
+      fprintf(stream, "\n");
+    }
+}
+
+static void
+usage(struct opt_odb_t *odb, FILE *fd, int argc, char **argv)
+{
+  fprintf(fd, "Usage: %s {-options} trace-file\n", argv[0]);
+  opt_print_help(odb, fd);
+}
+
+int
+main(int argc, char **argv)
+{
+  struct opt_odb_t *odb;
+  struct stat_sdb_t *sdb;
+  instruction_trace_t *trace, *next;
+
+  odb = opt_new(orphan_fn);
+  opt_reg_header(odb,
+"tomreplay: This driver replays an instruction trace recorded by sim-safe\n"
+"(-tom:trace) through the Tomasulo timing model without re-running the\n"
+"functional simulation.\n"
+		 );
+  opt_reg_flag(odb, "-h", "print help message",
+	       &help_me, /* default */FALSE, /* !print */FALSE, NULL);
+  opt_reg_string(odb, "-sweep",
+		 "simulate every machine listed in this file (one per line, "
+		 "as <name>=<value> pairs) in parallel",
+		 &sweep_fname, /* default */NULL, /* print */TRUE, NULL);
+  opt_reg_string(odb, "-timing",
+		 "dump the per-instruction timing table to this file for "
+		 "tomview (a .gz suffix compresses it)",
+		 &timing_fname, /* default */NULL, /* print */TRUE, NULL);
+  opt_reg_int(odb, "-crit",
+	      "analyze the dataflow critical path of a single replay, listing "
+	      "this many of its static instructions (-1 to skip)",
+	      &crit_top, /* default */-1, /* print */TRUE, NULL);
+  opt_reg_int(odb, "-pcstalls",
+	      "list this many static instructions of a single replay by "
+	      "stall cycles, with the cycles lost to each reason (-1 to skip)",
+	      &pc_stalls_top, /* default */-1, /* print */TRUE, NULL);
+  opt_reg_int(odb, "-threads",
+	      "sweep worker threads (0 for one per online processor)",
+	      &sweep_threads, /* default */0, /* print */TRUE, NULL);
+  tom_reg_options(odb, &tom_config);
+  tom_cache_reg_options(odb);
+
+  opt_process_options(odb, argc, argv);
+
+  if (help_me)
+    {
+      usage(odb, stdout, argc, argv);
+      exit(0);
+    }
+  if (trace_index == -1)
+    {
+      fprintf(stderr, "error: no trace file specified\n");
+      usage(odb, stderr, argc, argv);
+      exit(1);
+    }
+  tom_check_config(&tom_config);
+  tom_cache_check_options(&tom_config);
+
+  if (sweep_threads < 0)
+    fatal("number of sweep threads must not be negative");
+  if (sweep_threads == 0)
+    sweep_threads = MAX((int)sysconf(_SC_NPROCESSORS_ONLN), 1);
+
+  /* a memory model with global state serializes the sweep */
+  if (tom_config.mem_hook && tom_config.mem_hook->shared)
+    sweep_threads = 1;
+  if (sweep_fname)
+    read_sweep(sweep_fname);
+
+  sdb = stat_new();
+  stat_reg_counter(sdb, "sim_num_insn",
+		   "total number of instructions replayed",
+		   &sim_num_insn, 0, NULL);
+  stat_reg_counter(sdb, "sim_num_tom_cycles",
+		   "total number of cycles with tomasulo",
+		   &sim_num_tom_cycles, 0, NULL);
+  stat_reg_formula(sdb, "sim_tom_CPI",
+		   "cycles per instruction with tomasulo",
+		   "sim_num_tom_cycles / sim_num_insn", NULL);
+  tom_reg_stats(sdb, &tom_stats, &tom_config);
+  tom_cache_reg_stats(sdb);
+
+  fprintf(stderr, "tomreplay: loading trace `%s'\n", argv[trace_index]);
+  trace = load_instr_file(argv[trace_index], &sim_num_insn);
+
+  if (sweep_fname)
+    {
+      if (sim_num_insn > 0)
+	run_sweep(trace, sweep_threads, stdout);
+    }
+  else
+    {
+      fprintf(stderr, "tomreplay: ** replaying %.0f instructions **\n",
+	      (double)sim_num_insn);
+      if (pc_stalls_top >= 0)
+	tom_stats.pc_stalls = tom_pc_stalls_create();
+      if (sim_num_insn > 0 && timing_fname)
+	{
+	  tom_timing_t *timing = tom_timing_create(sim_num_insn);
+
+	  sim_num_tom_cycles =
+	    tom_run(&tom_config, trace, sim_num_insn, timing, &tom_stats);
+	  write_timing_file(timing_fname, trace, timing);
+	  tom_timing_free(timing);
+	}
+      else if (sim_num_insn > 0)
+	sim_num_tom_cycles =
+	  tom_run(&tom_config, trace, sim_num_insn, /* timing */NULL,
+		  &tom_stats);
+
+      stat_print_stats(sdb, stderr);
+      if (sim_num_insn > 0 && crit_top >= 0)
+	tom_critical_path(&tom_config, trace, sim_num_insn,
+			  sim_num_tom_cycles, crit_top, stderr);
+      if (tom_stats.pc_stalls)
+	{
+	  tom_pc_stalls_print(tom_stats.pc_stalls, pc_stalls_top, stderr);
+	  tom_pc_stalls_free(tom_stats.pc_stalls);
+	  tom_stats.pc_stalls = NULL;
+	}
+    }
+
+  for (; trace != NULL; trace = next)
+    {
+      next = trace->next;
+      free(trace);
+    }
+
+  return 0;
+}
@@ -0,0 +1,251 @@
+/* tomview.c - render a Tomasulo timing table dumped by sim-safe or tomreplay */
+
+/*
+ * This tool reads the timing file written by sim-safe or tomreplay with
+ * `-tom:timing <file>' (`-timing <file>' for tomreplay), the cycles every
+ * instruction entered each stage stored column by column, and renders it
+ * offline.  By default it prints aggregates: how long instructions of each
+ * opcode waited between stages.  With -text it prints the table itself, one
+ * instruction per line, optionally limited to a range of instructions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "misc.h"
+#include "machine.h"
+#include "options.h"
+
+#include "instr.h"
+
+/* index of the timing file name in argv, set by orphan_fn() */
+static int timing_index = -1;
+
+/* dump help information */
+static int help_me;
+
+/* print the table as text instead of aggregates */
+static int print_text;
+
+/* range of instructions printed by -text */
+static int first_insn;
+static int last_insn;
+
+/* columns of the timing file, entry i is instruction i + 1 */
+static word_t num_insn;
+static md_addr_t *pcs;
+static half_t *ops;
+static int *dispatch_cycle, *issue_cycle, *execute_cycle, *cdb_cycle,
+  *commit_cycle;
+
+/* stage transitions aggregated per opcode */
+enum { WAIT_ISSUE, WAIT_EXECUTE, WAIT_CDB, WAIT_COMMIT, NUM_WAITS };
+
+static char *wait_names[NUM_WAITS] =
+  { "disp->iss", "iss->exec", "exec->cdb", "cdb->commit" };
+
+static int
+orphan_fn(int i, int argc, char **argv)
+{
+  timing_index = i;
+  return /* done */FALSE;
+}
+
+/* allocate and read one column of the timing file */
+static void *
+read_column(FILE *fd, size_t size, char *fname)
+{
+  void *column = malloc(MAX(num_insn, 1) * size);
+
+  if (!column)
+    fatal("out of virtual memory");
+  if (num_insn > 0 && fread(column, size, num_insn, fd) != num_insn)
+    fatal("timing file `%s' is truncated", fname);
+  return column;
+}
+
+/* read all columns of a timing file */
+static void
+read_timing_file(char *fname)
+{
+  timing_file_header_t header;
+  FILE *fd = gzopen(fname, "r");
+
+  if (!fd)
+    fatal("cannot open timing file `%s'", fname);
+  setvbuf(fd, NULL, _IOFBF, 1 << 20);
+
+  if (fread(&header, sizeof(header), 1, fd) != 1
+      || memcmp(header.magic, TIMING_FILE_MAGIC, sizeof(header.magic)) != 0)
+    fatal("`%s' is not a timing file", fname);
+  if (header.byte_order != INSTR_FILE_BYTE_ORDER)
+    fatal("timing file `%s' was written on a host with a different byte order",
+	  fname);
+  if (header.version != TIMING_FILE_VERSION
+      || header.num_columns != TIMING_FILE_COLUMNS)
+    fatal("timing file `%s' has version %d, expected %d",
+	  fname, header.version, TIMING_FILE_VERSION);
+
+  num_insn = header.num_insn;
+  pcs = read_column(fd, sizeof(md_addr_t), fname);
+  ops = read_column(fd, sizeof(half_t), fname);
+  dispatch_cycle = read_column(fd, sizeof(int), fname);
+  issue_cycle = read_column(fd, sizeof(int), fname);
+  execute_cycle = read_column(fd, sizeof(int), fname);
+  cdb_cycle = read_column(fd, sizeof(int), fname);
+  commit_cycle = read_column(fd, sizeof(int), fname);
+
+  gzclose(fd);
+}
+
+/* name of opcode OP, checked against the opcode range */
+static char *
+op_name(int op)
+{
+  return (op > 0 && op < OP_MAX) ? MD_OP_NAME(op) : "<bogus>";
+}
+
+/* print instructions FIRST to LAST (1-based, inclusive) as text */
+static void
+print_table(FILE *stream, int first, int last)
+{
+  int i;
+
+  fprintf(stream, "# %8s %10s %-10s %8s %8s %8s %8s %8s\n", "index", "pc",
+	  "op", "dispatch", "issue", "execute", "cdb", "commit");
+  for (i = first - 1; i < last; i++)
+    fprintf(stream, "%10d 0x%08x %-10s %8d %8d %8d %8d %8d\n", i + 1,
+	    (word_t)pcs[i], op_name(ops[i]), dispatch_cycle[i], issue_cycle[i],
+	    execute_cycle[i], cdb_cycle[i], commit_cycle[i]);
+}
+
+/* accumulate the wait between two stages, if the instruction saw both */
+#define ADD_WAIT(W, FROM, TO)						\
+  do {									\
+    if ((FROM) && (TO))							\
+      {									\
+	sum[op][W] += (TO) - (FROM);					\
+	cnt[op][W]++;							\
+	total_sum[W] += (TO) - (FROM);					\
+	total_cnt[W]++;							\
+      }									\
+  } while (0)
+
+/* print the average stage waits per opcode and over all instructions */
+static void
+print_aggregates(FILE *stream)
+{
+  static double sum[OP_MAX][NUM_WAITS];
+  static counter_t cnt[OP_MAX][NUM_WAITS], insns[OP_MAX];
+  double total_sum[NUM_WAITS];
+  counter_t total_cnt[NUM_WAITS];
+  int i, op, w, last_cycle = 0;
+
+  memset(total_sum, 0, sizeof(total_sum));
+  memset(total_cnt, 0, sizeof(total_cnt));
+
+  for (i = 0; i < num_insn; i++)
+    {
+      op = (ops[i] > 0 && ops[i] < OP_MAX) ? ops[i] : 0;
+      insns[op]++;
+
+      ADD_WAIT(WAIT_ISSUE, dispatch_cycle[i], issue_cycle[i]);
+      ADD_WAIT(WAIT_EXECUTE, issue_cycle[i], execute_cycle[i]);
+      ADD_WAIT(WAIT_CDB, execute_cycle[i], cdb_cycle[i]);
+      ADD_WAIT(WAIT_COMMIT, cdb_cycle[i], commit_cycle[i]);
+
+      last_cycle = MAX(last_cycle, MAX(cdb_cycle[i], commit_cycle[i]));
+    }
+
+  fprintf(stream, "instructions: %d\n", (int)num_insn);
+  fprintf(stream, "last cycle:   %d\n", last_cycle);
+  fprintf(stream, "\naverage cycles between stages:\n");
+  fprintf(stream, "%-12s %10s", "op", "count");
+  for (w = 0; w < NUM_WAITS; w++)
+    fprintf(stream, " %11s", wait_names[w]);
+  fprintf(stream, "\n");
+
+  for (op = 0; op < OP_MAX; op++)
+    {
+      if (!insns[op])
+	continue;
+      fprintf(stream, "%-12s %10.0f", op_name(op), (double)insns[op]);
+      for (w = 0; w < NUM_WAITS; w++)
+	{
+	  if (cnt[op][w])
+	    fprintf(stream, " %11.2f", sum[op][w] / cnt[op][w]);
+	  else
+	    fprintf(stream, " %11s", "-");
+	}
+      fprintf(stream, "\n");
+    }
+
+  fprintf(stream, "%-12s %10d", "all", (int)num_insn);
+  for (w = 0; w < NUM_WAITS; w++)
+    {
+      if (total_cnt[w])
+	fprintf(stream, " %11.2f", total_sum[w] / total_cnt[w]);
+      else
+	fprintf(stream, " %11s", "-");
+    }
+  fprintf(stream, "\n");
+}
+
+static void
+usage(struct opt_odb_t *odb, FILE *fd, int argc, char **argv)
+{
+  fprintf(fd, "Usage: %s {-options} timing-file\n", argv[0]);
+  opt_print_help(odb, fd);
+}
+
+int
+main(int argc, char **argv)
+{
+  struct opt_odb_t *odb;
+
+  odb = opt_new(orphan_fn);
+  opt_reg_header(odb,
+"tomview: This tool renders a Tomasulo timing table dumped by sim-safe\n"
+"(-tom:timing) or tomreplay (-timing), as per-opcode aggregates or as text.\n"
+		 );
+  opt_reg_flag(odb, "-h", "print help message",
+	       &help_me, /* default */FALSE, /* !print */FALSE, NULL);
+  opt_reg_flag(odb, "-text", "print the timing table as text",
+	       &print_text, /* default */FALSE, /* print */TRUE, NULL);
+  opt_reg_int(odb, "-first", "first instruction printed by -text",
+	      &first_insn, /* default */1, /* print */TRUE, NULL);
+  opt_reg_int(odb, "-last",
+	      "last instruction printed by -text (0 for the last one)",
+	      &last_insn, /* default */0, /* print */TRUE, NULL);
+
+  opt_process_options(odb, argc, argv);
+
+  if (help_me)
+    {
+      usage(odb, stdout, argc, argv);
+      exit(0);
+    }
+  if (timing_index == -1)
+    {
+      fprintf(stderr, "error: no timing file specified\n");
+      usage(odb, stderr, argc, argv);
+      exit(1);
+    }
+
+  read_timing_file(argv[timing_index]);
+
+  if (print_text)
+    {
+      if (last_insn == 0 || last_insn > num_insn)
+	last_insn = num_insn;
+      if (first_insn < 1)
+	first_insn = 1;
+      print_table(stdout, first_insn, last_insn);
+    }
+  else
+    print_aggregates(stdout);
+
+  return 0;
+}
@@ -51,6 +51,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include "host.h"
@@ -87,11 +88,36 @@
 #define CACHE_HALF(data, bofs)	  __CACHE_ACCESS(unsigned short, data, bofs)
 #define CACHE_BYTE(data, bofs)	  __CACHE_ACCESS(unsigned char, data, bofs)
 
-/* cache block hashing macros, this macro is used to index into a cache
-   set hash table (to find the correct block on N in an N-way cache), the
-   cache set index function is CACHE_SET, defined above */
-#define CACHE_HASH(cp, key)						\
-  (((key >> 24) ^ (key >> 16) ^ (key >> 8) ^ key) & ((cp)->hsize-1))
+/* tag of an invalid way, real tags are at least 3 bits shorter (blocks
+   are 8 bytes or larger), so it never matches */
+#define CACHE_TAG_INVALID	((md_addr_t)-1)
+
+/* ways compared per step of a set lookup, the compares of one step have no
+   branches, so the compiler can do them with vector instructions */
+#define CACHE_MATCH_WAYS	16
+
+/* re-reference prediction values (RRPVs) of 2-bit RRIP, a hit predicts a
+   near re-reference, SRRIP fills predict a long one, and the victim is the
+   first block predicted distant */
+#define RRIP_NEAR		0
+#define RRIP_LONG		2
+#define RRIP_DISTANT		3
+
+/* one BRRIP fill in this many is inserted long, the rest distant; which
+   ones is random, a fixed count would line up with sets swept in order */
+#define RRIP_BIP_RATE		32
+
+/* DRRIP dueling, leader sets per policy and the 10-bit policy selector */
+#define RRIP_DUEL_SETS		32
+#define RRIP_PSEL_MAX		1023
+
+/* SHiP signature history counter table, 3-bit counters indexed by a hash
+   of the PC, prefetch fills get a signature of their own */
+#define SHIP_SHCT_SIZE		16384
+#define SHIP_SHCT_MAX		7
+#define SHIP_SIGNATURE(pc, prefetch)					\
+  ((half_t)((((pc) >> 3) ^ ((pc) >> 17) ^ ((prefetch) ? SHIP_SHCT_SIZE/2 : 0)) \
+	    & (SHIP_SHCT_SIZE - 1)))
 
 /* copy data out of a cache block to buffer indicated by argument pointer p */
 #define CACHE_BCOPY(cmd, blk, bofs, p, nbytes)	\
@@ -136,124 +162,392 @@
     }\
   }
 
+/* pollution filter bit of block address BADDR */
+#define PF_FILTER_BIT(cp, baddr)					\
+  ((((baddr) >> (cp)->set_shift) ^ ((baddr) >> (cp)->tag_shift))	\
+   & (cp)->pf_filter_mask)
+#define PF_FILTER_TEST(cp, baddr)					\
+  ((cp)->pf_filter[PF_FILTER_BIT(cp, baddr) >> 5]			\
+   & (1 << (PF_FILTER_BIT(cp, baddr) & 31)))
+#define PF_FILTER_SET(cp, baddr)					\
+  ((cp)->pf_filter[PF_FILTER_BIT(cp, baddr) >> 5]			\
+   |= (1 << (PF_FILTER_BIT(cp, baddr) & 31)))
+#define PF_FILTER_CLEAR(cp, baddr)					\
+  ((cp)->pf_filter[PF_FILTER_BIT(cp, baddr) >> 5]			\
+   &= ~(1 << (PF_FILTER_BIT(cp, baddr) & 31)))
+
 /* bound sqword_t/dfloat_t to positive int */
 #define BOUND_POS(N)		((int)(MIN(MAX(0, (N)), 2147483647)))
 
-/* unlink BLK from the hash table bucket chain in SET */
-static void
-unlink_htab_ent(struct cache_t *cp,		/* cache to update */
-		struct cache_set_t *set,	/* set containing bkt chain */
-		struct cache_blk_t *blk)	/* block to unlink */
+/* PC of the access that queued the prefetch being issued from a prefetch
+   queue, 0 if none is; a queued prefetch is issued after its access is
+   gone, so get_PC() no longer names it */
+static md_addr_t pfq_issue_PC = 0;
+
+/* PC of the current access, for SHiP and the PC-indexed prefetchers */
+static md_addr_t
+access_PC(void)
 {
-  struct cache_blk_t *prev, *ent;
-  int index = CACHE_HASH(cp, blk->tag);
+  return pfq_issue_PC ? pfq_issue_PC : get_PC();
+}
 
-  /* locate the block in the hash table bucket chain */
-  for (prev=NULL,ent=set->hash[index];
-       ent;
-       prev=ent,ent=ent->hash_next)
-    {
-      if (ent == blk)
-	break;
-    }
-  assert(ent);
+/* find the way of SET holding TAG in cache CP, -1 if there is none; the
+   valid tags of a set are unique and invalid ways never match, so the sum
+   of (way + 1) over the matching ways of a step names the way */
+static int				/* way holding TAG, or -1 */
+cache_find_way(struct cache_t *cp,	/* cache instance */
+	       struct cache_set_t *set,	/* set to search */
+	       md_addr_t tag)		/* tag to look for */
+{
+  md_addr_t *tags = set->tags;
+  int i, j, match;
 
-  /* unlink the block from the hash table bucket chain */
-  if (!prev)
+  /* a few ways, a plain search is as fast */
+  if (cp->assoc < CACHE_MATCH_WAYS)
     {
-      /* head of hash bucket list */
-      set->hash[index] = ent->hash_next;
+      for (i=0; i<cp->assoc; i++)
+	{
+	  if (tags[i] == tag)
+	    return i;
+	}
+      return -1;
     }
-  else
+
+  /* ASSOC is a multiple of CACHE_MATCH_WAYS, both are powers of two */
+  for (i=0; i<cp->assoc; i+=CACHE_MATCH_WAYS)
     {
-      /* middle or end of hash bucket list */
-      prev->hash_next = ent->hash_next;
+      match = 0;
+      for (j=0; j<CACHE_MATCH_WAYS; j++)
+	match += (tags[i+j] == tag) * (j+1);
+      if (match)
+	return i + match - 1;
     }
-  ent->hash_next = NULL;
+  return -1;
 }
 
-/* insert BLK onto the head of the hash table bucket chain in SET */
+/* make way WAY the youngest in SET (age 0), the ways younger than it
+   age by one */
 static void
-link_htab_ent(struct cache_t *cp,		/* cache to update */
-	      struct cache_set_t *set,		/* set containing bkt chain */
-	      struct cache_blk_t *blk)		/* block to insert */
+age_touch(struct cache_t *cp,		/* cache instance */
+	  struct cache_set_t *set,	/* set to update */
+	  int way)			/* way to make youngest */
 {
-  int index = CACHE_HASH(cp, blk->tag);
+  half_t *ages = set->ages;
+  half_t age = ages[way];
+  int i;
 
-  /* insert block onto the head of the bucket chain */
-  blk->hash_next = set->hash[index];
-  set->hash[index] = blk;
+  for (i=0; i<cp->assoc; i++)
+    ages[i] += (ages[i] < age);
+  ages[way] = 0;
 }
 
-/* where to insert a block onto the ordered way chain */
-enum list_loc_t { Head, Tail };
-
-/* insert BLK into the order way chain in SET at location WHERE */
+/* make way WAY the oldest in SET (age ASSOC-1), the ways older than it
+   get younger by one */
 static void
-update_way_list(struct cache_set_t *set,	/* set contained way chain */
-		struct cache_blk_t *blk,	/* block to insert */
-		enum list_loc_t where)		/* insert location */
+age_demote(struct cache_t *cp,		/* cache instance */
+	   struct cache_set_t *set,	/* set to update */
+	   int way)			/* way to make oldest */
+{
+  half_t *ages = set->ages;
+  half_t age = ages[way];
+  int i;
+
+  for (i=0; i<cp->assoc; i++)
+    ages[i] -= (ages[i] > age);
+  ages[way] = cp->assoc - 1;
+}
+
+/* replace the oldest way of SET, it becomes the youngest and all others
+   age by one, in one pass; ages are a permutation of 0..ASSOC-1 */
+static int				/* way replaced */
+age_replace(struct cache_t *cp,		/* cache instance */
+	    struct cache_set_t *set)	/* set to update */
 {
-  /* unlink entry from the way list */
-  if (!blk->way_prev && !blk->way_next)
+  half_t *ages = set->ages;
+  half_t oldest = cp->assoc - 1;
+  int i, way = 0;
+
+  for (i=0; i<cp->assoc; i++)
     {
-      /* only one entry in list (direct-mapped), no action */
-      assert(set->way_head == blk && set->way_tail == blk);
-      /* Head/Tail order already */
-      return;
+      way += (ages[i] == oldest) * i;
+      ages[i]++;
     }
-  /* else, more than one element in the list */
-  else if (!blk->way_prev)
+  ages[way] = 0;
+  return way;
+}
+
+/* choose the victim of SET, the first way predicted distant; if there is
+   none, all ways age until one is, in one pass */
+static int				/* way replaced */
+rrip_victim(struct cache_t *cp,		/* cache instance */
+	    struct cache_set_t *set)	/* set to update */
+{
+  half_t *ages = set->ages;
+  half_t oldest = 0;
+  int i, way = 0;
+
+  for (i=0; i<cp->assoc; i++)
     {
-      assert(set->way_head == blk && set->way_tail != blk);
-      if (where == Head)
+      if (ages[i] > oldest)
 	{
-	  /* already there */
-	  return;
+	  oldest = ages[i];
+	  way = i;
 	}
-      /* else, move to tail */
-      set->way_head = blk->way_next;
-      blk->way_next->way_prev = NULL;
     }
-  else if (!blk->way_next)
+  if (oldest < RRIP_DISTANT)
     {
-      /* end of list (and not front of list) */
-      assert(set->way_head != blk && set->way_tail == blk);
-      if (where == Tail)
-	{
-	  /* already there */
-	  return;
-	}
-      set->way_tail = blk->way_prev;
-      blk->way_prev->way_next = NULL;
+      for (i=0; i<cp->assoc; i++)
+	ages[i] += RRIP_DISTANT - oldest;
     }
-  else
+  return way;
+}
+
+/* RRPV of a BRRIP fill, mostly distant; a xorshift generator of the
+   cache's own keeps the other users of myrand() unaffected */
+static half_t				/* RRPV to insert with */
+brrip_insert(struct cache_t *cp)	/* cache instance */
+{
+  word_t x = cp->bip_rand;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  cp->bip_rand = x;
+  return (x % RRIP_BIP_RATE) == 0 ? RRIP_LONG : RRIP_DISTANT;
+}
+
+/* make way WAY of SET the most recently used in its tree, every node on
+   the path from the root points away from it */
+static void
+plru_touch(struct cache_t *cp,		/* cache instance */
+	   struct cache_set_t *set,	/* set to update */
+	   int way)			/* way used */
+{
+  half_t *ages = set->ages;
+  int node = 1, bit, right;
+
+  for (bit = cp->assoc >> 1; bit; bit >>= 1)
     {
-      /* middle of list (and not front or end of list) */
-      assert(set->way_head != blk && set->way_tail != blk);
-      blk->way_prev->way_next = blk->way_next;
-      blk->way_next->way_prev = blk->way_prev;
+      right = (way & bit) != 0;
+      ages[node] = !right;
+      node = 2*node + right;
     }
+}
+
+/* make way WAY of SET the next victim, every node on the path from the
+   root points toward it */
+static void
+plru_demote(struct cache_t *cp,		/* cache instance */
+	    struct cache_set_t *set,	/* set to update */
+	    int way)			/* way to replace next */
+{
+  half_t *ages = set->ages;
+  int node = 1, bit, right;
 
-  /* link BLK back into the list */
-  if (where == Head)
+  for (bit = cp->assoc >> 1; bit; bit >>= 1)
     {
-      /* link to the head of the way list */
-      blk->way_next = set->way_head;
-      blk->way_prev = NULL;
-      set->way_head->way_prev = blk;
-      set->way_head = blk;
+      right = (way & bit) != 0;
+      ages[node] = right;
+      node = 2*node + right;
     }
-  else if (where == Tail)
+}
+
+/* follow the tree of SET from the root to its pseudo-LRU way */
+static int				/* way replaced */
+plru_victim(struct cache_t *cp,		/* cache instance */
+	    struct cache_set_t *set)	/* set to search */
+{
+  half_t *ages = set->ages;
+  int node = 1;
+
+  while (node < cp->assoc)
+    node = 2*node + ages[node];
+  return node - cp->assoc;
+}
+
+/* choose the way of SET in cache CP a miss replaces; LRU and FIFO make it
+   the youngest already, the others are told of the fill by repl_insert() */
+static int				/* way replaced */
+repl_victim(struct cache_t *cp,		/* cache instance */
+	    md_addr_t set)		/* set of the miss */
+{
+  switch (cp->policy) {
+  case LRU:
+  case FIFO:
+    return age_replace(cp, &cp->sets[set]);
+  case Random:
+    return myrand() & (cp->assoc - 1);
+  case SRRIP:
+  case BRRIP:
+  case DRRIP:
+  case SHiP:
+    return rrip_victim(cp, &cp->sets[set]);
+  case PLRU:
+    return plru_victim(cp, &cp->sets[set]);
+  default:
+    panic("bogus replacement policy");
+  }
+}
+
+/* set up the replacement state of BLK, just filled into way WAY of SET in
+   cache CP; DRRIP leader sets train the policy selector on regular misses,
+   SHiP predicts from the history of the fill's signature */
+static void
+repl_insert(struct cache_t *cp,		/* cache instance */
+	    md_addr_t set,		/* set filled */
+	    int way,			/* way filled */
+	    struct cache_blk_t *blk,	/* block filled */
+	    int prefetch)		/* 1 if the fill is a prefetch */
+{
+  half_t *ages = cp->sets[set].ages;
+  int leader;
+
+  switch (cp->policy) {
+  case SRRIP:
+    ages[way] = RRIP_LONG;
+    break;
+  case BRRIP:
+    ages[way] = brrip_insert(cp);
+    break;
+  case DRRIP:
+    leader = set & cp->duel_mask;
+    if (leader == 0)
+      {
+	if (prefetch == 0 && cp->psel < RRIP_PSEL_MAX)
+	  cp->psel++;
+	ages[way] = RRIP_LONG;
+      }
+    else if (leader == cp->duel_mask)
+      {
+	if (prefetch == 0 && cp->psel > 0)
+	  cp->psel--;
+	ages[way] = brrip_insert(cp);
+      }
+    else
+      ages[way] = (cp->psel > RRIP_PSEL_MAX/2
+		   ? brrip_insert(cp) : RRIP_LONG);
+    break;
+  case SHiP:
+    blk->signature = SHIP_SIGNATURE(access_PC(), prefetch);
+    ages[way] = cp->shct[blk->signature] ? RRIP_LONG : RRIP_DISTANT;
+    break;
+  case PLRU:
+    plru_touch(cp, &cp->sets[set], way);
+    break;
+  default:
+    /* LRU and FIFO are done, Random keeps no state */
+    break;
+  }
+
+  if (ages[way] == RRIP_DISTANT && cp->policy != PLRU)
+    cp->distant_fills++;
+}
+
+/* update the replacement state of SET in cache CP for a hit to BLK in way
+   WAY; only regular hits train SHiP */
+static void
+repl_touch(struct cache_t *cp,		/* cache instance */
+	   md_addr_t set,		/* set hit */
+	   int way,			/* way hit */
+	   struct cache_blk_t *blk,	/* block hit */
+	   int prefetch)		/* 1 if the hit is a prefetch */
+{
+  half_t *ages = cp->sets[set].ages;
+
+  switch (cp->policy) {
+  case LRU:
+    /* if this is not the youngest block, make it so */
+    if (ages[way] != 0)
+      age_touch(cp, &cp->sets[set], way);
+    break;
+  case SHiP:
+    if (prefetch == 0)
+      {
+	blk->status |= CACHE_BLK_REUSED;
+	if (cp->shct[blk->signature] < SHIP_SHCT_MAX)
+	  cp->shct[blk->signature]++;
+      }
+    /* fall through */
+  case SRRIP:
+  case BRRIP:
+  case DRRIP:
+    ages[way] = RRIP_NEAR;
+    break;
+  case PLRU:
+    plru_touch(cp, &cp->sets[set], way);
+    break;
+  default:
+    /* FIFO and Random ignore hits */
+    break;
+  }
+}
+
+/* make way WAY of SET in cache CP, just invalidated, the next victim */
+static void
+repl_demote(struct cache_t *cp,		/* cache instance */
+	    md_addr_t set,		/* set of the block */
+	    int way)			/* way invalidated */
+{
+  switch (cp->policy) {
+  case SRRIP:
+  case BRRIP:
+  case DRRIP:
+  case SHiP:
+    cp->sets[set].ages[way] = RRIP_DISTANT;
+    break;
+  case PLRU:
+    plru_demote(cp, &cp->sets[set], way);
+    break;
+  default:
+    age_demote(cp, &cp->sets[set], way);
+    break;
+  }
+}
+
+/* select the prefetcher of cache CP from SPEC, "<name>[:<arg>]", "none" or
+   NULL, and create its state; the assignment's numeric prefetcher types are
+   still accepted: 0 (none), 1 (next line), 2 (open ended) and N > 2 (stride,
+   with an N-entry RPT) */
+static void
+select_prefetcher(struct cache_t *cp,	/* cache to attach prefetcher to */
+		  char *spec)		/* prefetcher spec */
+{
+  char name[128], *colon, junk;
+  int type;
+
+  cp->prefetcher = NULL;
+  cp->prefetch_arg = 0;
+  cp->prefetch_state = NULL;
+  if (!spec || !mystricmp(spec, "none"))
+    return;
+
+  if (sscanf(spec, "%d%c", &type, &junk) == 1)
     {
-      /* link to the tail of the way list */
-      blk->way_prev = set->way_tail;
-      blk->way_next = NULL;
-      set->way_tail->way_next = blk;
-      set->way_tail = blk;
+      if (type < 0)
+	fatal("prefetcher type `%d' must be a positive number", type);
+      if (type == 0)
+	return;
+      strcpy(name, type == 1 ? "nextline" : type == 2 ? "openended" : "stride");
+      cp->prefetch_arg = (type > 2) ? type : 0;
     }
   else
-    panic("bogus WHERE designator");
+    {
+      if (strlen(spec) >= sizeof(name))
+	fatal("bogus prefetcher `%s'", spec);
+      strcpy(name, spec);
+      if ((colon = strchr(name, ':')) != NULL)
+	{
+	  *colon = '\0';
+	  if (sscanf(colon+1, "%d%c", &cp->prefetch_arg, &junk) != 1)
+	    fatal("bad prefetcher `%s', use <name>[:<number>]", spec);
+	}
+    }
+
+  cp->prefetcher = cache_find_prefetcher(name);
+  if (!cp->prefetcher)
+    fatal("unknown prefetcher `%s' for cache `%s'", name, cp->name);
+  if (cp->prefetcher->create)
+    cp->prefetch_state = cp->prefetcher->create(cp, cp->prefetch_arg);
 }
 
 /* create and initialize a general cache structure */
@@ -271,7 +565,7 @@ cache_create(char *name,		/* name of the cache */
 					   struct cache_blk_t *blk,
 					   tick_t now, int prefetch),
 	     unsigned int hit_latency,	/* latency in cycles for a hit */
-	     int prefetch_type)		/* prefetcher type */
+	     char *prefetch)		/* prefetcher, see select_prefetcher() */
 {
   struct cache_t *cp;
   struct cache_blk_t *blk;
@@ -293,10 +587,10 @@ cache_create(char *name,		/* name of the cache */
     fatal("cache associativity `%d' must be non-zero and positive", assoc);
   if ((assoc & (assoc-1)) != 0)
     fatal("cache associativity `%d' must be a power of two", assoc);
+  if (assoc > 65536)
+    fatal("cache associativity `%d' must be 65536 or less", assoc);
   if (!blk_access_fn)
     fatal("must specify miss/replacement functions");
-  if (prefetch_type < 0)
-    fatal("prefetcher type `%d'must be a positive number", prefetch_type);
 
   /* allocate the cache structure */
   cp = (struct cache_t *)
@@ -313,13 +607,11 @@ cache_create(char *name,		/* name of the cache */
   cp->assoc = assoc;
   cp->policy = policy;
   cp->hit_latency = hit_latency;
-  cp->prefetch_type = prefetch_type;
 
   /* miss/replacement functions */
   cp->blk_access_fn = blk_access_fn;
 
   /* compute derived parameters */
-  cp->hsize = CACHE_HIGHLY_ASSOC(cp) ? (assoc >> 2) : 0;
   cp->blk_mask = bsize-1;
   cp->set_shift = log_base2(bsize);
   cp->set_mask = nsets-1;
@@ -329,7 +621,6 @@ cache_create(char *name,		/* name of the cache */
   cp->bus_free = 0;
 
   /* print derived parameters during debug */
-  debug("%s: cp->hsize     = %d", cp->name, cp->hsize);
   debug("%s: cp->blk_mask  = 0x%08x", cp->name, cp->blk_mask);
   debug("%s: cp->set_shift = %d", cp->name, cp->set_shift);
   debug("%s: cp->set_mask  = 0x%08x", cp->name, cp->set_mask);
@@ -347,11 +638,73 @@ cache_create(char *name,		/* name of the cache */
   cp->read_misses = 0;
   cp->prefetch_hits = 0;
   cp->prefetch_misses = 0;
+  cp->pf_useful = 0;
+  cp->pf_late = 0;
+  cp->pf_useless = 0;
+  cp->pf_pollution = 0;
+  cp->mshr_merges = 0;
+  cp->mshr_full = 0;
+  cp->mshr_wait = 0;
+  cp->pfq_issued = 0;
+  cp->pfq_dropped = 0;
+  cp->sb_hits = 0;
+  cp->sb_allocs = 0;
+  cp->sb_fetches = 0;
+  cp->distant_fills = 0;
+  cp->miss_compulsory = 0;
+  cp->miss_capacity = 0;
+  cp->miss_conflict = 0;
+
+  /* one block one stride ahead, until cache_set_pf_distance() or
+     cache_set_fdp() says otherwise */
+  cp->pf_distance = 1;
+  cp->pf_degree = 1;
+  cp->fdp = NULL;
+
+  /* blocking until cache_set_mshrs() says otherwise */
+  cp->nmshrs = 0;
+  cp->mshrs = NULL;
+  cp->pfq_size = 0;
+  cp->pfq = NULL;
+  cp->pfq_pc = NULL;
+  cp->pfq_head = 0;
+  cp->pfq_num = 0;
+
+  /* no stream buffers until cache_set_sbufs() says otherwise */
+  cp->nsbufs = 0;
+  cp->sbuf_depth = 0;
+  cp->sbufs = NULL;
+
+  /* no stack distance analysis or 3C classification until cache_set_mrc()
+     or cache_set_3c() says otherwise */
+  cp->mrc = NULL;
+  cp->classify_3c = FALSE;
+  cp->fa_stack = NULL;
 
   /* blow away the last block accessed */
   cp->last_tagset = 0;
   cp->last_blk = NULL;
 
+  /* DRRIP leads with about RRIP_DUEL_SETS sets per policy, the selector
+     starts out favoring SRRIP; SHiP counters start out predicting reuse */
+  cp->psel = RRIP_PSEL_MAX/2;
+  cp->duel_mask = MAX(nsets / RRIP_DUEL_SETS, 2) - 1;
+  cp->bip_rand = 0x9e3779b9;
+  cp->shct = NULL;
+  if (policy == SHiP)
+    {
+      cp->shct = (byte_t *)malloc(SHIP_SHCT_SIZE);
+      if (!cp->shct)
+	fatal("out of virtual memory");
+      memset(cp->shct, 1, SHIP_SHCT_SIZE);
+    }
+
+  /* allocate the pollution filter, one bit per block frame */
+  cp->pf_filter_mask = nsets * assoc - 1;
+  cp->pf_filter = (word_t *)calloc((nsets * assoc + 31) / 32, sizeof(word_t));
+  if (!cp->pf_filter)
+    fatal("out of virtual memory");
+
   /* allocate data blocks */
   cp->data = (byte_t *)calloc(nsets * assoc,
 			      sizeof(struct cache_blk_t) +
@@ -359,28 +712,21 @@ cache_create(char *name,		/* name of the cache */
   if (!cp->data)
     fatal("out of virtual memory");
 
-  /* slice up the data blocks */
+  /* allocate the tag and age arrays, way by way within each set */
+  cp->tags = (md_addr_t *)calloc(nsets * assoc, sizeof(md_addr_t));
+  cp->ages = (half_t *)calloc(nsets * assoc, sizeof(half_t));
+  if (!cp->tags || !cp->ages)
+    fatal("out of virtual memory");
+
+  /* slice up the data blocks, tags and ages */
   for (bindex=0,i=0; i<nsets; i++)
     {
-
-      cp->sets[i].way_head = NULL;
-      cp->sets[i].way_tail = NULL;
-      /* get a hash table, if needed */
-      if (cp->hsize)
-	{
-	  cp->sets[i].hash =
-	    (struct cache_blk_t **)calloc(cp->hsize,
-					  sizeof(struct cache_blk_t *));
-	  if (!cp->sets[i].hash)
-	    fatal("out of virtual memory");
-	}
       /* NOTE: all the blocks in a set *must* be allocated contiguously,
-	 otherwise, block accesses through SET->BLKS will fail (used
-	 during random replacement selection) */
+	 otherwise, block accesses through SET->BLKS will fail */
       cp->sets[i].blks = CACHE_BINDEX(cp, cp->data, bindex);
-      
-      /* link the data blocks into ordered way chain and hash table bucket
-         chains, if hash table exists */
+      cp->sets[i].tags = &cp->tags[bindex];
+      cp->sets[i].ages = &cp->ages[bindex];
+
       for (j=0; j<assoc; j++)
 	{
 	  /* locate next cache block */
@@ -389,28 +735,66 @@ cache_create(char *name,		/* name of the cache */
 
 	  /* invalidate new cache block */
 	  blk->status = 0;		
-	  blk->tag = 0;
+	  blk->signature = 0;
 	  blk->ready = 0;
 	  blk->user_data = (usize != 0
 			    ? (byte_t *)calloc(usize, sizeof(byte_t)) : NULL);
-
-	  /* insert cache block into set hash table */
-	  if (cp->hsize)
-	    link_htab_ent(cp, &cp->sets[i], blk);
-
-	  /* insert into head of way list, order is arbitrary at this point */
-	  blk->way_next = cp->sets[i].way_head;
-	  blk->way_prev = NULL;
-	  if (cp->sets[i].way_head)
-	    cp->sets[i].way_head->way_prev = blk;
-	  cp->sets[i].way_head = blk;
-	  if (!cp->sets[i].way_tail)
-	    cp->sets[i].way_tail = blk;
+	  cp->sets[i].tags[j] = CACHE_TAG_INVALID;
+
+	  /* way 0 is the oldest, order is arbitrary at this point; RRIP
+	     predicts all ways distant, every PLRU node points left */
+	  if (policy == LRU || policy == FIFO || policy == Random)
+	    cp->sets[i].ages[j] = assoc - 1 - j;
+	  else if (policy == PLRU)
+	    cp->sets[i].ages[j] = 0;
+	  else
+	    cp->sets[i].ages[j] = RRIP_DISTANT;
 	}
     }
+
+  /* create this cache's own prefetcher instance */
+  select_prefetcher(cp, prefetch);
+
   return cp;
 }
 
+/* free cache CP, its blocks and its prefetcher state */
+void
+cache_free(struct cache_t *cp)		/* cache instance to free */
+{
+  int i;
+
+  if (cp->prefetcher && cp->prefetcher->destroy)
+    cp->prefetcher->destroy(cp->prefetch_state);
+  if (cp->mshrs)
+    free(cp->mshrs);
+  if (cp->pfq)
+    free(cp->pfq);
+  if (cp->pfq_pc)
+    free(cp->pfq_pc);
+  cache_set_sbufs(cp, 0, 0);
+  cache_set_mrc(cp, 0, 0);
+  cache_set_3c(cp, FALSE);
+
+  for (i=0; i<cp->nsets * cp->assoc; i++)
+    {
+      struct cache_blk_t *blk = CACHE_BINDEX(cp, cp->data, i);
+
+      if (blk->user_data)
+	free(blk->user_data);
+    }
+  if (cp->fdp)
+    free(cp->fdp);
+  if (cp->shct)
+    free(cp->shct);
+  free(cp->pf_filter);
+  free(cp->tags);
+  free(cp->ages);
+  free(cp->data);
+  free(cp->name);
+  free(cp);
+}
+
 /* parse policy */
 enum cache_policy			/* replacement policy enum */
 cache_char2policy(char c)		/* replacement policy as a char */
@@ -419,6 +803,11 @@ cache_char2policy(char c)		/* replacement policy as a char */
   case 'l': return LRU;
   case 'r': return Random;
   case 'f': return FIFO;
+  case 's': return SRRIP;
+  case 'b': return BRRIP;
+  case 'd': return DRRIP;
+  case 'h': return SHiP;
+  case 'p': return PLRU;
   default: fatal("bogus replacement policy, `%c'", c);
   }
 }
@@ -432,13 +821,35 @@ cache_config(struct cache_t *cp,	/* cache instance */
 	  "cache: %s: %d sets, %d byte blocks, %d bytes user data/block\n",
 	  cp->name, cp->nsets, cp->bsize, cp->usize);
   fprintf(stream,
-	  "cache: %s: %d-way, `%s' replacement policy, write-back, %d prefetcher type\n",
+	  "cache: %s: %d-way, `%s' replacement policy, write-back\n",
 	  cp->name, cp->assoc,
 	  cp->policy == LRU ? "LRU"
 	  : cp->policy == Random ? "Random"
 	  : cp->policy == FIFO ? "FIFO"
-	  : (abort(), ""),
-	  cp->prefetch_type);
+	  : cp->policy == SRRIP ? "SRRIP"
+	  : cp->policy == BRRIP ? "BRRIP"
+	  : cp->policy == DRRIP ? "DRRIP"
+	  : cp->policy == SHiP ? "SHiP"
+	  : cp->policy == PLRU ? "tree-PLRU"
+	  : (abort(), ""));
+  if (cp->prefetcher && cp->prefetch_arg)
+    fprintf(stream, "cache: %s: `%s:%d' prefetcher\n",
+	    cp->name, cp->prefetcher->name, cp->prefetch_arg);
+  else if (cp->prefetcher)
+    fprintf(stream, "cache: %s: `%s' prefetcher\n",
+	    cp->name, cp->prefetcher->name);
+  if (cp->prefetcher && !cp->fdp)
+    fprintf(stream,
+	    "cache: %s: prefetch distance %d, degree %d\n",
+	    cp->name, cp->pf_distance, cp->pf_degree);
+  if (cp->fdp)
+    fprintf(stream,
+	    "cache: %s: prefetch throttling every %d evictions\n",
+	    cp->name, cp->fdp->interval);
+  if (cp->nsbufs)
+    fprintf(stream,
+	    "cache: %s: %d stream buffers, %d blocks deep\n",
+	    cp->name, cp->nsbufs, cp->sbuf_depth);
 }
 
 /* register cache stats */
@@ -502,28 +913,136 @@ cache_reg_stats(struct cache_t *cp,	/* cache instance */
   sprintf(buf, "%s.prefetch_misses", name);
   stat_reg_counter(sdb, buf, "total number of prefetch misses", &cp->prefetch_misses, 0, NULL);
 
+  sprintf(buf, "%s.pf_useful", name);
+  stat_reg_counter(sdb, buf, "prefetched blocks used by a regular access",
+		   &cp->pf_useful, 0, NULL);
+  sprintf(buf, "%s.pf_late", name);
+  stat_reg_counter(sdb, buf, "useful prefetches used before their fill completed",
+		   &cp->pf_late, 0, NULL);
+  sprintf(buf, "%s.pf_useless", name);
+  stat_reg_counter(sdb, buf, "prefetched blocks evicted before any use",
+		   &cp->pf_useless, 0, NULL);
+  sprintf(buf, "%s.pf_pollution", name);
+  stat_reg_counter(sdb, buf, "regular misses to blocks evicted by a prefetch",
+		   &cp->pf_pollution, 0, NULL);
+  sprintf(buf, "%s.pf_accuracy", name);
+  sprintf(buf1, "%s.pf_useful / %s.prefetch_misses", name, name);
+  stat_reg_formula(sdb, buf, "prefetch accuracy (i.e., useful/prefetch fills)",
+		   buf1, NULL);
+  sprintf(buf, "%s.pf_lateness", name);
+  sprintf(buf1, "%s.pf_late / %s.pf_useful", name, name);
+  stat_reg_formula(sdb, buf, "fraction of useful prefetches that were late",
+		   buf1, NULL);
+  sprintf(buf, "%s.pf_coverage", name);
+  sprintf(buf1, "%s.pf_useful / (%s.pf_useful + %s.misses)", name, name, name);
+  stat_reg_formula(sdb, buf, "misses removed by prefetching (i.e., useful/(useful+misses))",
+		   buf1, NULL);
+
+  if (cp->fdp)
+    {
+      sprintf(buf, "%s.fdp_intervals", name);
+      stat_reg_counter(sdb, buf, "prefetch throttling intervals",
+		       &cp->fdp->intervals, 0, NULL);
+      sprintf(buf, "%s.fdp_ups", name);
+      stat_reg_counter(sdb, buf, "intervals that raised prefetch aggressiveness",
+		       &cp->fdp->ups, 0, NULL);
+      sprintf(buf, "%s.fdp_downs", name);
+      stat_reg_counter(sdb, buf, "intervals that lowered prefetch aggressiveness",
+		       &cp->fdp->downs, 0, NULL);
+      sprintf(buf, "%s.fdp_off", name);
+      stat_reg_counter(sdb, buf, "intervals with prefetching turned off",
+		       &cp->fdp->off_intervals, 0, NULL);
+      sprintf(buf, "%s.fdp_level", name);
+      stat_reg_int(sdb, buf, "final prefetch aggressiveness level",
+		   &cp->fdp->level, cp->fdp->level, NULL);
+    }
+
+  if (cp->nmshrs)
+    {
+      sprintf(buf, "%s.mshr_merges", name);
+      stat_reg_counter(sdb, buf, "accesses merged into an outstanding miss",
+		       &cp->mshr_merges, 0, NULL);
+      sprintf(buf, "%s.mshr_full", name);
+      stat_reg_counter(sdb, buf, "demand misses that waited for a free MSHR",
+		       &cp->mshr_full, 0, NULL);
+      sprintf(buf, "%s.mshr_wait", name);
+      stat_reg_counter(sdb, buf, "total cycles demand misses waited for an MSHR",
+		       &cp->mshr_wait, 0, NULL);
+    }
+  if (cp->pfq_size)
+    {
+      sprintf(buf, "%s.pfq_issued", name);
+      stat_reg_counter(sdb, buf, "queued prefetches issued",
+		       &cp->pfq_issued, 0, NULL);
+      sprintf(buf, "%s.pfq_dropped", name);
+      stat_reg_counter(sdb, buf, "prefetches dropped on a full queue",
+		       &cp->pfq_dropped, 0, NULL);
+    }
+  if (cp->nsbufs)
+    {
+      sprintf(buf, "%s.sb_hits", name);
+      stat_reg_counter(sdb, buf, "demand misses supplied by a stream buffer",
+		       &cp->sb_hits, 0, NULL);
+      sprintf(buf, "%s.sb_allocs", name);
+      stat_reg_counter(sdb, buf, "stream buffers allocated on a miss",
+		       &cp->sb_allocs, 0, NULL);
+      sprintf(buf, "%s.sb_fetches", name);
+      stat_reg_counter(sdb, buf, "blocks fetched into stream buffers",
+		       &cp->sb_fetches, 0, NULL);
+      sprintf(buf, "%s.sb_accuracy", name);
+      sprintf(buf1, "%s.sb_hits / %s.sb_fetches", name, name);
+      stat_reg_formula(sdb, buf, "stream buffer accuracy (i.e., hits/fetches)",
+		       buf1, NULL);
+    }
+  if (cp->policy == SRRIP || cp->policy == BRRIP
+      || cp->policy == DRRIP || cp->policy == SHiP)
+    {
+      sprintf(buf, "%s.distant_fills", name);
+      stat_reg_counter(sdb, buf, "fills predicted not to be re-referenced",
+		       &cp->distant_fills, 0, NULL);
+    }
+  if (cp->classify_3c)
+    {
+      sprintf(buf, "%s.miss_compulsory", name);
+      stat_reg_counter(sdb, buf, "misses to blocks never referenced before",
+		       &cp->miss_compulsory, 0, NULL);
+      sprintf(buf, "%s.miss_capacity", name);
+      stat_reg_counter(sdb, buf,
+		       "misses a fully associative LRU cache would take too",
+		       &cp->miss_capacity, 0, NULL);
+      sprintf(buf, "%s.miss_conflict", name);
+      stat_reg_counter(sdb, buf, "misses due to limited associativity",
+		       &cp->miss_conflict, 0, NULL);
+      sprintf(buf, "%s.compulsory_frac", name);
+      sprintf(buf1, "%s.miss_compulsory / %s.misses", name, name);
+      stat_reg_formula(sdb, buf, "fraction of misses that are compulsory",
+		       buf1, NULL);
+      sprintf(buf, "%s.capacity_frac", name);
+      sprintf(buf1, "%s.miss_capacity / %s.misses", name, name);
+      stat_reg_formula(sdb, buf, "fraction of misses that are capacity",
+		       buf1, NULL);
+      sprintf(buf, "%s.conflict_frac", name);
+      sprintf(buf1, "%s.miss_conflict / %s.misses", name, name);
+      stat_reg_formula(sdb, buf, "fraction of misses that are conflict",
+		       buf1, NULL);
+    }
+  if (cp->policy == DRRIP)
+    {
+      sprintf(buf, "%s.drrip_psel", name);
+      stat_reg_int(sdb, buf, "final DRRIP policy selector (BRRIP above half)",
+		   &cp->psel, cp->psel, NULL);
+    }
+
 
 }
 
 /* Next Line Prefetcher */
-void next_line_prefetcher(struct cache_t *cp, md_addr_t addr) {
+static void
+next_line_prefetcher(struct cache_t *cp, void *state, md_addr_t addr, tick_t now) {
 
   /* ECE552 Assignment 4 - BEGIN CODE */
-  //get the next line
-  int cache_line_size = cp->bsize;
-  md_addr_t next_line = addr + cache_line_size; 
-  //make sure it's aligned
-  //divide by cache_line_size
-  //multiply by cache_line_size
-  if (next_line % cache_line_size != 0){
-    next_line = next_line / cache_line_size;
-    next_line = next_line * cache_line_size;
-  }
-  //check if it's in the cache before trying to prefetch
-  int in_cache_already = cache_probe(cp, next_line);
-  if (!in_cache_already){
-    cache_access(cp, Read, next_line, NULL, cp->bsize, 0, NULL, NULL, 1); 
-  }
+  //prefetch the next line(s), as far and as many as the cache allows
+  cache_prefetch_stride(cp, addr, cp->bsize, now);
   /* ECE552 Assignment 4 - END CODE */
 }
 
@@ -544,33 +1063,35 @@ typedef struct oe_rpt_entry {
   State state_4;
 }oe_rpt_entry;
 
-int oe_initialized = 0;
-
-oe_rpt_entry *oe_rpt;
-
 #define OE_RPT_SIZE 7000
 
-/* Open Ended Prefetcher */
-void open_ended_prefetcher(struct cache_t *cp, md_addr_t addr) {
-	if (!oe_initialized){
-    oe_rpt = (oe_rpt_entry *)malloc(OE_RPT_SIZE * sizeof(oe_rpt_entry));
-    for (int i = 0; i < OE_RPT_SIZE; i++){
-      oe_rpt[i].tag = 0;
-      oe_rpt[i].prev_addr = 0;
-      oe_rpt[i].stride_1 = 0;
-      oe_rpt[i].stride_2 = 0;
-      oe_rpt[i].stride_3 = 0;
-      oe_rpt[i].stride_4 = 0;
-      oe_rpt[i].state_1 = Initial;
-      oe_rpt[i].state_2 = Initial;
-      oe_rpt[i].state_3 = Initial;
-      oe_rpt[i].state_4 = Initial;
-    }
-    oe_initialized = 1;
-
+/* allocate the RPT of one open ended prefetcher */
+static void *
+open_ended_create(struct cache_t *cp, int arg) {
+  oe_rpt_entry *oe_rpt = (oe_rpt_entry *)malloc(OE_RPT_SIZE * sizeof(oe_rpt_entry));
+  if (!oe_rpt)
+    fatal("out of virtual memory");
+  for (int i = 0; i < OE_RPT_SIZE; i++){
+    oe_rpt[i].tag = 0;
+    oe_rpt[i].prev_addr = 0;
+    oe_rpt[i].stride_1 = 0;
+    oe_rpt[i].stride_2 = 0;
+    oe_rpt[i].stride_3 = 0;
+    oe_rpt[i].stride_4 = 0;
+    oe_rpt[i].state_1 = Initial;
+    oe_rpt[i].state_2 = Initial;
+    oe_rpt[i].state_3 = Initial;
+    oe_rpt[i].state_4 = Initial;
   }
+  return oe_rpt;
+}
+
+/* Open Ended Prefetcher */
+static void
+open_ended_prefetcher(struct cache_t *cp, void *state, md_addr_t addr, tick_t now) {
+  oe_rpt_entry *oe_rpt = state;
 
-  md_addr_t pc = get_PC();
+  md_addr_t pc = access_PC();
   //discard lowest 3 bits because it's a 64-bit address
   int negative_oe_rpt_size = -1 * OE_RPT_SIZE;
   unsigned int mask = (~negative_oe_rpt_size) << 3;
@@ -742,19 +1263,8 @@ void open_ended_prefetcher(struct cache_t *cp, md_addr_t addr) {
       if (i == 0){
         if (oe_rpt[index].state_1 == Steady){
 
-          md_addr_t prefetch_addr = addr + oe_rpt[index].stride_1; 
-          //align it to the size of the cache block
-          if (prefetch_addr % cp->bsize != 0){
-            prefetch_addr = prefetch_addr / cp->bsize;
-            prefetch_addr = prefetch_addr * cp->bsize;
-          }
-
-        
-          //check that it's not already in the cache
-          int in_cache_already = cache_probe(cp, prefetch_addr);
-          if (!in_cache_already){
-            cache_access(cp, Read, prefetch_addr, NULL, cp->bsize, 0, NULL, NULL, 1); 
-          }
+          //prefetch along the stride, as far and as many as the cache allows
+          cache_prefetch_stride(cp, addr, oe_rpt[index].stride_1, now);
         }
 
         return;
@@ -763,19 +1273,8 @@ void open_ended_prefetcher(struct cache_t *cp, md_addr_t addr) {
       else if (i == 1) {
         if (oe_rpt[index].state_2 == Steady){
 
-          md_addr_t prefetch_addr = addr + oe_rpt[index].stride_2; 
-          //align it to the size of the cache block
-          if (prefetch_addr % cp->bsize != 0){
-            prefetch_addr = prefetch_addr / cp->bsize;
-            prefetch_addr = prefetch_addr * cp->bsize;
-          }
-
-        
-          //check that it's not already in the cache
-          int in_cache_already = cache_probe(cp, prefetch_addr);
-          if (!in_cache_already){
-            cache_access(cp, Read, prefetch_addr, NULL, cp->bsize, 0, NULL, NULL, 1); 
-          }
+          //prefetch along the stride, as far and as many as the cache allows
+          cache_prefetch_stride(cp, addr, oe_rpt[index].stride_2, now);
         }
 
         return;
@@ -784,19 +1283,8 @@ void open_ended_prefetcher(struct cache_t *cp, md_addr_t addr) {
       else if (i == 2){
         if (oe_rpt[index].state_3 == Steady){
 
-            md_addr_t prefetch_addr = addr + oe_rpt[index].stride_3; 
-            //align it to the size of the cache block
-            if (prefetch_addr % cp->bsize != 0){
-              prefetch_addr = prefetch_addr / cp->bsize;
-              prefetch_addr = prefetch_addr * cp->bsize;
-            }
-
-          
-            //check that it's not already in the cache
-            int in_cache_already = cache_probe(cp, prefetch_addr);
-            if (!in_cache_already){
-              cache_access(cp, Read, prefetch_addr, NULL, cp->bsize, 0, NULL, NULL, 1); 
-            }
+            //prefetch along the stride, as far and as many as the cache allows
+            cache_prefetch_stride(cp, addr, oe_rpt[index].stride_3, now);
           }
 
         return;
@@ -804,19 +1292,8 @@ void open_ended_prefetcher(struct cache_t *cp, md_addr_t addr) {
       else {
         if (oe_rpt[index].state_4 == Steady){
 
-            md_addr_t prefetch_addr = addr + oe_rpt[index].stride_4; 
-            //align it to the size of the cache block
-            if (prefetch_addr % cp->bsize != 0){
-              prefetch_addr = prefetch_addr / cp->bsize;
-              prefetch_addr = prefetch_addr * cp->bsize;
-            }
-
-          
-            //check that it's not already in the cache
-            int in_cache_already = cache_probe(cp, prefetch_addr);
-            if (!in_cache_already){
-              cache_access(cp, Read, prefetch_addr, NULL, cp->bsize, 0, NULL, NULL, 1); 
-            }
+            //prefetch along the stride, as far and as many as the cache allows
+            cache_prefetch_stride(cp, addr, oe_rpt[index].stride_4, now);
           }
 
         return;
@@ -840,30 +1317,48 @@ typedef struct rpt_entry {
   State state; 
 }rpt_entry;
 
-int initialized = 0;
+typedef struct rpt_table {
+  int size;
+  rpt_entry *entries;
+}rpt_table;
 
-rpt_entry *rpt;
+/* allocate the RPT of one stride prefetcher, ARG is its number of entries */
+static void *
+stride_create(struct cache_t *cp, int arg) {
+  if (arg < 1)
+    fatal("stride prefetcher of cache `%s' needs the RPT size, e.g., stride:%d",
+	  cp->name, 64);
 
-/* Stride Prefetcher */
-void stride_prefetcher(struct cache_t *cp, md_addr_t addr) {
+  rpt_table *table = (rpt_table *)malloc(sizeof(rpt_table));
+  if (!table)
+    fatal("out of virtual memory");
+  table->size = arg;
+  //initialize every rpt_entry in the rpt to be 0
+  table->entries = (rpt_entry *)calloc(arg, sizeof(rpt_entry));
+  if (!table->entries)
+    fatal("out of virtual memory");
+  for (int i = 0; i < arg; i++)
+    table->entries[i].state = Initial;
+  return table;
+}
 
-  if (!initialized){
-    //initialize the RPT, where the number of entries is the prefetch type
-    rpt = (rpt_entry *)malloc(cp->prefetch_type * sizeof(rpt_entry));
+static void
+stride_destroy(void *state) {
+  rpt_table *table = state;
 
-    //initialize every rpt_entry in the rpt to be 0
-    for (int i = 0; i < cp->prefetch_type; i++){
-      rpt[i].tag = 0;
-      rpt[i].prev_addr = 0;
-      rpt[i].stride = 0;
-      rpt[i].state = Initial;
-    }
-    initialized = 1;
-  }
+  free(table->entries);
+  free(table);
+}
+
+/* Stride Prefetcher */
+static void
+stride_prefetcher(struct cache_t *cp, void *state, md_addr_t addr, tick_t now) {
+  rpt_table *table = state;
+  rpt_entry *rpt = table->entries;
 
-  md_addr_t pc = get_PC();
+  md_addr_t pc = access_PC();
   //discard lowest 3 bits because it's a 64-bit address
-  int negative_rpt_size = -1 * cp->prefetch_type;
+  int negative_rpt_size = -1 * table->size;
   unsigned int mask = (~negative_rpt_size) << 3;
   md_addr_t index = (pc & mask) >> 3; 
 
@@ -917,19 +1412,8 @@ void stride_prefetcher(struct cache_t *cp, md_addr_t addr) {
     // only make a prediction if the rpt has a prediction
     if (rpt[index].state != NoPrediction){
 
-      md_addr_t prefetch_addr = addr + rpt[index].stride; 
-      //align it to the size of the cache block
-      if (prefetch_addr % cp->bsize != 0){
-        prefetch_addr = prefetch_addr / cp->bsize;
-        prefetch_addr = prefetch_addr * cp->bsize;
-      }
-
-    
-      //check that it's not already in the cache
-      int in_cache_already = cache_probe(cp, prefetch_addr);
-      if (!in_cache_already){
-        cache_access(cp, Read, prefetch_addr, NULL, cp->bsize, 0, NULL, NULL, 1); 
-      }
+      //prefetch along the stride, as far and as many as the cache allows
+      cache_prefetch_stride(cp, addr, rpt[index].stride, now);
     }
   }
 
@@ -937,171 +1421,1389 @@ void stride_prefetcher(struct cache_t *cp, md_addr_t addr) {
 /* ECE552 Assignment 4 - END CODE */
 
 
-/* cache x might generate a prefetch after a regular cache access to address addr */
-void generate_prefetch(struct cache_t *cp, md_addr_t addr) {
-
-	switch(cp->prefetch_type) {
-		case 0:
-		   // prefetching is not enabled;
-		   // do nothing
-		   break;
-		case 1:
-		   // Next Line Prefetcher
-		   next_line_prefetcher(cp, addr);
-		   break;
-		case 2:
-		   // Open Ended Prefetcher
-		   open_ended_prefetcher(cp, addr);
-		   break;
-		default:
-		   // Stride Prefetcher with cp->prefetch_type number of entries in the Reference Prediction Table (RPT)
-		   stride_prefetcher(cp, addr);
-	}
+/*
+ * GHB PC/DC prefetcher
+ */
 
-}
+/* Global History Buffer prefetcher with PC-localized delta correlation: a
+   FIFO of the blocks each PC moves to, the entries of a PC linked newest to
+   oldest through an index table; the PC's last two deltas are looked up in
+   its older deltas, and the deltas that followed them back then are
+   replayed from the current block, cycling through them for lookahead */
 
-/* print cache stats */
-void
-cache_stats(struct cache_t *cp,		/* cache instance */
-	    FILE *stream)		/* output stream */
+#define GHB_DEFAULT_SIZE	256	/* GHB entries without an argument */
+#define GHB_DEGREE		4	/* blocks per trigger at degree 1 */
+#define GHB_HISTORY		16	/* deltas of a PC searched for a match */
+
+/* one GHB entry */
+struct ghb_entry_t
 {
-  double sum = (double)(cp->hits + cp->misses);
+  md_addr_t blk;		/* block number moved to */
+  counter_t prev;		/* sequence number of the PC's previous entry,
+				   0 for none */
+};
 
-  fprintf(stream,
-	  "cache: %s: %.0f hits %.0f misses %.0f repls %.0f invalidations\n",
-	  cp->name, (double)cp->hits, (double)cp->misses,
-	  (double)cp->replacements, (double)cp->invalidations);
-  fprintf(stream,
-	  "cache: %s: miss rate=%f  repl rate=%f  invalidation rate=%f\n",
-	  cp->name,
-	  (double)cp->misses/sum, (double)(double)cp->replacements/sum,
-	  (double)cp->invalidations/sum);
-}
+/* one index table entry */
+struct ghb_index_t
+{
+  md_addr_t pc;			/* PC owning the entry */
+  counter_t last;		/* sequence number of its newest GHB entry */
+};
 
-/* access a cache, perform a CMD operation on cache CP at address ADDR,
-   places NBYTES of data at *P, returns latency of operation if initiated
-   at NOW, places pointer to block user data in *UDATA, *P is untouched if
-   cache blocks are not allocated (!CP->BALLOC), UDATA should be NULL if no
-   user data is attached to blocks */
-unsigned int				/* latency of access in cycles */
-cache_access(struct cache_t *cp,	/* cache to access */
-	     enum mem_cmd cmd,		/* access type, Read or Write */
-	     md_addr_t addr,		/* address of access */
-	     void *vp,			/* ptr to buffer for input/output */
-	     int nbytes,		/* number of bytes to access */
-	     tick_t now,		/* time of access */
-	     byte_t **udata,		/* for return of user data ptr */
-	     md_addr_t *repl_addr,	/* for address of replaced block */
-	     int prefetch)		/* 1 if the access is a prefetch, 0 if it is not */
+/* GHB prefetcher state */
+struct ghb_t
 {
-  byte_t *p = vp;
-  md_addr_t tag = CACHE_TAG(cp, addr);
-  md_addr_t set = CACHE_SET(cp, addr);
-  md_addr_t bofs = CACHE_BLK(cp, addr);
-  struct cache_blk_t *blk, *repl;
-  int lat = 0;
+  int size;			/* GHB and index table entries */
+  counter_t head;		/* sequence number of the newest entry */
+  struct ghb_entry_t *ghb;	/* circular buffer, by sequence number */
+  struct ghb_index_t *index;	/* index table, by PC */
+};
+
+/* GHB entry with sequence number SEQ, SEQ is valid if not overwritten */
+#define GHB_ENTRY(g, seq)	(&(g)->ghb[(seq) % (g)->size])
+#define GHB_VALID(g, seq)						\
+  ((seq) != 0 && (seq) + (g)->size > (g)->head)
+
+/* allocate a GHB prefetcher, ARG is the number of GHB entries */
+static void *
+ghb_create(struct cache_t *cp, int arg)
+{
+  struct ghb_t *g;
+  int size = arg ? arg : GHB_DEFAULT_SIZE;
 
-  /* default replacement address */
-  if (repl_addr)
-    *repl_addr = 0;
+  if (size < 2 || (size & (size-1)) != 0)
+    fatal("GHB size `%d' of cache `%s' must be a power of two", size, cp->name);
 
-  /* check alignments */
-  if ((nbytes & (nbytes-1)) != 0 || (addr & (nbytes-1)) != 0)
-    fatal("cache: access error: bad size or alignment, addr 0x%08x", addr);
+  g = (struct ghb_t *)calloc(1, sizeof(struct ghb_t));
+  if (!g)
+    fatal("out of virtual memory");
+  g->size = size;
+  g->head = 0;
+  g->ghb = (struct ghb_entry_t *)calloc(size, sizeof(struct ghb_entry_t));
+  g->index = (struct ghb_index_t *)calloc(size, sizeof(struct ghb_index_t));
+  if (!g->ghb || !g->index)
+    fatal("out of virtual memory");
+  return g;
+}
 
-  /* access must fit in cache block */
-  /* FIXME:
-     ((addr + (nbytes - 1)) > ((addr & ~cp->blk_mask) + (cp->bsize - 1))) */
-  if ((addr + nbytes) > ((addr & ~cp->blk_mask) + cp->bsize))
-    fatal("cache: access error: access spans block, addr 0x%08x", addr);
+static void
+ghb_destroy(void *state)
+{
+  struct ghb_t *g = state;
 
-  /* permissions are checked on cache misses */
+  free(g->ghb);
+  free(g->index);
+  free(g);
+}
 
-  /* check for a fast hit: access to same block */
-  if (CACHE_TAGSET(cp, addr) == cp->last_tagset)
+/* GHB PC/DC Prefetcher */
+static void
+ghb_prefetcher(struct cache_t *cp, void *state, md_addr_t addr, tick_t now)
+{
+  struct ghb_t *g = state;
+  md_addr_t pc = access_PC();
+  md_addr_t blk = addr >> cp->set_shift, prev_blk, target;
+  struct ghb_index_t *it = &g->index[(pc >> 3) & (g->size - 1)];
+  counter_t seq, last;
+  int delta[GHB_HISTORY], n, i, j, k, count;
+
+  /* the PC's newest entry, if it is still in the GHB */
+  last = (it->pc == pc && GHB_VALID(g, it->last)) ? it->last : 0;
+
+  /* only moves to another block are history */
+  if (last && GHB_ENTRY(g, last)->blk == blk)
+    return;
+
+  g->head++;
+  GHB_ENTRY(g, g->head)->blk = blk;
+  GHB_ENTRY(g, g->head)->prev = last;
+  it->pc = pc;
+  it->last = g->head;
+
+  /* the PC's deltas, newest first */
+  n = 0;
+  prev_blk = blk;
+  for (seq=last; GHB_VALID(g, seq) && n < GHB_HISTORY;
+       seq=GHB_ENTRY(g, seq)->prev)
     {
-      /* hit in the same block */
-      blk = cp->last_blk;
-      goto cache_fast_hit;
+      delta[n++] = (int)(prev_blk - GHB_ENTRY(g, seq)->blk);
+      prev_blk = GHB_ENTRY(g, seq)->blk;
     }
-    
-  if (cp->hsize)
-    {
-      /* higly-associativity cache, access through the per-set hash tables */
-      int hindex = CACHE_HASH(cp, tag);
 
-      for (blk=cp->sets[set].hash[hindex];
-	   blk;
-	   blk=blk->hash_next)
-	{
-	  if (blk->tag == tag && (blk->status & CACHE_BLK_VALID))
-	    goto cache_hit;
-	}
+  /* find the newest earlier occurrence of the last two deltas */
+  for (j=1; j+1 < n; j++)
+    {
+      if (delta[j] == delta[0] && delta[j+1] == delta[1])
+	break;
     }
-  else
+  if (j+1 >= n)
+    return;
+
+  /* replay the deltas that followed it, delta[j-1] down to delta[0] and
+     around again, skipping the blocks closer than the prefetch distance */
+  count = GHB_DEGREE * cp->pf_degree;
+  target = blk;
+  for (i=0, k=j-1; count > 0; i++)
     {
-      /* low-associativity cache, linear search the way list */
-      for (blk=cp->sets[set].way_head;
-	   blk;
-	   blk=blk->way_next)
+      target += delta[k];
+      if (i >= cp->pf_distance - 1)
 	{
-	  if (blk->tag == tag && (blk->status & CACHE_BLK_VALID))
-	    goto cache_hit;
+	  cache_prefetch(cp, target << cp->set_shift, now);
+	  count--;
 	}
+      k = k ? k - 1 : j - 1;
     }
+}
 
-  /* cache block not found */
 
-  /* **MISS** */
-  if (prefetch == 0 ) {
+/*
+ * Best-Offset prefetcher
+ */
+
+/* Best-Offset prefetcher: learns the single offset (in blocks) that would
+   have covered the most recent accesses and prefetches with it; a learning
+   phase tests one candidate offset D per access to a new block X, scoring
+   it if X - D is in the recent requests (RR) table, and ends after
+   BO_ROUND_MAX rounds over all offsets or once an offset reaches
+   BO_SCORE_MAX; the prefetcher sees accesses, not fills, so the RR table
+   holds the recently accessed blocks */
+
+#define BO_DEFAULT_RR		256	/* RR entries without an argument */
+#define BO_SCORE_MAX		31	/* score that ends a phase early */
+#define BO_ROUND_MAX		100	/* rounds per learning phase */
+#define BO_BAD_SCORE		1	/* best score that turns prefetching off */
+
+/* candidate offsets, products of 2, 3 and 5 up to 64 blocks */
+static int bo_offsets[] = {
+  1, 2, 3, 4, 5, 6, 8, 9, 10, 12, 15, 16, 18, 20, 24, 25, 27, 30, 32,
+  36, 40, 45, 48, 50, 54, 60, 64
+};
+#define BO_NOFFSETS	((int)(sizeof(bo_offsets) / sizeof(bo_offsets[0])))
+
+/* Best-Offset prefetcher state */
+struct bo_t
+{
+  int rr_size;			/* RR entries */
+  md_addr_t *rr;		/* RR table, block numbers hashed by block */
+  int scores[BO_NOFFSETS];	/* scores of this phase */
+  int test;			/* offset tested next */
+  int round;			/* rounds done in this phase */
+  int best;			/* offset prefetched with, 0 for none */
+  md_addr_t last_blk;		/* block of the previous access */
+};
+
+/* RR table entry of block number BLK */
+#define BO_RR(bo, blk)							\
+  (&(bo)->rr[((blk) ^ ((blk) >> 8)) & ((bo)->rr_size - 1)])
+
+/* allocate a Best-Offset prefetcher, ARG is the number of RR entries */
+static void *
+bo_create(struct cache_t *cp, int arg)
+{
+  struct bo_t *bo;
+  int size = arg ? arg : BO_DEFAULT_RR;
+
+  if (size < 2 || (size & (size-1)) != 0)
+    fatal("RR table size `%d' of cache `%s' must be a power of two",
+	  size, cp->name);
+
+  bo = (struct bo_t *)calloc(1, sizeof(struct bo_t));
+  if (!bo)
+    fatal("out of virtual memory");
+  bo->rr_size = size;
+  bo->rr = (md_addr_t *)calloc(size, sizeof(md_addr_t));
+  if (!bo->rr)
+    fatal("out of virtual memory");
+
+  /* next line until the first phase is over */
+  bo->best = 1;
+  return bo;
+}
+
+static void
+bo_destroy(void *state)
+{
+  struct bo_t *bo = state;
+
+  free(bo->rr);
+  free(bo);
+}
+
+/* end a learning phase, prefetch with the best scoring offset from now on */
+static void
+bo_end_phase(struct bo_t *bo)
+{
+  int i, best = 0;
+
+  for (i=1; i < BO_NOFFSETS; i++)
+    {
+      if (bo->scores[i] > bo->scores[best])
+	best = i;
+    }
+  bo->best = bo->scores[best] > BO_BAD_SCORE ? bo_offsets[best] : 0;
+
+  memset(bo->scores, 0, sizeof(bo->scores));
+  bo->test = 0;
+  bo->round = 0;
+}
+
+/* Best-Offset Prefetcher */
+static void
+bo_prefetcher(struct cache_t *cp, void *state, md_addr_t addr, tick_t now)
+{
+  struct bo_t *bo = state;
+  md_addr_t blk = addr >> cp->set_shift;
+  int d;
+
+  /* only moves to another block train and trigger */
+  if (blk == bo->last_blk)
+    return;
+  bo->last_blk = blk;
+
+  /* would the offset under test have prefetched this block? */
+  d = bo_offsets[bo->test];
+  if (blk > (md_addr_t)d && *BO_RR(bo, blk - d) == blk - d)
+    bo->scores[bo->test]++;
+
+  if (bo->scores[bo->test] >= BO_SCORE_MAX)
+    bo_end_phase(bo);
+  else if (++bo->test == BO_NOFFSETS)
+    {
+      bo->test = 0;
+      if (++bo->round >= BO_ROUND_MAX)
+	bo_end_phase(bo);
+    }
+
+  *BO_RR(bo, blk) = blk;
+
+  if (bo->best)
+    cache_prefetch_stride(cp, addr, bo->best * cp->bsize, now);
+}
+
+
+/*
+ * Spatial Memory Streaming prefetcher
+ */
+
+/* Spatial Memory Streaming (SMS): records which blocks of a SMS_REGION
+   byte region are touched during a generation, from the trigger access
+   (the first access to the region) until the region's accumulation table
+   (AGT) entry is replaced; the footprint is stored in the pattern history
+   table (PHT) under the PC and region offset of the trigger, and the next
+   trigger by the same PC at the same offset prefetches the whole
+   footprint at once; the prefetcher does not see evictions, so AGT
+   replacement alone ends a generation */
+
+#define SMS_REGION		2048	/* region size in bytes */
+#define SMS_AGT_SIZE		32	/* regions accumulated at once */
+#define SMS_DEFAULT_PHT		1024	/* PHT entries without an argument */
+
+/* one accumulation table entry, a region in its generation */
+struct sms_agt_t
+{
+  md_addr_t region;		/* region number, 0 for a free entry */
+  md_addr_t pc;			/* PC of the trigger access */
+  int offset;			/* block offset of the trigger access */
+  qword_t pattern;		/* blocks touched so far, bit per block */
+  counter_t last_use;		/* access sequence number, for LRU */
+};
+
+/* one pattern history table entry */
+struct sms_pht_t
+{
+  md_addr_t pc;			/* trigger PC */
+  int offset;			/* trigger block offset */
+  qword_t pattern;		/* footprint, 0 for a free entry */
+};
+
+/* SMS prefetcher state */
+struct sms_t
+{
+  int region_blks;		/* blocks per region, at most 64 */
+  int region_shift;		/* log2 of the region size in bytes */
+  struct sms_agt_t agt[SMS_AGT_SIZE];	/* accumulation table */
+  int pht_size;			/* PHT entries */
+  struct sms_pht_t *pht;	/* pattern history table, by PC and offset */
+  counter_t seq;		/* accesses seen */
+};
+
+/* PHT entry of trigger PC and block offset OFS */
+#define SMS_PHT(sms, pc, ofs)						\
+  (&(sms)->pht[(((pc) >> 3) ^ ((md_addr_t)(ofs) << 5)) & ((sms)->pht_size - 1)])
+
+/* allocate an SMS prefetcher, ARG is the number of PHT entries */
+static void *
+sms_create(struct cache_t *cp, int arg)
+{
+  struct sms_t *sms;
+  int size = arg ? arg : SMS_DEFAULT_PHT;
+
+  if (size < 2 || (size & (size-1)) != 0)
+    fatal("PHT size `%d' of cache `%s' must be a power of two",
+	  size, cp->name);
+
+  sms = (struct sms_t *)calloc(1, sizeof(struct sms_t));
+  if (!sms)
+    fatal("out of virtual memory");
+
+  /* regions of SMS_REGION bytes, or 64 blocks if these are fewer */
+  sms->region_blks = MAX(1, MIN(64, SMS_REGION / cp->bsize));
+  sms->region_shift = cp->set_shift + log_base2(sms->region_blks);
+
+  sms->pht_size = size;
+  sms->pht = (struct sms_pht_t *)calloc(size, sizeof(struct sms_pht_t));
+  if (!sms->pht)
+    fatal("out of virtual memory");
+  return sms;
+}
+
+static void
+sms_destroy(void *state)
+{
+  struct sms_t *sms = state;
+
+  free(sms->pht);
+  free(sms);
+}
+
+/* end the generation of AGT entry AGT, a footprint of more than the
+   trigger block is remembered */
+static void
+sms_commit(struct sms_t *sms, struct sms_agt_t *agt)
+{
+  struct sms_pht_t *pht;
+
+  if (agt->region && (agt->pattern & (agt->pattern - 1)) != 0)
+    {
+      pht = SMS_PHT(sms, agt->pc, agt->offset);
+      pht->pc = agt->pc;
+      pht->offset = agt->offset;
+      pht->pattern = agt->pattern;
+    }
+  agt->region = 0;
+}
+
+/* SMS Prefetcher */
+static void
+sms_prefetcher(struct cache_t *cp, void *state, md_addr_t addr, tick_t now)
+{
+  struct sms_t *sms = state;
+  md_addr_t region = addr >> sms->region_shift;
+  md_addr_t pc = access_PC();
+  int offset = (addr >> cp->set_shift) & (sms->region_blks - 1);
+  struct sms_agt_t *agt, *lru;
+  struct sms_pht_t *pht;
+  md_addr_t blocks[64];
+  int i, n;
+
+  sms->seq++;
+
+  /* a region in its generation accumulates the block */
+  lru = &sms->agt[0];
+  for (i=0; i<SMS_AGT_SIZE; i++)
+    {
+      agt = &sms->agt[i];
+      if (agt->region == region)
+	{
+	  agt->pattern |= (qword_t)1 << offset;
+	  agt->last_use = sms->seq;
+	  return;
+	}
+      if (agt->last_use < lru->last_use)
+	lru = agt;
+    }
+
+  /* a trigger access, start a generation in the least recently used entry */
+  agt = lru;
+  sms_commit(sms, agt);
+  agt->region = region;
+  agt->pc = pc;
+  agt->offset = offset;
+  agt->pattern = (qword_t)1 << offset;
+  agt->last_use = sms->seq;
+
+  /* stream the footprint recorded for this trigger, unless throttled off */
+  pht = SMS_PHT(sms, pc, offset);
+  if (!cp->pf_degree || !pht->pattern
+      || pht->pc != pc || pht->offset != offset)
+    return;
+
+  for (i=0, n=0; i<sms->region_blks; i++)
+    {
+      if (i != offset && (pht->pattern & ((qword_t)1 << i)))
+	blocks[n++] = (region << sms->region_shift)
+	  + ((md_addr_t)i << cp->set_shift);
+    }
+  cache_prefetch_blocks(cp, blocks, n, now);
+}
+
+
+/* built-in prefetchers, selected by name at cache_create() */
+static struct cache_prefetcher_t next_line_pf =
+  { "nextline", NULL, next_line_prefetcher, NULL, NULL };
+static struct cache_prefetcher_t open_ended_pf =
+  { "openended", open_ended_create, open_ended_prefetcher, free, &next_line_pf };
+static struct cache_prefetcher_t stride_pf =
+  { "stride", stride_create, stride_prefetcher, stride_destroy, &open_ended_pf };
+static struct cache_prefetcher_t ghb_pf =
+  { "ghb", ghb_create, ghb_prefetcher, ghb_destroy, &stride_pf };
+static struct cache_prefetcher_t bo_pf =
+  { "bo", bo_create, bo_prefetcher, bo_destroy, &ghb_pf };
+static struct cache_prefetcher_t sms_pf =
+  { "sms", sms_create, sms_prefetcher, sms_destroy, &bo_pf };
+
+/* registered prefetchers, most recently registered first */
+static struct cache_prefetcher_t *prefetchers = &sms_pf;
+
+/* register prefetcher PF, making it selectable by name at cache_create() */
+void
+cache_reg_prefetcher(struct cache_prefetcher_t *pf)	/* prefetcher to add */
+{
+  if (!pf->name || !pf->access)
+    panic("prefetcher needs a name and an access function");
+  if (cache_find_prefetcher(pf->name))
+    fatal("prefetcher `%s' is already registered", pf->name);
+
+  pf->next = prefetchers;
+  prefetchers = pf;
+}
+
+/* find the prefetcher registered as NAME, returns NULL if there is none */
+struct cache_prefetcher_t *		/* prefetcher, or NULL */
+cache_find_prefetcher(char *name)	/* prefetcher name */
+{
+  struct cache_prefetcher_t *pf;
+
+  for (pf=prefetchers; pf; pf=pf->next)
+    {
+      if (!mystricmp(pf->name, name))
+	return pf;
+    }
+  return NULL;
+}
+
+/* print the names of all registered prefetchers */
+void
+cache_print_prefetchers(FILE *stream)	/* output stream */
+{
+  struct cache_prefetcher_t *pf;
+
+  fprintf(stream, "none");
+  for (pf=prefetchers; pf; pf=pf->next)
+    fprintf(stream, "|%s", pf->name);
+}
+
+/* cache x might generate a prefetch after a regular cache access to address addr */
+void generate_prefetch(struct cache_t *cp, md_addr_t addr, tick_t now) {
+
+  if (cp->prefetcher)
+    cp->prefetcher->access(cp, cp->prefetch_state, addr, now);
+
+  /* the regular access went first, prefetches use what is left */
+  if (cp->pfq_num)
+    cache_issue_prefetches(cp, now);
+}
+
+/* find the MSHR filling block BADDR at time NOW, NULL if there is none */
+static struct cache_mshr_t *
+mshr_lookup(struct cache_t *cp,		/* cache instance */
+	    md_addr_t baddr,		/* block address */
+	    tick_t now)			/* current time */
+{
+  int i;
+
+  for (i=0; i<cp->nmshrs; i++)
+    {
+      if (cp->mshrs[i].baddr == baddr && cp->mshrs[i].ready > now)
+	return &cp->mshrs[i];
+    }
+  return NULL;
+}
+
+/* the MSHR that is free first, it is free now if its ready time has passed */
+static struct cache_mshr_t *
+mshr_first_free(struct cache_t *cp)	/* cache instance */
+{
+  struct cache_mshr_t *mshr = &cp->mshrs[0];
+  int i;
+
+  for (i=1; i<cp->nmshrs; i++)
+    {
+      if (cp->mshrs[i].ready < mshr->ready)
+	mshr = &cp->mshrs[i];
+    }
+  return mshr;
+}
+
+/* make cache CP non-blocking with NMSHRS MSHRs and a PFQ_SIZE-entry
+   prefetch queue */
+void
+cache_set_mshrs(struct cache_t *cp,	/* cache instance */
+		int nmshrs,		/* number of MSHRs, 0 for unlimited */
+		int pfq_size)		/* prefetch queue entries */
+{
+  if (nmshrs < 0)
+    fatal("number of MSHRs of cache `%s' must not be negative", cp->name);
+  if (pfq_size < 0)
+    fatal("prefetch queue size of cache `%s' must not be negative", cp->name);
+
+  if (cp->mshrs)
+    free(cp->mshrs);
+  if (cp->pfq)
+    free(cp->pfq);
+  if (cp->pfq_pc)
+    free(cp->pfq_pc);
+  cp->mshrs = NULL;
+  cp->pfq = NULL;
+  cp->pfq_pc = NULL;
+
+  cp->nmshrs = nmshrs;
+  if (nmshrs)
+    {
+      cp->mshrs = (struct cache_mshr_t *)
+	calloc(nmshrs, sizeof(struct cache_mshr_t));
+      if (!cp->mshrs)
+	fatal("out of virtual memory");
+    }
+
+  cp->pfq_size = pfq_size;
+  cp->pfq_head = 0;
+  cp->pfq_num = 0;
+  if (pfq_size)
+    {
+      cp->pfq = (md_addr_t *)calloc(pfq_size, sizeof(md_addr_t));
+      cp->pfq_pc = (md_addr_t *)calloc(pfq_size, sizeof(md_addr_t));
+      if (!cp->pfq || !cp->pfq_pc)
+	fatal("out of virtual memory");
+    }
+}
+
+/* fetch blocks down the stream into stream buffer SB of cache CP at NOW
+   until it is full, one block per bus cycle */
+static void
+sbuf_fill(struct cache_t *cp,		/* cache instance */
+	  struct cache_sbuf_t *sb,	/* stream buffer */
+	  tick_t now)			/* current time */
+{
+  tick_t when;
+  int i;
+
+  while (sb->num < cp->sbuf_depth)
+    {
+      i = (sb->head + sb->num) % cp->sbuf_depth;
+      when = MAX(cp->bus_free, now);
+      cp->bus_free = when + 1;
+
+      sb->baddr[i] = sb->next;
+      sb->ready[i] = when + cp->blk_access_fn(Read, sb->next, cp->bsize,
+					      NULL, when, 1);
+      sb->next += cp->bsize;
+      sb->num++;
+      cp->sb_fetches++;
+    }
+}
+
+/* look block BADDR up in the stream buffers of cache CP at NOW, if a
+   buffer holds it, drop it and the blocks before it, top the buffer up
+   and return the time the block arrives in *READY */
+static int				/* non-zero if a buffer holds BADDR */
+sbuf_lookup(struct cache_t *cp,		/* cache instance */
+	    md_addr_t baddr,		/* block address */
+	    tick_t now,			/* current time */
+	    tick_t *ready)		/* for return of the arrival time */
+{
+  struct cache_sbuf_t *sb;
+  int i, j, k;
+
+  for (i=0; i<cp->nsbufs; i++)
+    {
+      sb = &cp->sbufs[i];
+      for (j=0; j<sb->num; j++)
+	{
+	  k = (sb->head + j) % cp->sbuf_depth;
+	  if (sb->baddr[k] != baddr)
+	    continue;
+
+	  *ready = sb->ready[k];
+	  sb->head = (k + 1) % cp->sbuf_depth;
+	  sb->num -= j + 1;
+	  sb->last_use = now;
+	  cp->sb_hits++;
+	  sbuf_fill(cp, sb, now);
+	  return TRUE;
+	}
+    }
+  return FALSE;
+}
+
+/* start the least recently used stream buffer of cache CP after the block
+   BADDR that missed at NOW */
+static void
+sbuf_allocate(struct cache_t *cp,	/* cache instance */
+	      md_addr_t baddr,		/* block address that missed */
+	      tick_t now)		/* current time */
+{
+  struct cache_sbuf_t *sb = &cp->sbufs[0];
+  int i;
+
+  for (i=1; i<cp->nsbufs; i++)
+    {
+      if (cp->sbufs[i].last_use < sb->last_use)
+	sb = &cp->sbufs[i];
+    }
+
+  sb->head = 0;
+  sb->num = 0;
+  sb->next = baddr + cp->bsize;
+  sb->last_use = now;
+  cp->sb_allocs++;
+  sbuf_fill(cp, sb, now);
+}
+
+/* give cache CP NSBUFS stream buffers of DEPTH blocks each */
+void
+cache_set_sbufs(struct cache_t *cp,	/* cache instance */
+		int nsbufs,		/* number of stream buffers, 0 for none */
+		int depth)		/* blocks per stream buffer */
+{
+  int i;
+
+  if (nsbufs < 0)
+    fatal("number of stream buffers of cache `%s' must not be negative",
+	  cp->name);
+  if (nsbufs && depth < 1)
+    fatal("stream buffer depth of cache `%s' must be positive", cp->name);
+  if (nsbufs && cp->balloc)
+    fatal("stream buffers need a cache without block data, `%s' has it",
+	  cp->name);
+
+  for (i=0; i<cp->nsbufs; i++)
+    {
+      free(cp->sbufs[i].baddr);
+      free(cp->sbufs[i].ready);
+    }
+  if (cp->sbufs)
+    free(cp->sbufs);
+  cp->sbufs = NULL;
+
+  cp->nsbufs = nsbufs;
+  cp->sbuf_depth = depth;
+  if (!nsbufs)
+    return;
+
+  cp->sbufs = (struct cache_sbuf_t *)
+    calloc(nsbufs, sizeof(struct cache_sbuf_t));
+  if (!cp->sbufs)
+    fatal("out of virtual memory");
+  for (i=0; i<nsbufs; i++)
+    {
+      cp->sbufs[i].baddr = (md_addr_t *)calloc(depth, sizeof(md_addr_t));
+      cp->sbufs[i].ready = (tick_t *)calloc(depth, sizeof(tick_t));
+      if (!cp->sbufs[i].baddr || !cp->sbufs[i].ready)
+	fatal("out of virtual memory");
+    }
+}
+
+/* hash table index of block BADDR in the fully associative stack FA */
+#define FA_HASH(fa, baddr)						\
+  ((((baddr) >> (fa)->blk_shift) * 2654435761u) & ((fa)->hsize - 1))
+
+/* find the entry of block BADDR in the fully associative stack FA, or the
+   empty entry where it goes */
+static int				/* hash table index */
+fa_find(struct cache_fa_stack_t *fa,	/* fully associative stack */
+	md_addr_t baddr)		/* block address */
+{
+  int i;
+
+  for (i = FA_HASH(fa, baddr);
+       fa->htab[i].time && fa->htab[i].baddr != baddr;
+       i = (i + 1) & (fa->hsize - 1))
+    /* nada */;
+  return i;
+}
+
+/* double the hash table of FA, the times point at the new entries */
+static void
+fa_grow_htab(struct cache_fa_stack_t *fa)	/* fully associative stack */
+{
+  struct cache_fa_ent_t *old = fa->htab;
+  int i, j, old_size = fa->hsize;
+
+  fa->hsize = old_size ? 2 * old_size : 1024;
+  fa->htab = (struct cache_fa_ent_t *)
+    calloc(fa->hsize, sizeof(struct cache_fa_ent_t));
+  if (!fa->htab)
+    fatal("out of virtual memory");
+
+  for (i=0; i<old_size; i++)
+    {
+      if (!old[i].time)
+	continue;
+      j = fa_find(fa, old[i].baddr);
+      fa->htab[j] = old[i];
+      fa->slot[old[i].time] = j;
+    }
+  if (old)
+    free(old);
+}
+
+/* renumber the last references of the fully associative stack FA as times
+   1..HUSED, in order, growing the time range if that leaves less than half
+   of it free, and rebuild the tree */
+static void
+fa_renumber(struct cache_fa_stack_t *fa)	/* fully associative stack */
+{
+  int t, n = 0, j;
+
+  for (t=1; t<=fa->now; t++)
+    {
+      if (fa->slot[t] < 0)
+	continue;
+      n++;
+      fa->slot[n] = fa->slot[t];
+      fa->htab[fa->slot[n]].time = n;
+    }
+
+  if (2 * n > fa->tsize)
+    {
+      fa->tsize *= 2;
+      fa->slot = (int *)realloc(fa->slot, (fa->tsize + 1) * sizeof(int));
+      free(fa->tree);
+      fa->tree = (int *)malloc((fa->tsize + 1) * sizeof(int));
+      if (!fa->slot || !fa->tree)
+	fatal("out of virtual memory");
+    }
+
+  /* one mark per block, built bottom up */
+  for (t=1; t<=fa->tsize; t++)
+    fa->tree[t] = (t <= n);
+  for (t=1; t<=fa->tsize; t++)
+    {
+      j = t + (t & -t);
+      if (j <= fa->tsize)
+	fa->tree[j] += fa->tree[t];
+    }
+  fa->now = n;
+}
+
+/* record a reference to block BADDR in the fully associative stack FA,
+   returns its stack distance, the number of other blocks referenced since
+   its last reference, or -1 for a first reference */
+static int				/* stack distance */
+fa_access(struct cache_fa_stack_t *fa,	/* fully associative stack */
+	  md_addr_t baddr)		/* block referenced */
+{
+  int i, t, d = -1;
+
+  if (2 * (fa->hused + 1) > fa->hsize)
+    fa_grow_htab(fa);
+
+  i = fa_find(fa, baddr);
+  if (fa->htab[i].time)
+    {
+      /* the blocks referenced since are the marks after its last time */
+      d = fa->hused;
+      for (t = fa->htab[i].time; t > 0; t -= t & -t)
+	d -= fa->tree[t];
+
+      for (t = fa->htab[i].time; t <= fa->tsize; t += t & -t)
+	fa->tree[t]--;
+      fa->slot[fa->htab[i].time] = -1;
+    }
+  else
+    {
+      fa->hused++;
+      fa->htab[i].baddr = baddr;
+    }
+
+  /* the block takes a new time, after the others are renumbered if there
+     is none left */
+  if (fa->now == fa->tsize)
+    fa_renumber(fa);
+  fa->now++;
+  fa->htab[i].time = fa->now;
+  fa->slot[fa->now] = i;
+  for (t = fa->now; t <= fa->tsize; t += t & -t)
+    fa->tree[t]++;
+
+  return d;
+}
+
+/* give cache CP a fully associative stack if its stack distance analysis or
+   its 3C classification needs one, free it otherwise */
+static void
+fa_update(struct cache_t *cp)		/* cache instance */
+{
+  struct cache_fa_stack_t *fa = cp->fa_stack;
+
+  if (cp->mrc || cp->classify_3c)
+    {
+      if (fa)
+	return;
+
+      /* the hash table is allocated by the first reference */
+      fa = (struct cache_fa_stack_t *)
+	calloc(1, sizeof(struct cache_fa_stack_t));
+      if (!fa)
+	fatal("out of virtual memory");
+      fa->blk_shift = cp->set_shift;
+      fa->htab = NULL;
+      fa->hsize = 0;
+      fa->hused = 0;
+      fa->tsize = 65536;
+      fa->now = 0;
+      fa->slot = (int *)calloc(fa->tsize + 1, sizeof(int));
+      fa->tree = (int *)calloc(fa->tsize + 1, sizeof(int));
+      if (!fa->slot || !fa->tree)
+	fatal("out of virtual memory");
+      cp->fa_stack = fa;
+    }
+  else if (fa)
+    {
+      if (fa->htab)
+	free(fa->htab);
+      free(fa->slot);
+      free(fa->tree);
+      free(fa);
+      cp->fa_stack = NULL;
+    }
+}
+
+/* record a reference to block BADDR at fully associative stack distance
+   DIST (-1 for a first reference) in the stack distance analysis MRC; a
+   block on top of its stack with some number of sets is on top of its
+   stacks with more sets too */
+static void
+mrc_access(struct cache_mrc_t *mrc,	/* stack distance analysis */
+	   md_addr_t baddr,		/* block referenced */
+	   int dist)			/* its fully associative distance */
+{
+  md_addr_t *stack;
+  int level, i, nsets, b;
+
+  mrc->refs++;
+  if (dist < 0)
+    mrc->fa_first++;
+  else
+    {
+      /* distance 0, 1, 2..3, 4..7, .. */
+      for (b = 0; dist; b++)
+	dist >>= 1;
+      mrc->fa_dist[b]++;
+    }
+
+  for (level=0; level<mrc->nlevels; level++)
+    {
+      nsets = 1 << level;
+      stack = &mrc->stacks[(nsets - 1 + ((baddr >> mrc->blk_shift)
+					  & (nsets - 1))) * mrc->max_assoc];
+      for (i=0; i<mrc->max_assoc && stack[i] != baddr; i++)
+	/* nada */;
+
+      if (i == 0)
+	{
+	  for (; level<mrc->nlevels; level++)
+	    mrc->dist[level * (mrc->max_assoc + 1)]++;
+	  return;
+	}
+
+      /* move the block to the top, a block not found pushes out the
+	 bottom one */
+      mrc->dist[level * (mrc->max_assoc + 1) + i]++;
+      memmove(&stack[1], &stack[0],
+	      MIN(i, mrc->max_assoc - 1) * sizeof(md_addr_t));
+      stack[0] = baddr;
+    }
+}
+
+/* analyze the regular references to cache CP by their LRU stack distance
+   for MAX_SETS sets and MAX_ASSOC ways at most, MAX_SETS 0 for none */
+void
+cache_set_mrc(struct cache_t *cp,	/* cache instance */
+	      int max_sets,		/* largest set count, 0 for none */
+	      int max_assoc)		/* largest associativity */
+{
+  struct cache_mrc_t *mrc = cp->mrc;
+  int i;
+
+  if (max_sets < 0 || (max_sets & (max_sets-1)) != 0)
+    fatal("stack distance analysis of cache `%s' needs a power of two sets",
+	  cp->name);
+  if (max_sets && (max_assoc <= 0 || (max_assoc & (max_assoc-1)) != 0))
+    fatal("stack distance analysis of cache `%s' needs a power of two ways",
+	  cp->name);
+
+  if (mrc)
+    {
+      free(mrc->stacks);
+      free(mrc->dist);
+      free(mrc);
+      cp->mrc = NULL;
+    }
+  if (max_sets)
+    {
+      mrc = (struct cache_mrc_t *)calloc(1, sizeof(struct cache_mrc_t));
+      if (!mrc)
+	fatal("out of virtual memory");
+      mrc->max_sets = max_sets;
+      mrc->max_assoc = max_assoc;
+      mrc->nlevels = log_base2(max_sets) + 1;
+      mrc->blk_shift = cp->set_shift;
+
+      /* 2*MAX_SETS-1 stacks in all, empty */
+      mrc->stacks = (md_addr_t *)
+	malloc((2 * max_sets - 1) * max_assoc * sizeof(md_addr_t));
+      mrc->dist = (counter_t *)
+	calloc(mrc->nlevels * (max_assoc + 1), sizeof(counter_t));
+      if (!mrc->stacks || !mrc->dist)
+	fatal("out of virtual memory");
+      for (i=0; i<(2 * max_sets - 1) * max_assoc; i++)
+	mrc->stacks[i] = CACHE_TAG_INVALID;
+      cp->mrc = mrc;
+    }
+
+  /* the fully associative distances come from the cache's stack */
+  fa_update(cp);
+}
+
+/* classify the regular misses of cache CP (ON non-zero) as compulsory, the
+   first reference to a block, capacity, a miss of a fully associative LRU
+   cache of the same size too, or conflict, the rest */
+void
+cache_set_3c(struct cache_t *cp,	/* cache instance */
+	     int on)			/* non-zero to classify misses */
+{
+  cp->classify_3c = (on != 0);
+  fa_update(cp);
+}
+
+/* print the miss ratio curves of the stack distance analysis of cache CP:
+   the miss rate of every set count and associativity, and the misses of a
+   fully associative cache of every power of two blocks, up to the size at
+   which only first references miss */
+void
+cache_mrc_print(struct cache_t *cp,	/* cache instance */
+		FILE *stream)		/* output stream */
+{
+  struct cache_mrc_t *mrc = cp->mrc;
+  counter_t hits, *dist;
+  double refs;
+  int level, assoc, d, k;
+
+  if (!mrc)
+    return;
+  refs = mrc->refs ? (double)mrc->refs : 1.0;
+
+  fprintf(stream,
+	  "\ncache: %s: LRU miss rates of %.0f references, %d byte blocks\n",
+	  cp->name, (double)mrc->refs, cp->bsize);
+  fprintf(stream, "  %10s", "sets\\ways");
+  for (assoc=1; assoc<=mrc->max_assoc; assoc*=2)
+    fprintf(stream, " %8d", assoc);
+  fprintf(stream, "\n");
+
+  for (level=0; level<mrc->nlevels; level++)
+    {
+      dist = &mrc->dist[level * (mrc->max_assoc + 1)];
+      fprintf(stream, "  %10d", 1 << level);
+      for (hits=0, d=0, assoc=1; assoc<=mrc->max_assoc; assoc*=2)
+	{
+	  /* ASSOC ways hit the references at distances below ASSOC */
+	  for (; d<assoc; d++)
+	    hits += dist[d];
+	  fprintf(stream, " %8.4f", (double)(mrc->refs - hits) / refs);
+	}
+      fprintf(stream, "\n");
+    }
+
+  fprintf(stream,
+	  "cache: %s: fully associative LRU misses, %.0f first references\n",
+	  cp->name, (double)mrc->fa_first);
+  fprintf(stream, "  %10s %12s %12s %10s\n",
+	  "blocks", "bytes", "misses", "miss_rate");
+  for (hits=0, k=0; k<32; k++)
+    {
+      /* 2^K blocks hit the references at distances below 2^K */
+      hits += mrc->fa_dist[k];
+      fprintf(stream, "  %10.0f %12.0f %12.0f %10.4f\n",
+	      (double)(1u << k), (double)(1u << k) * cp->bsize,
+	      (double)(mrc->refs - hits), (double)(mrc->refs - hits) / refs);
+      if (mrc->refs - hits <= mrc->fa_first)
+	break;
+    }
+}
+
+/* fill a prefetched block with a single lookup, see below */
+static int prefetch_fill(struct cache_t *cp, md_addr_t baddr, tick_t now);
+
+/* request prefetches of the blocks containing ADDRS[0..N-1] into cache CP
+   at NOW */
+void
+cache_prefetch_blocks(struct cache_t *cp,	/* cache instance */
+		      md_addr_t *addrs,		/* addresses to prefetch */
+		      int n,			/* number of addresses */
+		      tick_t now)		/* time of the requests */
+{
+  md_addr_t baddr;
+  int i, j;
+
+  for (i=0; i<n; i++)
+    {
+      baddr = CACHE_BADDR(cp, addrs[i]);
+
+      if (!cp->pfq_size)
+	{
+	  /* no prefetch queue, fetch the block right away */
+	  prefetch_fill(cp, baddr, now);
+	  continue;
+	}
+
+      if (cache_probe(cp, baddr))
+	continue;
+
+      /* one queue entry per block */
+      for (j=0; j<cp->pfq_num; j++)
+	{
+	  if (cp->pfq[(cp->pfq_head + j) % cp->pfq_size] == baddr)
+	    break;
+	}
+      if (j < cp->pfq_num)
+	continue;
+
+      if (cp->pfq_num == cp->pfq_size)
+	{
+	  cp->pfq_dropped++;
+	  continue;
+	}
+      cp->pfq[(cp->pfq_head + cp->pfq_num) % cp->pfq_size] = baddr;
+      cp->pfq_pc[(cp->pfq_head + cp->pfq_num) % cp->pfq_size] = access_PC();
+      cp->pfq_num++;
+    }
+}
+
+/* request a prefetch of the block containing ADDR into cache CP at NOW */
+void
+cache_prefetch(struct cache_t *cp,	/* cache instance */
+	       md_addr_t addr,		/* address to prefetch */
+	       tick_t now)		/* time of the request */
+{
+  cache_prefetch_blocks(cp, &addr, 1, now);
+}
+
+/* request prefetches along STRIDE from ADDR, CP->PF_DISTANCE strides ahead
+   for CP->PF_DEGREE blocks */
+void
+cache_prefetch_stride(struct cache_t *cp,	/* cache instance */
+		      md_addr_t addr,		/* address accessed */
+		      int stride,		/* stride in bytes */
+		      tick_t now)		/* time of the request */
+{
+  int i;
+
+  for (i=0; i<cp->pf_degree; i++)
+    {
+      cache_prefetch(cp, addr + (md_addr_t)stride * (cp->pf_distance + i), now);
+
+      /* a zero stride names the one block */
+      if (!stride)
+	break;
+    }
+}
+
+/* set the prefetch distance and degree of cache CP */
+void
+cache_set_pf_distance(struct cache_t *cp,	/* cache instance */
+		      int distance,		/* strides ahead, >= 1 */
+		      int degree)		/* blocks per trigger, >= 1 */
+{
+  if (distance < 1 || degree < 1)
+    fatal("prefetch distance and degree of cache `%s' must be positive",
+	  cp->name);
 
-     cp->misses++;
+  cp->pf_distance = distance;
+  cp->pf_degree = degree;
+}
 
-     if (cmd == Read) {	
-	cp->read_misses++;
-     }
-  }
-  else {
-     cp->prefetch_misses++;
-  }
+/* FDP aggressiveness levels, level 0 turns prefetching off */
+static struct {
+  int distance;			/* first prefetch this many strides ahead */
+  int degree;			/* prefetches per trigger */
+} fdp_levels[] = {
+  { 0, 0 }, { 1, 1 }, { 2, 1 }, { 4, 2 }, { 8, 4 }, { 16, 4 }
+};
+#define FDP_MAX_LEVEL		5
+#define FDP_START_LEVEL		3
+
+/* FDP thresholds: accuracy (useful/fills) high and low, lateness
+   (late/useful) and pollution (pollution/misses) */
+#define FDP_ACC_HIGH		0.75
+#define FDP_ACC_LOW		0.40
+#define FDP_LATE		0.01
+#define FDP_POLLUTION		0.005
+
+/* intervals prefetching stays off before it is retried at level 1 */
+#define FDP_OFF_INTERVALS	4
+
+/* set the aggressiveness level of cache CP */
+static void
+fdp_set_level(struct cache_t *cp, int level)
+{
+  cp->fdp->level = level;
+  cp->pf_distance = fdp_levels[level].distance;
+  cp->pf_degree = fdp_levels[level].degree;
+}
 
+/* end of an FDP interval, step the aggressiveness of cache CP by how
+   accurate, timely and polluting its prefetches were */
+static void
+fdp_update(struct cache_t *cp)		/* cache instance */
+{
+  struct cache_fdp_t *fdp = cp->fdp;
+  double accuracy, lateness, pollution;
+  int late, polluting, step;
+
+  /* average this interval's counts with the past ones */
+  fdp->fills = (fdp->fills + (cp->prefetch_misses - fdp->last_fills)) / 2;
+  fdp->useful = (fdp->useful + (cp->pf_useful - fdp->last_useful)) / 2;
+  fdp->late = (fdp->late + (cp->pf_late - fdp->last_late)) / 2;
+  fdp->pollution =
+    (fdp->pollution + (cp->pf_pollution - fdp->last_pollution)) / 2;
+  fdp->misses = (fdp->misses + (cp->misses - fdp->last_misses)) / 2;
+
+  fdp->last_fills = cp->prefetch_misses;
+  fdp->last_useful = cp->pf_useful;
+  fdp->last_late = cp->pf_late;
+  fdp->last_pollution = cp->pf_pollution;
+  fdp->last_misses = cp->misses;
+  fdp->evictions = 0;
+  fdp->intervals++;
+
+  /* turned off, retry at the lowest level after a while */
+  if (fdp->level == 0)
+    {
+      fdp->off_intervals++;
+      if (--fdp->off == 0)
+	fdp_set_level(cp, 1);
+      return;
+    }
 
-  /* select the appropriate block to replace, and re-link this entry to
-     the appropriate place in the way list */
-  switch (cp->policy) {
-  case LRU:
-  case FIFO:
-    repl = cp->sets[set].way_tail;
-    update_way_list(&cp->sets[set], repl, Head);
-    break;
-  case Random:
+  /* nothing prefetched, nothing to learn */
+  if (fdp->fills == 0)
+    return;
+
+  accuracy = fdp->useful / fdp->fills;
+  lateness = fdp->useful ? fdp->late / fdp->useful : 0.0;
+  pollution = fdp->misses ? fdp->pollution / fdp->misses : 0.0;
+  late = lateness > FDP_LATE;
+  polluting = pollution > FDP_POLLUTION;
+
+  if (accuracy >= FDP_ACC_HIGH)
+    /* accurate: go further if late, back off if polluting */
+    step = late ? 1 : (polluting ? -1 : 0);
+  else if (accuracy >= FDP_ACC_LOW)
+    /* fair: back off if polluting, go further only if late */
+    step = polluting ? -1 : (late ? 1 : 0);
+  else
+    /* inaccurate: back off, unless late prefetches are all that help */
+    step = (late && !polluting) ? 0 : -1;
+
+  if (step > 0 && fdp->level < FDP_MAX_LEVEL)
     {
-      int bindex = myrand() & (cp->assoc - 1);
-      repl = CACHE_BINDEX(cp, cp->sets[set].blks, bindex);
+      fdp->ups++;
+      fdp_set_level(cp, fdp->level + 1);
     }
-    break;
-  default:
-    panic("bogus replacement policy");
-  }
+  else if (step < 0)
+    {
+      fdp->downs++;
+      fdp_set_level(cp, fdp->level - 1);
+      if (fdp->level == 0)
+	fdp->off = FDP_OFF_INTERVALS;
+    }
+}
 
-  /* remove this block from the hash bucket chain, if hash exists */
-  if (cp->hsize)
-    unlink_htab_ent(cp, &cp->sets[set], repl);
+/* throttle the prefetches of cache CP, sampled every INTERVAL evictions */
+void
+cache_set_fdp(struct cache_t *cp,	/* cache instance */
+	      int interval)		/* evictions per interval */
+{
+  if (interval < 0)
+    fatal("prefetch throttling interval of cache `%s' must not be negative",
+	  cp->name);
 
-  /* blow away the last block to hit */
-  cp->last_tagset = 0;
-  cp->last_blk = NULL;
+  /* throttling off again, back to the default distance and degree */
+  if (cp->fdp)
+    {
+      free(cp->fdp);
+      cp->fdp = NULL;
+      cp->pf_distance = 1;
+      cp->pf_degree = 1;
+    }
+  if (!interval)
+    return;
+
+  cp->fdp = (struct cache_fdp_t *)calloc(1, sizeof(struct cache_fdp_t));
+  if (!cp->fdp)
+    fatal("out of virtual memory");
+  cp->fdp->interval = interval;
+  cp->fdp->last_fills = cp->prefetch_misses;
+  cp->fdp->last_useful = cp->pf_useful;
+  cp->fdp->last_late = cp->pf_late;
+  cp->fdp->last_pollution = cp->pf_pollution;
+  cp->fdp->last_misses = cp->misses;
+  fdp_set_level(cp, FDP_START_LEVEL);
+}
+
+/* issue queued prefetches of cache CP while an MSHR and the bus are free */
+void
+cache_issue_prefetches(struct cache_t *cp,	/* cache instance */
+		       tick_t now)		/* current time */
+{
+  md_addr_t baddr, saved_PC = pfq_issue_PC;
+
+  while (cp->pfq_num > 0
+	 && cp->bus_free <= now
+	 && (!cp->nmshrs || mshr_first_free(cp)->ready <= now))
+    {
+      baddr = cp->pfq[cp->pfq_head];
+      pfq_issue_PC = cp->pfq_pc[cp->pfq_head];
+      cp->pfq_head = (cp->pfq_head + 1) % cp->pfq_size;
+      cp->pfq_num--;
+
+      /* a regular access may have brought the block in meanwhile */
+      if (prefetch_fill(cp, baddr, now))
+	cp->pfq_issued++;
+    }
+  pfq_issue_PC = saved_PC;
+}
+
+/* print cache stats */
+void
+cache_stats(struct cache_t *cp,		/* cache instance */
+	    FILE *stream)		/* output stream */
+{
+  double sum = (double)(cp->hits + cp->misses);
+
+  fprintf(stream,
+	  "cache: %s: %.0f hits %.0f misses %.0f repls %.0f invalidations\n",
+	  cp->name, (double)cp->hits, (double)cp->misses,
+	  (double)cp->replacements, (double)cp->invalidations);
+  fprintf(stream,
+	  "cache: %s: miss rate=%f  repl rate=%f  invalidation rate=%f\n",
+	  cp->name,
+	  (double)cp->misses/sum, (double)(double)cp->replacements/sum,
+	  (double)cp->invalidations/sum);
+}
+
+/* find the valid block with tag TAG in set SET of cache CP, returns its
+   way, -1 if the set does not hold it */
+static int				/* way of the block, or -1 */
+cache_lookup(struct cache_t *cp,	/* cache instance */
+	     md_addr_t tag,		/* tag of the block */
+	     md_addr_t set)		/* set of the block */
+{
+  return cache_find_way(cp, &cp->sets[set], tag);
+}
+
+/* bring the block containing ADDR, which missed, into set SET of cache CP
+   at NOW, replacing the block the policy selects; returns the latency of
+   the fill, places the filled block in *BLKP, its way in *WAYP and the
+   address of the replaced block in *REPL_ADDR (if not NULL); the last
+   block to hit is left alone unless it is the one replaced */
+static int				/* latency of the fill */
+cache_fill(struct cache_t *cp,		/* cache instance */
+	   md_addr_t addr,		/* address missed */
+	   md_addr_t set,		/* its set */
+	   tick_t now,			/* time of the miss */
+	   int prefetch,		/* 1 if the miss is a prefetch */
+	   md_addr_t *repl_addr,	/* for address of replaced block */
+	   struct cache_blk_t **blkp,	/* for return of the block filled */
+	   int *wayp)			/* for return of its way */
+{
+  md_addr_t baddr = CACHE_BADDR(cp, addr);
+  struct cache_blk_t *repl;
+  struct cache_mshr_t *mshr = NULL;
+  int way, merged = FALSE, sb_hit = FALSE;
+  tick_t sb_ready = 0;
+  int lat = 0;
+
+  /* a regular miss to a block a prefetch pushed out is pollution, either
+     way the block is coming back in */
+  if (PF_FILTER_TEST(cp, baddr))
+    {
+      if (prefetch == 0)
+	cp->pf_pollution++;
+      PF_FILTER_CLEAR(cp, baddr);
+    }
+
+  /* a stream buffer holding the block supplies it, the buffers are checked
+     alongside the cache; otherwise a non-blocking cache merges this miss
+     with an outstanding fill of the same block, or waits for an MSHR to
+     track it */
+  if (prefetch == 0 && cp->nsbufs
+      && sbuf_lookup(cp, baddr, now, &sb_ready))
+    sb_hit = TRUE;
+  else if (cp->nmshrs)
+    {
+      mshr = mshr_lookup(cp, baddr, now);
+      if (mshr)
+	{
+	  cp->mshr_merges++;
+	  merged = TRUE;
+	}
+      else
+	{
+	  mshr = mshr_first_free(cp);
+	  if (mshr->ready > now)
+	    {
+	      if (prefetch == 0)
+		{
+		  cp->mshr_full++;
+		  cp->mshr_wait += mshr->ready - now;
+		}
+	      lat += mshr->ready - now;
+	    }
+	}
+    }
+
+  /* select the appropriate block to replace */
+  way = repl_victim(cp, set);
+  repl = CACHE_BINDEX(cp, cp->sets[set].blks, way);
+
+  /* the last block to hit may be the one going */
+  if (repl == cp->last_blk)
+    {
+      cp->last_tagset = 0;
+      cp->last_blk = NULL;
+    }
 
   /* write back replaced block data */
   if (repl->status & CACHE_BLK_VALID)
     {
       cp->replacements++;
 
+      /* prefetch throttling samples every so many evictions */
+      if (cp->fdp && ++cp->fdp->evictions >= cp->fdp->interval)
+	fdp_update(cp);
+
       if (repl_addr)
-	*repl_addr = CACHE_MK_BADDR(cp, repl->tag, set);
+	*repl_addr = CACHE_MK_BADDR(cp, cp->sets[set].tags[way], set);
+
+      /* a block never hit since its fill teaches SHiP its signature is
+	 dead */
+      if (cp->policy == SHiP && !(repl->status & CACHE_BLK_REUSED)
+	  && cp->shct[repl->signature] > 0)
+	cp->shct[repl->signature]--;
+
+      /* an unused prefetch is wasted, a used block pushed out by a
+	 prefetch may come back as pollution */
+      if (repl->status & CACHE_BLK_PREFETCHED)
+	cp->pf_useless++;
+      else if (prefetch)
+	PF_FILTER_SET(cp, CACHE_MK_BADDR(cp, cp->sets[set].tags[way], set));
  
       /* don't replace the block until outstanding misses are satisfied */
-      lat += BOUND_POS(repl->ready - now);
+      lat += BOUND_POS(repl->ready - (now + lat));
  
       /* stall until the bus to next level of memory is available */
       lat += BOUND_POS(cp->bus_free - (now + lat));
@@ -1114,18 +2816,164 @@ cache_access(struct cache_t *cp,	/* cache to access */
 	  /* write back the cache block */
 	  cp->writebacks++;
 	  lat += cp->blk_access_fn(Write,
-				   CACHE_MK_BADDR(cp, repl->tag, set),
+				   CACHE_MK_BADDR(cp, cp->sets[set].tags[way], set),
 				   cp->bsize, repl, now+lat, 0);
 	}
     }
 
   /* update block tags */
-  repl->tag = tag;
+  cp->sets[set].tags[way] = CACHE_TAG(cp, addr);
   repl->status = CACHE_BLK_VALID;	/* dirty bit set on update */
+  if (prefetch)
+    repl->status |= CACHE_BLK_PREFETCHED;
+  repl_insert(cp, set, way, repl, prefetch);
+
+  /* read data block, unless it is on its way already */
+  if (merged)
+    lat = MAX(lat, mshr->ready - now);
+  else if (sb_hit)
+    lat = MAX(lat, BOUND_POS(sb_ready - now));
+  else
+    lat += cp->blk_access_fn(Read, baddr, cp->bsize,
+			     repl, now+lat, prefetch);
+
+  /* update block status */
+  repl->ready = now+lat;
+
+  /* the MSHR is busy until the fill completes */
+  if (mshr && !merged)
+    {
+      mshr->baddr = baddr;
+      mshr->ready = repl->ready;
+    }
+
+  /* a demand miss no stream buffer saw coming starts a new stream */
+  if (prefetch == 0 && cp->nsbufs && !sb_hit && !merged)
+    sbuf_allocate(cp, baddr, now);
+
+  *blkp = repl;
+  *wayp = way;
+  return lat;
+}
+
+/* prefetch the block BADDR into cache CP at NOW: one lookup, then a fill
+   if it missed and no MSHR is filling it already; the last block to hit,
+   used by regular accesses, is left alone; returns non-zero if the block
+   was filled */
+static int				/* non-zero if filled */
+prefetch_fill(struct cache_t *cp,	/* cache instance */
+	      md_addr_t baddr,		/* block address */
+	      tick_t now)		/* time of the prefetch */
+{
+  md_addr_t set = CACHE_SET(cp, baddr);
+  struct cache_blk_t *blk;
+  int way;
+
+  if (cache_lookup(cp, CACHE_TAG(cp, baddr), set) >= 0
+      || (cp->nmshrs && mshr_lookup(cp, baddr, now)))
+    return FALSE;
+
+  cp->prefetch_misses++;
+  cache_fill(cp, baddr, set, now, /* prefetch */1, NULL, &blk, &way);
+  return TRUE;
+}
+
+/* access a cache, perform a CMD operation on cache CP at address ADDR,
+   places NBYTES of data at *P, returns latency of operation if initiated
+   at NOW, places pointer to block user data in *UDATA, *P is untouched if
+   cache blocks are not allocated (!CP->BALLOC), UDATA should be NULL if no
+   user data is attached to blocks */
+unsigned int				/* latency of access in cycles */
+cache_access(struct cache_t *cp,	/* cache to access */
+	     enum mem_cmd cmd,		/* access type, Read or Write */
+	     md_addr_t addr,		/* address of access */
+	     void *vp,			/* ptr to buffer for input/output */
+	     int nbytes,		/* number of bytes to access */
+	     tick_t now,		/* time of access */
+	     byte_t **udata,		/* for return of user data ptr */
+	     md_addr_t *repl_addr,	/* for address of replaced block */
+	     int prefetch)		/* 1 if the access is a prefetch, 0 if it is not */
+{
+  byte_t *p = vp;
+  md_addr_t tag = CACHE_TAG(cp, addr);
+  md_addr_t set = CACHE_SET(cp, addr);
+  md_addr_t bofs = CACHE_BLK(cp, addr);
+  struct cache_blk_t *blk, *repl;
+  int way, lat = 0, dist = 0;
+
+  /* default replacement address */
+  if (repl_addr)
+    *repl_addr = 0;
+
+  /* check alignments */
+  if ((nbytes & (nbytes-1)) != 0 || (addr & (nbytes-1)) != 0)
+    fatal("cache: access error: bad size or alignment, addr 0x%08x", addr);
+
+  /* access must fit in cache block */
+  /* FIXME:
+     ((addr + (nbytes - 1)) > ((addr & ~cp->blk_mask) + (cp->bsize - 1))) */
+  if ((addr + nbytes) > ((addr & ~cp->blk_mask) + cp->bsize))
+    fatal("cache: access error: access spans block, addr 0x%08x", addr);
+
+  /* permissions are checked on cache misses */
+
+  /* the fully associative stack sees the regular references, for the
+     stack distance analysis and the 3C classification of misses */
+  if (cp->fa_stack && prefetch == 0)
+    {
+      dist = fa_access(cp->fa_stack, CACHE_BADDR(cp, addr));
+      if (cp->mrc)
+	mrc_access(cp->mrc, CACHE_BADDR(cp, addr), dist);
+    }
+
+  /* check for a fast hit: access to same block */
+  if (CACHE_TAGSET(cp, addr) == cp->last_tagset)
+    {
+      /* hit in the same block */
+      blk = cp->last_blk;
+      way = cp->last_way;
+      goto cache_fast_hit;
+    }
+    
+  way = cache_lookup(cp, tag, set);
+  if (way >= 0)
+    {
+      blk = CACHE_BINDEX(cp, cp->sets[set].blks, way);
+      goto cache_hit;
+    }
+
+  /* cache block not found */
+
+  /* **MISS** */
+  if (prefetch == 0 ) {
+
+     cp->misses++;
+
+     if (cmd == Read) {	
+	cp->read_misses++;
+     }
+
+     /* a first reference is compulsory, a miss that a fully associative
+	LRU cache of the same size would take too is capacity */
+     if (cp->classify_3c) {
+	if (dist < 0)
+	  cp->miss_compulsory++;
+	else if (dist >= cp->nsets * cp->assoc)
+	  cp->miss_capacity++;
+	else
+	  cp->miss_conflict++;
+     }
+  }
+  else {
+     cp->prefetch_misses++;
+  }
+
+  /* blow away the last block to hit */
+  cp->last_tagset = 0;
+  cp->last_blk = NULL;
 
-  /* read data block */
-  lat += cp->blk_access_fn(Read, CACHE_BADDR(cp, addr), cp->bsize,
-			   repl, now+lat, prefetch);
+  /* replace a block and read the missing one in */
+  lat = cache_fill(cp, addr, set, now, prefetch, repl_addr, &repl, &way);
 
   /* copy data out of cache block */
   if (cp->balloc)
@@ -1141,15 +2989,8 @@ cache_access(struct cache_t *cp,	/* cache to access */
   if (udata)
     *udata = repl->user_data;
 
-  /* update block status */
-  repl->ready = now+lat;
-
-  /* link this entry back into the hash table */
-  if (cp->hsize)
-    link_htab_ent(cp, &cp->sets[set], repl);
-
   if (prefetch == 0) {	/* only regular cache accesses can generate a prefetch */
-  	generate_prefetch(cp, addr);
+  	generate_prefetch(cp, addr, now);
   }
 
   /* return latency of the operation */
@@ -1163,6 +3004,14 @@ cache_access(struct cache_t *cp,	/* cache to access */
 
      cp->hits++;
 
+     /* first regular use of a prefetched block */
+     if (blk->status & CACHE_BLK_PREFETCHED) {
+        cp->pf_useful++;
+        if (blk->ready > now)
+          cp->pf_late++;
+        blk->status &= ~CACHE_BLK_PREFETCHED;
+     }
+
      if (cmd == Read) {	
 	   cp->read_hits++;
      }
@@ -1172,6 +3021,10 @@ cache_access(struct cache_t *cp,	/* cache to access */
   }
 
 
+  /* a hit on a block still being filled merges with its miss */
+  if (cp->nmshrs && blk->ready > now)
+    cp->mshr_merges++;
+
   /* copy data out of cache block, if block exists */
   if (cp->balloc)
     {
@@ -1182,25 +3035,20 @@ cache_access(struct cache_t *cp,	/* cache to access */
   if (cmd == Write)
     blk->status |= CACHE_BLK_DIRTY;
 
-  /* if LRU replacement and this is not the first element of list, reorder */
-  if (blk->way_prev && cp->policy == LRU)
-    {
-      /* move this block to head of the way (MRU) list */
-      update_way_list(&cp->sets[set], blk, Head);
-    }
-
-  /* tag is unchanged, so hash links (if they exist) are still valid */
+  /* update the replacement state, e.g., make the block the youngest */
+  repl_touch(cp, set, way, blk, prefetch);
 
   /* record the last block to hit */
   cp->last_tagset = CACHE_TAGSET(cp, addr);
   cp->last_blk = blk;
+  cp->last_way = way;
 
   /* get user block data, if requested and it exists */
   if (udata)
     *udata = blk->user_data;
 
   if (prefetch == 0) {	/* only regular cache accesses can generate a prefetch */
-	generate_prefetch(cp, addr);
+	generate_prefetch(cp, addr, now);
   }
 
 
@@ -1214,6 +3062,14 @@ cache_access(struct cache_t *cp,	/* cache to access */
      
      cp->hits++;
 
+     /* first regular use of a prefetched block */
+     if (blk->status & CACHE_BLK_PREFETCHED) {
+        cp->pf_useful++;
+        if (blk->ready > now)
+          cp->pf_late++;
+        blk->status &= ~CACHE_BLK_PREFETCHED;
+     }
+
      if (cmd == Read) {	
         cp->read_hits++;
      }
@@ -1223,6 +3079,10 @@ cache_access(struct cache_t *cp,	/* cache to access */
   }
 
 
+  /* a hit on a block still being filled merges with its miss */
+  if (cp->nmshrs && blk->ready > now)
+    cp->mshr_merges++;
+
   /* copy data out of cache block, if block exists */
   if (cp->balloc)
     {
@@ -1233,9 +3093,9 @@ cache_access(struct cache_t *cp,	/* cache to access */
   if (cmd == Write)
     blk->status |= CACHE_BLK_DIRTY;
 
-  /* this block hit last, no change in the way list */
-
-  /* tag is unchanged, so hash links (if they exist) are still valid */
+  /* this block hit last, but prefetches filled since may have made it
+     older */
+  repl_touch(cp, set, way, blk, prefetch);
 
   /* get user block data, if requested and it exists */
   if (udata)
@@ -1244,9 +3104,10 @@ cache_access(struct cache_t *cp,	/* cache to access */
   /* record the last block to hit */
   cp->last_tagset = CACHE_TAGSET(cp, addr);
   cp->last_blk = blk;
+  cp->last_way = way;
 
   if (prefetch == 0) {	/* only regular cache accesses can generate a prefetch */
-     generate_prefetch(cp, addr);
+     generate_prefetch(cp, addr, now);
   }
 
   /* return first cycle data is available to access */
@@ -1260,39 +3121,9 @@ int					/* non-zero if access would hit */
 cache_probe(struct cache_t *cp,		/* cache instance to probe */
 	    md_addr_t addr)		/* address of block to probe */
 {
-  md_addr_t tag = CACHE_TAG(cp, addr);
-  md_addr_t set = CACHE_SET(cp, addr);
-  struct cache_blk_t *blk;
-
   /* permissions are checked on cache misses */
 
-  if (cp->hsize)
-  {
-    /* higly-associativity cache, access through the per-set hash tables */
-    int hindex = CACHE_HASH(cp, tag);
-    
-    for (blk=cp->sets[set].hash[hindex];
-	 blk;
-	 blk=blk->hash_next)
-    {	
-      if (blk->tag == tag && (blk->status & CACHE_BLK_VALID))
-	  return TRUE;
-    }
-  }
-  else
-  {
-    /* low-associativity cache, linear search the way list */
-    for (blk=cp->sets[set].way_head;
-	 blk;
-	 blk=blk->way_next)
-    {
-      if (blk->tag == tag && (blk->status & CACHE_BLK_VALID))
-	  return TRUE;
-    }
-  }
-  
-  /* cache block not found */
-  return FALSE;
+  return cache_lookup(cp, CACHE_TAG(cp, addr), CACHE_SET(cp, addr)) >= 0;
 }
 
 /* flush the entire cache, returns latency of the operation */
@@ -1300,19 +3131,28 @@ unsigned int				/* latency of the flush operation */
 cache_flush(struct cache_t *cp,		/* cache instance to flush */
 	    tick_t now)			/* time of cache flush */
 {
-  int i, lat = cp->hit_latency; /* min latency to probe cache */
+  int i, j, lat = cp->hit_latency; /* min latency to probe cache */
   struct cache_blk_t *blk;
 
   /* blow away the last block to hit */
   cp->last_tagset = 0;
   cp->last_blk = NULL;
 
-  /* no way list updates required because all blocks are being invalidated */
+  /* forget outstanding misses and queued prefetches */
+  for (i=0; i<cp->nmshrs; i++)
+    cp->mshrs[i].ready = 0;
+  cp->pfq_num = 0;
+  for (i=0; i<cp->nsbufs; i++)
+    cp->sbufs[i].num = 0;
+
+  /* no age updates required because all blocks are being invalidated,
+     except that RRIP must see them as distant */
   for (i=0; i<cp->nsets; i++)
     {
 
-      for (blk=cp->sets[i].way_head; blk; blk=blk->way_next)
+      for (j=0; j<cp->assoc; j++)
 	{
+	  blk = CACHE_BINDEX(cp, cp->sets[i].blks, j);
 	  if (blk->status & CACHE_BLK_VALID)
 	    {
 	      cp->invalidations++;
@@ -1323,9 +3163,17 @@ cache_flush(struct cache_t *cp,		/* cache instance to flush */
 		  /* write back the invalidated block */
           	  cp->writebacks++;
 		  lat += cp->blk_access_fn(Write,
-					   CACHE_MK_BADDR(cp, blk->tag, i),
+					   CACHE_MK_BADDR(cp,
+							  cp->sets[i].tags[j],
+							  i),
 					   cp->bsize, blk, now+lat, 0);
 		}
+	      cp->sets[i].tags[j] = CACHE_TAG_INVALID;
+
+	      /* RRIP replaces the distant ways first */
+	      if (cp->policy == SRRIP || cp->policy == BRRIP
+		  || cp->policy == DRRIP || cp->policy == SHiP)
+		cp->sets[i].ages[j] = RRIP_DISTANT;
 	    }
 	}
     }
@@ -1334,6 +3182,77 @@ cache_flush(struct cache_t *cp,		/* cache instance to flush */
   return lat;
 }
 
+/* reset cache CP to the state cache_create() and the cache_set_*() calls
+   left it in: all blocks invalid and ready, the bus, MSHRs, prefetch queue
+   and stream buffers idle, the prefetcher, throttling, pollution filter and
+   replacement state fresh; nothing is written back, the statistics
+   (including the stack distance analysis) accumulate across resets */
+void
+cache_reset(struct cache_t *cp)		/* cache instance to reset */
+{
+  struct cache_blk_t *blk;
+  int i, j;
+
+  /* blow away the last block to hit */
+  cp->last_tagset = 0;
+  cp->last_blk = NULL;
+
+  /* the bus, MSHRs, prefetch queue and stream buffers are idle */
+  cp->bus_free = 0;
+  if (cp->nmshrs)
+    memset(cp->mshrs, 0, cp->nmshrs * sizeof(struct cache_mshr_t));
+  cp->pfq_head = 0;
+  cp->pfq_num = 0;
+  for (i=0; i<cp->nsbufs; i++)
+    {
+      cp->sbufs[i].head = 0;
+      cp->sbufs[i].num = 0;
+      cp->sbufs[i].next = 0;
+      cp->sbufs[i].last_use = 0;
+      memset(cp->sbufs[i].ready, 0, cp->sbuf_depth * sizeof(tick_t));
+    }
+
+  /* invalid blocks, ordered as cache_create() leaves them */
+  for (i=0; i<cp->nsets; i++)
+    {
+      for (j=0; j<cp->assoc; j++)
+	{
+	  blk = CACHE_BINDEX(cp, cp->sets[i].blks, j);
+	  blk->status = 0;
+	  blk->signature = 0;
+	  blk->ready = 0;
+	  cp->sets[i].tags[j] = CACHE_TAG_INVALID;
+
+	  if (cp->policy == LRU || cp->policy == FIFO || cp->policy == Random)
+	    cp->sets[i].ages[j] = cp->assoc - 1 - j;
+	  else if (cp->policy == PLRU)
+	    cp->sets[i].ages[j] = 0;
+	  else
+	    cp->sets[i].ages[j] = RRIP_DISTANT;
+	}
+    }
+
+  /* replacement state beyond the ages */
+  cp->psel = RRIP_PSEL_MAX/2;
+  cp->bip_rand = 0x9e3779b9;
+  if (cp->shct)
+    memset(cp->shct, 1, SHIP_SHCT_SIZE);
+
+  /* a fresh prefetcher, throttling from its starting level and an empty
+     pollution filter */
+  if (cp->prefetcher)
+    {
+      if (cp->prefetcher->destroy)
+	cp->prefetcher->destroy(cp->prefetch_state);
+      cp->prefetch_state = cp->prefetcher->create
+	? cp->prefetcher->create(cp, cp->prefetch_arg) : NULL;
+    }
+  if (cp->fdp)
+    cache_set_fdp(cp, cp->fdp->interval);
+  memset(cp->pf_filter, 0,
+	 ((cp->nsets * cp->assoc + 31) / 32) * sizeof(word_t));
+}
+
 /* flush the block containing ADDR from the cache CP, returns the latency of
    the block flush operation */
 unsigned int				/* latency of flush operation */
@@ -1344,35 +3263,13 @@ cache_flush_addr(struct cache_t *cp,	/* cache instance to flush */
   md_addr_t tag = CACHE_TAG(cp, addr);
   md_addr_t set = CACHE_SET(cp, addr);
   struct cache_blk_t *blk;
-  int lat = cp->hit_latency; /* min latency to probe cache */
-
-  if (cp->hsize)
-    {
-      /* higly-associativity cache, access through the per-set hash tables */
-      int hindex = CACHE_HASH(cp, tag);
+  int way, lat = cp->hit_latency; /* min latency to probe cache */
 
-      for (blk=cp->sets[set].hash[hindex];
-	   blk;
-	   blk=blk->hash_next)
-	{
-	  if (blk->tag == tag && (blk->status & CACHE_BLK_VALID))
-	    break;
-	}
-    }
-  else
-    {
-      /* low-associativity cache, linear search the way list */
-      for (blk=cp->sets[set].way_head;
-	   blk;
-	   blk=blk->way_next)
-	{
-	  if (blk->tag == tag && (blk->status & CACHE_BLK_VALID))
-	    break;
-	}
-    }
+  way = cache_lookup(cp, tag, set);
 
-  if (blk)
+  if (way >= 0)
     {
+      blk = CACHE_BINDEX(cp, cp->sets[set].blks, way);
       cp->invalidations++;
       blk->status &= ~CACHE_BLK_VALID;
 
@@ -1385,11 +3282,13 @@ cache_flush_addr(struct cache_t *cp,	/* cache instance to flush */
 	  /* write back the invalidated block */
           cp->writebacks++;
 	  lat += cp->blk_access_fn(Write,
-				   CACHE_MK_BADDR(cp, blk->tag, set),
+				   CACHE_MK_BADDR(cp, tag, set),
 				   cp->bsize, blk, now+lat, 0);
 	}
-      /* move this block to tail of the way (LRU) list */
-      update_way_list(&cp->sets[set], blk, Tail);
+      cp->sets[set].tags[way] = CACHE_TAG_INVALID;
+
+      /* make this block the oldest, it is replaced next */
+      repl_demote(cp, set, way);
     }
 
   /* return latency of the operation */
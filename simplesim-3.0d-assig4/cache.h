@@ -78,9 +78,11 @@
  * physical page address information, etc...
  *
  * The caches implemented by this module provide efficient storage management
- * and fast access for all cache geometries.  When sets become highly
- * associative, a hash table (indexed by address) is allocated for each set
- * in the cache.
+ * and fast access for all cache geometries.  The tags of each set are kept
+ * in an array of their own, apart from the blocks, so a lookup compares the
+ * tags of all ways at once, and replacement state is kept per way rather
+ * than as a list of blocks: an LRU or FIFO age, an RRIP re-reference
+ * prediction, or the node bits of a tree-PLRU.
  *
  * This module also tracks latency of accessing the data cache, each cache has
  * a hit latency defined when instantiated, miss latency is returned by the
@@ -94,34 +96,31 @@
  * reordering of requests in the memory hierarchy is not possible.
  */
 
-/* highly associative caches are implemented using a hash table lookup to
-   speed block access, this macro decides if a cache is "highly associative" */
-#define CACHE_HIGHLY_ASSOC(cp)	((cp)->assoc > 4)
-
 /* cache replacement policy */
 enum cache_policy {
   LRU,		/* replace least recently used block (perfect LRU) */
   Random,	/* replace a random block */
-  FIFO		/* replace the oldest block in the set */
+  FIFO,		/* replace the oldest block in the set */
+  SRRIP,	/* static re-reference interval prediction */
+  BRRIP,	/* bimodal RRIP, most fills predicted distant */
+  DRRIP,	/* SRRIP or BRRIP, whichever misses less (set dueling) */
+  SHiP,		/* SRRIP with fills predicted by PC signature */
+  PLRU		/* tree pseudo-LRU */
 };
 
 
 /* block status values */
 #define CACHE_BLK_VALID		0x00000001	/* block in valid, in use */
 #define CACHE_BLK_DIRTY		0x00000002	/* dirty block */
+#define CACHE_BLK_PREFETCHED	0x00000004	/* filled by a prefetch, not
+						   yet used by a regular access */
+#define CACHE_BLK_REUSED	0x00000008	/* hit since filled (SHiP) */
 
 /* cache block (or line) definition */
 struct cache_blk_t
 {
-  struct cache_blk_t *way_next;	/* next block in the ordered way chain, used
-				   to order blocks for replacement */
-  struct cache_blk_t *way_prev;	/* previous block in the order way chain */
-  struct cache_blk_t *hash_next;/* next block in the hash bucket chain, only
-				   used in highly-associative caches */
-  /* since hash table lists are typically small, there is no previous
-     pointer, deletion requires a trip through the hash table bucket list */
-  md_addr_t tag;		/* data block tag value */
   unsigned int status;		/* block status, see CACHE_BLK_* defs above */
+  half_t signature;		/* SHiP signature of the fill */
   tick_t ready;		/* time when block will be accessible, field
 				   is set when a miss fetch is initiated */
   byte_t *user_data;		/* pointer to user defined data, e.g.,
@@ -136,16 +135,126 @@ struct cache_blk_t
 /* cache set definition (one or more blocks sharing the same set index) */
 struct cache_set_t
 {
-
-  struct cache_blk_t **hash;	/* hash table: for fast access w/assoc, NULL
-				   for low-assoc caches */
-  struct cache_blk_t *way_head;	/* head of way list */
-  struct cache_blk_t *way_tail;	/* tail pf way list */
+  md_addr_t *tags;		/* tag of each way, all invalid ways hold a
+				   tag that never matches */
+  half_t *ages;			/* replacement state of each way: the age, 0
+				   for the most recently used (LRU) or filled
+				   (FIFO) block up to ASSOC-1 for the next
+				   victim; the re-reference prediction value
+				   (RRIP, SHiP); or the tree node bits, node
+				   N of the tree in entry N (PLRU) */
   struct cache_blk_t *blks;	/* cache blocks, allocated sequentially, so
 				   this pointer can also be used for random
 				   access to cache blocks */
 };
 
+struct cache_t;
+
+/* prefetcher interface: a prefetcher watches the regular accesses to one
+   cache and may prefetch blocks into it with cache_prefetch(); every
+   cache gets its own instance, created by cache_create() and destroyed by
+   cache_free(), prefetchers are selected by the name they are registered
+   under with cache_reg_prefetcher() */
+struct cache_prefetcher_t
+{
+  char *name;			/* prefetcher name, e.g., "stride" */
+  /* create the state of the prefetcher of cache CP, ARG is the number
+     following the name in its spec (e.g., 64 for "stride:64"), 0 if none;
+     may be NULL if the prefetcher has no state */
+  void *(*create)(struct cache_t *cp, int arg);
+  /* observe a regular access to ADDR in cache CP at time NOW, prefetches
+     are requested with cache_prefetch() */
+  void (*access)(struct cache_t *cp, void *state, md_addr_t addr, tick_t now);
+  /* free the state, may be NULL */
+  void (*destroy)(void *state);
+  struct cache_prefetcher_t *next;	/* registry link */
+};
+
+/* miss status holding register, tracks one outstanding block fill */
+struct cache_mshr_t
+{
+  md_addr_t baddr;		/* block address being filled */
+  tick_t ready;			/* time the fill completes, free after that */
+};
+
+/* stream buffer, a FIFO of the blocks following a demand miss, see
+   cache_set_sbufs() */
+struct cache_sbuf_t
+{
+  md_addr_t *baddr;		/* block addresses, circular from HEAD */
+  tick_t *ready;		/* time each block arrives */
+  int head;			/* oldest entry */
+  int num;			/* number of entries */
+  md_addr_t next;		/* address of the next block to fetch */
+  tick_t last_use;		/* time of the last allocation or hit */
+};
+
+/* feedback-directed prefetch throttling state, see cache_set_fdp() */
+struct cache_fdp_t
+{
+  int interval;			/* evictions per sampling interval */
+  int evictions;		/* evictions so far in this interval */
+  int level;			/* aggressiveness level, 0 while turned off */
+  int off;			/* intervals left with prefetching turned off */
+
+  /* cache counters at the start of this interval */
+  counter_t last_fills, last_useful, last_late, last_pollution, last_misses;
+
+  /* per-interval counts, averaged with the past intervals */
+  double fills, useful, late, pollution, misses;
+
+  counter_t intervals;		/* intervals sampled */
+  counter_t ups;		/* intervals that raised the level */
+  counter_t downs;		/* intervals that lowered the level */
+  counter_t off_intervals;	/* intervals with prefetching turned off */
+};
+
+/* block of a fully associative stack */
+struct cache_fa_ent_t
+{
+  md_addr_t baddr;		/* block address */
+  int time;			/* time of its last reference, 0 if unused */
+};
+
+/* fully associative LRU stack of the regular references to a cache, for
+   its stack distance analysis and its 3C miss classification: the time of
+   the last reference to each block is marked in a binary indexed tree over
+   time, so the stack distance of a reference is the number of marks after
+   the time of the last one (Bennett and Kruskal); the hash table is also
+   the set of all blocks referenced */
+struct cache_fa_stack_t
+{
+  int blk_shift;		/* log2 of the block size */
+  struct cache_fa_ent_t *htab;	/* blocks, hashed by address */
+  int hsize;			/* hash table entries, a power of two */
+  int hused;			/* blocks referenced so far */
+  int *slot;			/* entry last referenced at each time, -1 if
+				   it has been referenced since */
+  int *tree;			/* binary indexed tree over times 1..TSIZE */
+  int tsize;			/* times before times are renumbered */
+  int now;			/* last time used */
+};
+
+/* stack distance (Mattson) analysis of the regular references to a cache,
+   see cache_set_mrc(); level L holds the LRU stacks of the cache with 2^L
+   sets, MAX_ASSOC blocks deep, the fully associative distances come from
+   the cache's fully associative stack */
+struct cache_mrc_t
+{
+  int max_sets;			/* set counts 1, 2, 4, .. MAX_SETS */
+  int max_assoc;		/* stack depth, a power of two */
+  int nlevels;			/* number of set counts */
+  int blk_shift;		/* log2 of the block size */
+  md_addr_t *stacks;		/* block addresses, most recent first, the
+				   stacks of level L start at stack 2^L-1 */
+  counter_t *dist;		/* per level, references at stack distances
+				   0..MAX_ASSOC-1, then the deeper ones */
+  counter_t refs;		/* references analyzed */
+  counter_t fa_dist[33];	/* references at fully associative stack
+				   distances 0, 1, 2..3, 4..7, .. */
+  counter_t fa_first;		/* first references to a block */
+};
+
 /* cache definition */
 struct cache_t
 {
@@ -158,7 +267,44 @@ struct cache_t
   int assoc;			/* cache associativity */
   enum cache_policy policy;	/* cache replacement policy */
   unsigned int hit_latency;	/* cache hit latency */
-  int prefetch_type;		/* prefetcher type */
+  struct cache_prefetcher_t *prefetcher;/* prefetcher, NULL for none */
+  int prefetch_arg;		/* prefetcher argument, e.g., RPT entries */
+  void *prefetch_state;		/* this cache's prefetcher state */
+  int pf_distance;		/* first prefetch this many strides ahead */
+  int pf_degree;		/* prefetches per trigger, 0 for none */
+  struct cache_fdp_t *fdp;	/* prefetch throttling, NULL for none */
+
+  /* replacement state beyond the per-way ages, see repl_insert() */
+  int psel;			/* DRRIP policy selector, followers use BRRIP
+				   in its upper half */
+  int duel_mask;		/* DRRIP leader sets, SRRIP if SET & MASK is
+				   0, BRRIP if it is MASK */
+  word_t bip_rand;		/* BRRIP's own random number state */
+  byte_t *shct;			/* SHiP signature history counters */
+
+  /* non-blocking miss handling, see cache_set_mshrs() */
+  int nmshrs;			/* number of MSHRs, 0 for unlimited */
+  struct cache_mshr_t *mshrs;	/* outstanding misses */
+  int pfq_size;			/* prefetch queue entries, 0 to issue
+				   prefetches at once */
+  md_addr_t *pfq;		/* prefetch queue, block addresses */
+  md_addr_t *pfq_pc;		/* PC of the access that queued each */
+  int pfq_head;			/* oldest queued prefetch */
+  int pfq_num;			/* number of queued prefetches */
+
+  /* stream buffers, see cache_set_sbufs() */
+  int nsbufs;			/* number of stream buffers, 0 for none */
+  int sbuf_depth;		/* blocks per stream buffer */
+  struct cache_sbuf_t *sbufs;	/* the stream buffers */
+
+  /* stack distance analysis, NULL for none, see cache_set_mrc() */
+  struct cache_mrc_t *mrc;
+
+  /* 3C miss classification, see cache_set_3c() */
+  int classify_3c;		/* classify regular misses? */
+
+  /* fully associative stack, if the above need one */
+  struct cache_fa_stack_t *fa_stack;
 
   /* miss/replacement handler, read/write BSIZE bytes starting at BADDR
      from/into cache block BLK, returns the latency of the operation
@@ -178,7 +324,6 @@ struct cache_t
 		     int prefetch);		/* 1 if the access is a prefetch, 0 if it is not */
 
   /* derived data, for fast decoding */
-  int hsize;			/* cache set hash table size */
   md_addr_t blk_mask;
   int set_shift;
   md_addr_t set_mask;		/* use *after* shift */
@@ -210,14 +355,41 @@ struct cache_t
   counter_t prefetch_hits;	/* total number of prefetch accesses that are hits */ 
   counter_t prefetch_misses;	/* total number of prefetch accesses that miss in this cache */
 
+  /* prefetch effectiveness, a prefetch fill is a prefetch miss */
+  counter_t pf_useful;		/* prefetched blocks used by a regular access */
+  counter_t pf_late;		/* ... whose fill had not completed yet */
+  counter_t pf_useless;		/* prefetched blocks evicted before any use */
+  counter_t pf_pollution;	/* regular misses to blocks a prefetch evicted */
+
+  /* pollution filter, one bit per block frame hashed by block address, set
+     when a prefetch evicts a block, cleared when the block is filled again */
+  word_t *pf_filter;
+  md_addr_t pf_filter_mask;
+
+  counter_t mshr_merges;	/* accesses merged into an outstanding miss */
+  counter_t mshr_full;		/* demand misses that waited for an MSHR */
+  counter_t mshr_wait;		/* cycles demand misses waited for an MSHR */
+  counter_t pfq_issued;		/* queued prefetches sent to the cache */
+  counter_t pfq_dropped;	/* prefetches dropped on a full queue */
+  counter_t sb_hits;		/* demand misses supplied by a stream buffer */
+  counter_t sb_allocs;		/* stream buffers (re)allocated on a miss */
+  counter_t sb_fetches;		/* blocks fetched into stream buffers */
+  counter_t distant_fills;	/* RRIP fills predicted not to be reused */
+  counter_t miss_compulsory;	/* first references to a block */
+  counter_t miss_capacity;	/* misses of a fully associative cache too */
+  counter_t miss_conflict;	/* the other misses */
+
 
 
   /* last block to hit, used to optimize cache hit processing */
   md_addr_t last_tagset;	/* tag of last line accessed */
   struct cache_blk_t *last_blk;	/* cache block last accessed */
+  int last_way;			/* its way */
 
   /* data blocks */
   byte_t *data;			/* pointer to data blocks allocation */
+  md_addr_t *tags;		/* pointer to tags allocation */
+  half_t *ages;			/* pointer to ages allocation */
 
   /* NOTE: this is a variable-size tail array, this must be the LAST field
      defined in this structure! */
@@ -239,7 +411,57 @@ cache_create(char *name,		/* name of the cache */
 					   struct cache_blk_t *blk,
 					   tick_t now, int prefetch),
 	     unsigned int hit_latency,/* latency in cycles for a hit */
-	     int prefetch_type);      /* the type of the prefetcher for this cache */	
+	     char *prefetch);		/* prefetcher, "<name>[:<arg>]" or "none" */
+
+/* free a cache, its blocks and its prefetcher state */
+void
+cache_free(struct cache_t *cp);		/* cache instance to free */
+
+/* make cache CP non-blocking: at most NMSHRS block fills are outstanding
+   (0 for no limit), a demand miss waits for a free MSHR and an access to a
+   block that is still being filled merges with its fill; prefetches wait
+   in a PFQ_SIZE-entry queue (0 to issue them at once, as demand misses do)
+   and are issued only when an MSHR and the bus are free, prefetches that
+   find the queue full are dropped */
+void
+cache_set_mshrs(struct cache_t *cp,	/* cache instance */
+		int nmshrs,		/* number of MSHRs, 0 for unlimited */
+		int pfq_size);		/* prefetch queue entries */
+
+/* give cache CP NSBUFS stream buffers of DEPTH blocks each: a demand miss
+   that no stream buffer holds reallocates the least recently used buffer
+   to the DEPTH blocks following it, a demand miss that a buffer holds is
+   supplied by it as soon as the block arrives, and the buffer fetches
+   further down the stream to stay DEPTH blocks full; the buffers are
+   checked alongside the cache, blocks are fetched without BLK (NULL), so
+   the cache must not allocate block data */
+void
+cache_set_sbufs(struct cache_t *cp,	/* cache instance */
+		int nsbufs,		/* number of stream buffers, 0 for none */
+		int depth);		/* blocks per stream buffer */
+
+/* analyze the regular references to cache CP by their LRU stack distance,
+   which gives in one pass the misses of every LRU cache of its block size
+   with 1, 2, 4, .. MAX_SETS sets and 1, 2, 4, .. MAX_ASSOC ways, and of a
+   fully associative LRU cache of any size; MAX_SETS 0 for no analysis */
+void
+cache_set_mrc(struct cache_t *cp,	/* cache instance */
+	      int max_sets,		/* largest set count, 0 for none */
+	      int max_assoc);		/* largest associativity */
+
+/* classify the regular misses of cache CP as compulsory (first reference
+   to the block), capacity (a fully associative LRU cache of the same size
+   misses too) or conflict (the rest), if ON is non-zero, the counts are
+   registered with the cache's statistics */
+void
+cache_set_3c(struct cache_t *cp,	/* cache instance */
+	     int on);			/* non-zero to classify misses */
+
+/* print the miss ratio curves of the stack distance analysis of cache CP,
+   if it has one */
+void
+cache_mrc_print(struct cache_t *cp,	/* cache instance */
+		FILE *stream);		/* output stream */
 
 /* parse policy */
 enum cache_policy			/* replacement policy enum */
@@ -263,19 +485,78 @@ cache_stats(struct cache_t *cp,		/* cache instance */
 /* print cache stats */
 void cache_stats(struct cache_t *cp, FILE *stream);
 
-/* figure out what type of prefetcher is used by this cache and
-   call the appropriate function to generate the prefetch (e.g., next_line_prefetcher) */
+/* register prefetcher PF, making it selectable by name at cache_create(),
+   the built-in prefetchers are "nextline", "stride:<RPT entries>",
+   "openended", "ghb[:<GHB entries>]", "bo[:<RR entries>]" and
+   "sms[:<PHT entries>]" */
+void
+cache_reg_prefetcher(struct cache_prefetcher_t *pf);	/* prefetcher to add */
 
-void generate_prefetch(struct cache_t *cp, md_addr_t addr);
+/* find the prefetcher registered as NAME, returns NULL if there is none */
+struct cache_prefetcher_t *		/* prefetcher, or NULL */
+cache_find_prefetcher(char *name);	/* prefetcher name */
 
-/* Next Line Prefetcher */
-void next_line_prefetcher(struct cache_t *cp, md_addr_t addr);
+/* print the names of all registered prefetchers, `|' separated */
+void
+cache_print_prefetchers(FILE *stream);	/* output stream */
+
+/* throttle the prefetches of cache CP by their accuracy, lateness and
+   pollution, sampled every INTERVAL evictions (0 for no throttling); at the
+   end of every interval the prefetch distance and degree step up or down
+   one aggressiveness level, below the lowest level prefetching is turned
+   off for a few intervals */
+void
+cache_set_fdp(struct cache_t *cp,	/* cache instance */
+	      int interval);		/* evictions per interval */
+
+/* set how far ahead (DISTANCE strides) and how many blocks (DEGREE) the
+   prefetcher of cache CP requests per trigger, the default is one block
+   one stride ahead; prefetch throttling, if any, overrides them */
+void
+cache_set_pf_distance(struct cache_t *cp,	/* cache instance */
+		      int distance,		/* strides ahead, >= 1 */
+		      int degree);		/* blocks per trigger, >= 1 */
+
+/* let the prefetcher of cache CP, if any, observe a regular access to ADDR
+   at time NOW, then issue what the prefetch queue allows */
+void generate_prefetch(struct cache_t *cp, md_addr_t addr, tick_t now);
 
-/* Stride Prefetcher */
-void stride_prefetcher(struct cache_t *cp, md_addr_t addr);
+/* request a prefetch of the block containing ADDR into cache CP at time NOW,
+   through the prefetch queue if the cache has one */
+void
+cache_prefetch(struct cache_t *cp,	/* cache instance */
+	       md_addr_t addr,		/* address to prefetch */
+	       tick_t now);		/* time of the request */
+
+/* request prefetches of the blocks containing ADDRS[0..N-1] into cache CP
+   at time NOW, as cache_prefetch() does for each; a block is filled with
+   a single tag lookup and the fill leaves the last block to hit, which
+   speeds up regular accesses, alone */
+void
+cache_prefetch_blocks(struct cache_t *cp,	/* cache instance */
+		      md_addr_t *addrs,		/* addresses to prefetch */
+		      int n,			/* number of addresses */
+		      tick_t now);		/* time of the requests */
+
+/* request prefetches of the blocks STRIDE, 2*STRIDE, ... bytes from ADDR
+   into cache CP at time NOW, starting CP->PF_DISTANCE strides ahead and
+   requesting CP->PF_DEGREE blocks */
+void
+cache_prefetch_stride(struct cache_t *cp,	/* cache instance */
+		      md_addr_t addr,		/* address accessed */
+		      int stride,		/* stride in bytes */
+		      tick_t now);		/* time of the request */
+
+/* issue queued prefetches of cache CP while an MSHR and the bus are free at
+   time NOW; simulators may call this every cycle, cache_access() calls it
+   after every regular access */
+void
+cache_issue_prefetches(struct cache_t *cp,	/* cache instance */
+		       tick_t now);		/* current time */
 
-/* Opend Ended Prefetcher */
-void open_ended_prefetcher(struct cache_t *cp, md_addr_t addr);
+/* PC of the instruction accessing the caches, for PC-indexed prefetchers
+   and SHiP; supplied by the simulator */
+extern md_addr_t get_PC(void);
 
 /* access a cache, perform a CMD operation on cache CP at address ADDR,
    places NBYTES of data at *P, returns latency of operation if initiated
@@ -320,6 +601,12 @@ unsigned int				/* latency of the flush operation */
 cache_flush(struct cache_t *cp,		/* cache instance to flush */
 	    tick_t now);		/* time of cache flush */
 
+/* reset cache CP for a new simulation starting at time 0: invalidate all
+   blocks without writing them back and forget all timing, prefetcher and
+   replacement state; the statistics are kept */
+void
+cache_reset(struct cache_t *cp);	/* cache instance to reset */
+
 /* flush the block containing ADDR from the cache CP, returns the latency of
    the block flush operation */
 unsigned int				/* latency of flush operation */
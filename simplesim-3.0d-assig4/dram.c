@@ -0,0 +1,390 @@
+/* dram.c - banked DRAM timing model routines */
+
+/*
+ * The DRAM keeps no queue of its own: every access is timed when it is
+ * made, from the state its bank and channel were left in by the accesses
+ * before it.  See dram.h for the organization and the scheduling policy.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "misc.h"
+#include "machine.h"
+#include "memory.h"
+#include "stats.h"
+#include "dram.h"
+
+/* initial number of bursts a channel can keep reserved, grows on demand */
+#define DRAM_BURSTS		64
+
+/* the bank of CHANNEL, RANK, BANK */
+#define DRAM_BANK(dram, channel, rank, bank)				\
+  (&(dram)->banks[((channel)*(dram)->nranks + (rank))*(dram)->nbanks + (bank)])
+
+/* create a DRAM of NCHANNELS channels of NRANKS ranks of NBANKS banks,
+   with ROW_SIZE-byte rows managed by POLICY, its timing parameters are set
+   with dram_set_timing() */
+struct dram_t *				/* DRAM created */
+dram_create(char *name,			/* name of the DRAM */
+	    int nchannels,		/* number of channels */
+	    int nranks,			/* ranks per channel */
+	    int nbanks,			/* banks per rank */
+	    int row_size,		/* bytes per row */
+	    enum dram_page_policy policy)	/* row buffer policy */
+{
+  struct dram_t *dram;
+  int i, nbanks_total;
+
+  /* check all DRAM parameters */
+  if (nchannels <= 0)
+    fatal("DRAM channels `%d' must be non-zero and positive", nchannels);
+  if (nranks <= 0)
+    fatal("DRAM ranks per channel `%d' must be non-zero and positive",
+	  nranks);
+  if (nbanks <= 0)
+    fatal("DRAM banks per rank `%d' must be non-zero and positive", nbanks);
+  if (row_size < 8 || (row_size & (row_size-1)) != 0)
+    fatal("DRAM row size (in bytes) `%d' must be a power of two, 8 or greater",
+	  row_size);
+
+  dram = (struct dram_t *)calloc(1, sizeof(struct dram_t));
+  if (!dram)
+    fatal("out of virtual memory");
+
+  dram->name = mystrdup(name);
+  dram->nchannels = nchannels;
+  dram->nranks = nranks;
+  dram->nbanks = nbanks;
+  dram->row_size = row_size;
+  dram->policy = policy;
+
+  /* all banks start precharged */
+  nbanks_total = nchannels * nranks * nbanks;
+  dram->banks =
+    (struct dram_bank_t *)calloc(nbanks_total, sizeof(struct dram_bank_t));
+  if (!dram->banks)
+    fatal("out of virtual memory");
+  for (i = 0; i < nbanks_total; i++)
+    dram->banks[i].open_row = -1;
+
+  dram->channels =
+    (struct dram_channel_t *)calloc(nchannels, sizeof(struct dram_channel_t));
+  if (!dram->channels)
+    fatal("out of virtual memory");
+  for (i = 0; i < nchannels; i++)
+    {
+      dram->channels[i].size = DRAM_BURSTS;
+      dram->channels[i].bus_start =
+	(tick_t *)calloc(DRAM_BURSTS, sizeof(tick_t));
+      dram->channels[i].bus_end =
+	(tick_t *)calloc(DRAM_BURSTS, sizeof(tick_t));
+      if (!dram->channels[i].bus_start || !dram->channels[i].bus_end)
+	fatal("out of virtual memory");
+    }
+
+  /* one cycle per byte until the timing is set */
+  dram->bus_width = 1;
+  dram->t_chunk = 1;
+
+  return dram;
+}
+
+/* set the timing of DRAM: the core timing parameters, the refresh interval
+   and duration (T_REFI 0 for none), and the data bus, BUS_WIDTH bytes every
+   T_CHUNK cycles; all in cycles */
+void
+dram_set_timing(struct dram_t *dram,	/* DRAM instance */
+		int t_rcd,		/* activate to column access */
+		int t_cas,		/* column access to data */
+		int t_rp,		/* precharge to activate */
+		int t_ras,		/* activate to precharge */
+		int t_refi,		/* refresh interval */
+		int t_rfc,		/* refresh duration */
+		int bus_width,		/* data bus width in bytes */
+		int t_chunk)		/* cycles per bus-width chunk */
+{
+  if (t_rcd < 0 || t_cas < 0 || t_rp < 0 || t_ras < 0)
+    fatal("DRAM timing parameters must be positive");
+  if (t_refi < 0 || t_rfc < 0)
+    fatal("DRAM refresh interval and duration must be positive");
+  if (t_refi > 0 && t_rfc >= t_refi)
+    fatal("DRAM refresh duration `%d' must be less than its interval `%d'",
+	  t_rfc, t_refi);
+  if (bus_width <= 0)
+    fatal("DRAM bus width `%d' must be non-zero and positive", bus_width);
+  if (t_chunk <= 0)
+    fatal("DRAM cycles per chunk `%d' must be non-zero and positive",
+	  t_chunk);
+
+  dram->t_rcd = t_rcd;
+  dram->t_cas = t_cas;
+  dram->t_rp = t_rp;
+  dram->t_ras = t_ras;
+  dram->t_refi = t_refi;
+  dram->t_rfc = t_rfc;
+  dram->bus_width = bus_width;
+  dram->t_chunk = t_chunk;
+}
+
+/* free DRAM */
+void
+dram_free(struct dram_t *dram)		/* DRAM instance */
+{
+  int i;
+
+  for (i = 0; i < dram->nchannels; i++)
+    {
+      free(dram->channels[i].bus_start);
+      free(dram->channels[i].bus_end);
+    }
+  free(dram->channels);
+  free(dram->banks);
+  free(dram->name);
+  free(dram);
+}
+
+/* parse a row buffer policy, 'o' for open page or 'c' for closed page */
+enum dram_page_policy			/* row buffer policy */
+dram_char2policy(char c)		/* policy as a char */
+{
+  switch (c) {
+  case 'o': return Open_page;
+  case 'c': return Closed_page;
+  default: fatal("bogus DRAM page policy, `%c'", c);
+  }
+}
+
+/* print the DRAM configuration */
+void
+dram_config(struct dram_t *dram,	/* DRAM instance */
+	    FILE *stream)		/* output stream */
+{
+  fprintf(stream,
+	  "dram: %s: %d channels, %d ranks/channel, %d banks/rank, "
+	  "%d byte rows, %s page\n",
+	  dram->name, dram->nchannels, dram->nranks, dram->nbanks,
+	  dram->row_size, dram->policy == Open_page ? "open" : "closed");
+  fprintf(stream,
+	  "dram: %s: tRCD %d, tCAS %d, tRP %d, tRAS %d, "
+	  "tREFI %d, tRFC %d, %d bytes/%d cycles\n",
+	  dram->name, dram->t_rcd, dram->t_cas, dram->t_rp, dram->t_ras,
+	  dram->t_refi, dram->t_rfc, dram->bus_width, dram->t_chunk);
+}
+
+/* register the DRAM stats */
+void
+dram_reg_stats(struct dram_t *dram,	/* DRAM instance */
+	       struct stat_sdb_t *sdb)	/* stats database */
+{
+  char buf[512], buf1[512], *name;
+
+  /* get a name for this DRAM */
+  if (!dram->name || !dram->name[0])
+    name = "<unknown>";
+  else
+    name = dram->name;
+
+  sprintf(buf, "%s.accesses", name);
+  sprintf(buf1, "%s.reads + %s.writes", name, name);
+  stat_reg_formula(sdb, buf, "total number of accesses", buf1, "%12.0f");
+  sprintf(buf, "%s.reads", name);
+  stat_reg_counter(sdb, buf, "total number of block reads",
+		   &dram->reads, 0, NULL);
+  sprintf(buf, "%s.writes", name);
+  stat_reg_counter(sdb, buf, "total number of block writes",
+		   &dram->writes, 0, NULL);
+  sprintf(buf, "%s.row_hits", name);
+  stat_reg_counter(sdb, buf, "total number of row buffer hits",
+		   &dram->row_hits, 0, NULL);
+  sprintf(buf, "%s.row_misses", name);
+  stat_reg_counter(sdb, buf, "total number of accesses to precharged banks",
+		   &dram->row_misses, 0, NULL);
+  sprintf(buf, "%s.row_conflicts", name);
+  stat_reg_counter(sdb, buf, "total number of row buffer conflicts",
+		   &dram->row_conflicts, 0, NULL);
+  sprintf(buf, "%s.row_hit_rate", name);
+  sprintf(buf1, "%s.row_hits / %s.accesses", name, name);
+  stat_reg_formula(sdb, buf, "row buffer hit rate (i.e., hits/ref)",
+		   buf1, NULL);
+  sprintf(buf, "%s.read_lat", name);
+  stat_reg_counter(sdb, buf, "total cycles of all block reads",
+		   &dram->read_lat, 0, NULL);
+  sprintf(buf, "%s.avg_read_lat", name);
+  sprintf(buf1, "%s.read_lat / %s.reads", name, name);
+  stat_reg_formula(sdb, buf, "average block read latency (in cycles)",
+		   buf1, NULL);
+  sprintf(buf, "%s.bank_wait", name);
+  stat_reg_counter(sdb, buf, "total cycles accesses waited for a busy bank",
+		   &dram->bank_wait, 0, NULL);
+  sprintf(buf, "%s.refresh_wait", name);
+  stat_reg_counter(sdb, buf, "total cycles accesses waited for refresh",
+		   &dram->refresh_wait, 0, NULL);
+  sprintf(buf, "%s.bus_wait", name);
+  stat_reg_counter(sdb, buf, "total cycles data waited for the bus",
+		   &dram->bus_wait, 0, NULL);
+  sprintf(buf, "%s.bus_busy", name);
+  stat_reg_counter(sdb, buf, "total cycles of data transfers, all channels",
+		   &dram->bus_busy, 0, NULL);
+}
+
+/* reserve LEN cycles on the data bus of CHANNEL, in the earliest free
+   slot starting at READY or later, returns the start of the slot */
+static tick_t				/* start of the burst */
+bus_reserve(struct dram_channel_t *channel,	/* channel */
+	    tick_t ready,		/* earliest start */
+	    tick_t now,			/* time of the access */
+	    int len)			/* cycles of the burst */
+{
+  tick_t start = ready;
+  int i, j;
+
+  /* bursts done by the time of the access can be forgotten, accesses are
+     made in (close to) time order */
+  for (i = 0; i < channel->nbursts && channel->bus_end[i] <= now; i++)
+    /* nada */;
+  if (i > 0)
+    {
+      memmove(channel->bus_start, channel->bus_start + i,
+	      (channel->nbursts - i) * sizeof(tick_t));
+      memmove(channel->bus_end, channel->bus_end + i,
+	      (channel->nbursts - i) * sizeof(tick_t));
+      channel->nbursts -= i;
+    }
+
+  /* find the first gap long enough */
+  for (i = 0; i < channel->nbursts; i++)
+    {
+      if (channel->bus_end[i] <= start)
+	continue;
+      if (channel->bus_start[i] >= start + len)
+	break;
+      start = channel->bus_end[i];
+    }
+
+  /* insert the burst before burst I */
+  if (channel->nbursts == channel->size)
+    {
+      channel->size *= 2;
+      channel->bus_start = (tick_t *)
+	realloc(channel->bus_start, channel->size * sizeof(tick_t));
+      channel->bus_end = (tick_t *)
+	realloc(channel->bus_end, channel->size * sizeof(tick_t));
+      if (!channel->bus_start || !channel->bus_end)
+	fatal("out of virtual memory");
+    }
+  for (j = channel->nbursts; j > i; j--)
+    {
+      channel->bus_start[j] = channel->bus_start[j-1];
+      channel->bus_end[j] = channel->bus_end[j-1];
+    }
+  channel->bus_start[i] = start;
+  channel->bus_end[i] = start + len;
+  channel->nbursts++;
+
+  return start;
+}
+
+/* access the BSIZE-byte block at BADDR in DRAM at time NOW, returns the
+   cycles until all of its data has crossed the bus; writes take the bank
+   and the bus as reads do, callers with write buffers may ignore their
+   latency */
+unsigned int				/* latency of the access */
+dram_access(struct dram_t *dram,	/* DRAM instance */
+	    enum mem_cmd cmd,		/* Read or Write */
+	    md_addr_t baddr,		/* block address */
+	    int bsize,			/* block size */
+	    tick_t now)			/* time of the access */
+{
+  struct dram_bank_t *bank;
+  md_addr_t line, offset;
+  int channel, rank, row, len;
+  tick_t t, col, start, done;
+
+  /* map the block: <row:rank:bank:column:channel> */
+  line = baddr / bsize;
+  channel = line % dram->nchannels;
+  offset = (line / dram->nchannels) * bsize / dram->row_size;
+  rank = (offset / dram->nbanks) % dram->nranks;
+  row = offset / dram->nbanks / dram->nranks;
+  bank = DRAM_BANK(dram, channel, rank, offset % dram->nbanks);
+
+  /* wait for the bank */
+  t = MAX(now, bank->ready);
+  dram->bank_wait += t - now;
+
+  /* each rank is refreshed every tREFI cycles, the ranks of a channel in
+     turn; a refresh closes the rows of the rank, and an access in the
+     middle of one waits for its end */
+  if (dram->t_refi > 0)
+    {
+      tick_t first = dram->t_refi + (tick_t)rank * dram->t_refi / dram->nranks;
+
+      if (t >= first)
+	{
+	  counter_t epoch = (t - first) / dram->t_refi + 1;
+	  tick_t phase = (t - first) % dram->t_refi;
+
+	  if (phase < dram->t_rfc)
+	    {
+	      dram->refresh_wait += dram->t_rfc - phase;
+	      t += dram->t_rfc - phase;
+	    }
+	  if (epoch > bank->refresh_epoch)
+	    {
+	      bank->open_row = -1;
+	      bank->refresh_epoch = epoch;
+	    }
+	}
+    }
+
+  /* open the row, if needed */
+  if (bank->open_row == row)
+    {
+      dram->row_hits++;
+      col = t;
+    }
+  else if (bank->open_row == -1)
+    {
+      dram->row_misses++;
+      bank->act_time = t;
+      col = t + dram->t_rcd;
+    }
+  else
+    {
+      dram->row_conflicts++;
+      bank->act_time = MAX(t, bank->act_time + dram->t_ras) + dram->t_rp;
+      col = bank->act_time + dram->t_rcd;
+    }
+
+  /* move the data on the first free slot of the channel bus */
+  len = ((bsize + dram->bus_width - 1) / dram->bus_width) * dram->t_chunk;
+  start = bus_reserve(&dram->channels[channel], col + dram->t_cas, now, len);
+  done = start + len;
+  dram->bus_wait += start - (col + dram->t_cas);
+  dram->bus_busy += len;
+
+  /* leave the row open for the next access, or precharge it */
+  if (dram->policy == Open_page)
+    {
+      bank->open_row = row;
+      bank->ready = done - dram->t_cas;
+    }
+  else
+    {
+      bank->open_row = -1;
+      bank->ready = MAX(done, bank->act_time + dram->t_ras) + dram->t_rp;
+    }
+
+  if (cmd == Read)
+    {
+      dram->reads++;
+      dram->read_lat += done - now;
+    }
+  else
+    dram->writes++;
+
+  return (unsigned int)(done - now);
+}
@@ -0,0 +1,154 @@
+/* dram.h - banked DRAM timing model interfaces */
+
+#ifndef DRAM_H
+#define DRAM_H
+
+#include <stdio.h>
+
+#include "host.h"
+#include "misc.h"
+#include "machine.h"
+#include "memory.h"
+#include "stats.h"
+
+/*
+ * This module times the block accesses that miss in the last level cache
+ * on a DRAM of one or more channels, each with its own data bus and ranks
+ * of banks.  Every bank keeps a row buffer, left open after an access
+ * (open page) or closed right away (closed page), so an access is a row
+ * hit (column access only), a row miss on a precharged bank (activate,
+ * then column access) or a row conflict (precharge, activate, then column
+ * access), timed by tRCD, tCAS, tRP and tRAS.  Every rank is refreshed
+ * every tREFI cycles for tRFC cycles, a refresh closes all its rows.
+ *
+ * Like the cache module, the DRAM must return the latency of an access as
+ * soon as it is made, so the latency of an access cannot be affected by a
+ * later one.  Within a bank accesses are served in order, but the data bus
+ * of a channel is kept as a list of reserved bursts, so an access whose
+ * data is ready first (e.g., a row hit in another bank) takes the earliest
+ * free slot on the bus, even ahead of older accesses still waiting for
+ * their rows: first ready, first come first served (FR-FCFS) as far as
+ * accesses timed on arrival allow.
+ *
+ * Blocks are interleaved across channels, then fill a row of a bank before
+ * moving to the next bank, rank and row: <row:rank:bank:column:channel>.
+ */
+
+/* row buffer management */
+enum dram_page_policy {
+  Open_page,		/* leave the row open for later row hits */
+  Closed_page		/* precharge right after every access */
+};
+
+/* one bank: its row buffer and when it can take the next command */
+struct dram_bank_t
+{
+  int open_row;			/* row in the row buffer, -1 if precharged */
+  tick_t ready;			/* time the bank can take the next command */
+  tick_t act_time;		/* time of the last activate, for tRAS */
+  counter_t refresh_epoch;	/* refresh interval of the last access */
+};
+
+/* one channel: the bursts reserved on its data bus */
+struct dram_channel_t
+{
+  tick_t *bus_start;		/* reserved bursts in time order, start ... */
+  tick_t *bus_end;		/* ... and end of each */
+  int nbursts;			/* number of reserved bursts */
+  int size;			/* bursts the arrays can hold */
+};
+
+/* DRAM definition */
+struct dram_t
+{
+  /* organization */
+  char *name;			/* DRAM name */
+  int nchannels;		/* number of channels */
+  int nranks;			/* ranks per channel */
+  int nbanks;			/* banks per rank */
+  int row_size;			/* bytes per row of a bank */
+  enum dram_page_policy policy;	/* row buffer policy */
+
+  /* timing, in cycles */
+  int t_rcd;			/* activate to column access */
+  int t_cas;			/* column access to first data */
+  int t_rp;			/* precharge to activate */
+  int t_ras;			/* activate to precharge, at least */
+  int t_refi;			/* refresh interval, 0 for no refresh */
+  int t_rfc;			/* refresh duration */
+  int bus_width;		/* data bus width in bytes */
+  int t_chunk;			/* cycles per bus-width chunk of data */
+
+  /* state */
+  struct dram_bank_t *banks;	/* all banks, channel by channel, rank by
+				   rank */
+  struct dram_channel_t *channels;	/* all channels */
+
+  /* stats */
+  counter_t reads;		/* block reads */
+  counter_t writes;		/* block writes (writebacks) */
+  counter_t row_hits;		/* accesses to the open row */
+  counter_t row_misses;		/* accesses to a precharged bank */
+  counter_t row_conflicts;	/* accesses to a bank with another row open */
+  counter_t read_lat;		/* total cycles of all reads */
+  counter_t bank_wait;		/* total cycles accesses waited for a bank */
+  counter_t bus_wait;		/* total cycles data waited for the bus */
+  counter_t refresh_wait;	/* total cycles accesses waited for refresh */
+  counter_t bus_busy;		/* total cycles of data bursts */
+};
+
+/* create a DRAM of NCHANNELS channels of NRANKS ranks of NBANKS banks,
+   with ROW_SIZE-byte rows managed by POLICY, its timing parameters are set
+   with dram_set_timing() */
+struct dram_t *				/* DRAM created */
+dram_create(char *name,			/* name of the DRAM */
+	    int nchannels,		/* number of channels */
+	    int nranks,			/* ranks per channel */
+	    int nbanks,			/* banks per rank */
+	    int row_size,		/* bytes per row */
+	    enum dram_page_policy policy);	/* row buffer policy */
+
+/* set the timing of DRAM: the core timing parameters, the refresh interval
+   and duration (T_REFI 0 for none), and the data bus, BUS_WIDTH bytes every
+   T_CHUNK cycles; all in cycles */
+void
+dram_set_timing(struct dram_t *dram,	/* DRAM instance */
+		int t_rcd,		/* activate to column access */
+		int t_cas,		/* column access to data */
+		int t_rp,		/* precharge to activate */
+		int t_ras,		/* activate to precharge */
+		int t_refi,		/* refresh interval */
+		int t_rfc,		/* refresh duration */
+		int bus_width,		/* data bus width in bytes */
+		int t_chunk);		/* cycles per bus-width chunk */
+
+/* free DRAM */
+void
+dram_free(struct dram_t *dram);		/* DRAM instance */
+
+/* parse a row buffer policy, 'o' for open page or 'c' for closed page */
+enum dram_page_policy			/* row buffer policy */
+dram_char2policy(char c);		/* policy as a char */
+
+/* print the DRAM configuration */
+void
+dram_config(struct dram_t *dram,	/* DRAM instance */
+	    FILE *stream);		/* output stream */
+
+/* register the DRAM stats */
+void
+dram_reg_stats(struct dram_t *dram,	/* DRAM instance */
+	       struct stat_sdb_t *sdb);	/* stats database */
+
+/* access the BSIZE-byte block at BADDR in DRAM at time NOW, returns the
+   cycles until all of its data has crossed the bus; writes take the bank
+   and the bus as reads do, callers with write buffers may ignore their
+   latency */
+unsigned int				/* latency of the access */
+dram_access(struct dram_t *dram,	/* DRAM instance */
+	    enum mem_cmd cmd,		/* Read or Write */
+	    md_addr_t baddr,		/* block address */
+	    int bsize,			/* block size */
+	    tick_t now);		/* time of the access */
+
+#endif /* DRAM_H */
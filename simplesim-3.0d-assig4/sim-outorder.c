@@ -61,6 +61,7 @@
 #include "regs.h"
 #include "memory.h"
 #include "cache.h"
+#include "dram.h"
 #include "loader.h"
 #include "syscall.h"
 #include "bpred.h"
@@ -101,6 +102,10 @@ static int fastfwd_count;
 static int ptrace_nelt = 0;
 static char *ptrace_opts[2];
 
+/* interval IPC trace output filename and instructions per interval */
+static char *ipc_fname = NULL;
+static int ipc_interval;
+
 /* instruction fetch queue size (in insts) */
 static int ruu_ifq_size;
 
@@ -163,12 +168,62 @@ static char *cache_dl1_opt;
 /* l1 data cache hit latency (in cycles) */
 static int cache_dl1_lat;
 
+/* l1 data cache prefetcher, i.e., {<name>[:<arg>]|none} */
+static char *cache_dl1_prefetch;
+
+/* l1 data cache MSHRs and prefetch queue entries (0 for unlimited/none) */
+static int cache_dl1_mshr;
+static int cache_dl1_pfq;
+
+/* l1 data cache prefetch throttling interval (in evictions, 0 for none) */
+static int cache_dl1_fdp;
+
+/* l1 data cache prefetch distance and degree (<distance> <degree>) */
+static int cache_dl1_pfdist_nelt = 2;
+static int cache_dl1_pfdist[2] =
+  { /* distance */1, /* degree */1 };
+
+/* l1 data cache stream buffers (<buffers> <depth>) */
+static int cache_dl1_sbuf_nelt = 2;
+static int cache_dl1_sbuf[2] =
+  { /* buffers */0, /* depth */4 };
+
+/* l1 data cache stack distance analysis (<max sets> <max assoc>) */
+static int cache_dl1_mrc_nelt = 2;
+static int cache_dl1_mrc[2] =
+  { /* max sets */0, /* max assoc */16 };
+
 /* l2 data cache config, i.e., {<config>|none} */
 static char *cache_dl2_opt;
 
 /* l2 data cache hit latency (in cycles) */
 static int cache_dl2_lat;
 
+/* l2 data cache prefetcher, i.e., {<name>[:<arg>]|none} */
+static char *cache_dl2_prefetch;
+
+/* l2 data cache MSHRs and prefetch queue entries (0 for unlimited/none) */
+static int cache_dl2_mshr;
+static int cache_dl2_pfq;
+
+/* l2 data cache prefetch throttling interval (in evictions, 0 for none) */
+static int cache_dl2_fdp;
+
+/* l2 data cache prefetch distance and degree (<distance> <degree>) */
+static int cache_dl2_pfdist_nelt = 2;
+static int cache_dl2_pfdist[2] =
+  { /* distance */1, /* degree */1 };
+
+/* l2 data cache stream buffers (<buffers> <depth>) */
+static int cache_dl2_sbuf_nelt = 2;
+static int cache_dl2_sbuf[2] =
+  { /* buffers */0, /* depth */4 };
+
+/* l2 data cache stack distance analysis (<max sets> <max assoc>) */
+static int cache_dl2_mrc_nelt = 2;
+static int cache_dl2_mrc[2] =
+  { /* max sets */0, /* max assoc */16 };
+
 /* l1 instruction cache config, i.e., {<config>|dl1|dl2|none} */
 static char *cache_il1_opt;
 
@@ -187,6 +242,9 @@ static int flush_on_syscalls;
 /* convert 64-bit inst addresses to 32-bit inst equivalents */
 static int compress_icache_addrs;
 
+/* classify cache misses as compulsory, capacity or conflict */
+static int cache_3c;
+
 /* memory access latency (<first_chunk> <inter_chunk>) */
 static int mem_nelt = 2;
 static int mem_lat[2] =
@@ -195,6 +253,22 @@ static int mem_lat[2] =
 /* memory access bus width (in bytes) */
 static int mem_bus_width;
 
+/* DRAM config, i.e., {<config>|none} */
+static char *dram_opt;
+
+/* DRAM timing (<tRCD> <tCAS> <tRP> <tRAS>) */
+static int dram_time_nelt = 4;
+static int dram_time[4] =
+  { /* tRCD */40, /* tCAS */40, /* tRP */40, /* tRAS */100 };
+
+/* DRAM refresh (<tREFI> <tRFC>) */
+static int dram_refresh_nelt = 2;
+static int dram_refresh[2] =
+  { /* interval */23400, /* duration */780 };
+
+/* DRAM behind the last level caches, NULL for the fixed latency model */
+static struct dram_t *dram = NULL;
+
 /* instruction TLB config, i.e., {<config>|none} */
 static char *itlb_opt;
 
@@ -306,6 +380,10 @@ struct res_desc fu_config[] = {
 /* SLIP variable */
 static counter_t sim_slip = 0;
 
+/* total number of instructions committed, and the interval IPC trace */
+static counter_t sim_num_committed = 0;
+static FILE *ipc_fd = NULL;
+
 /* total number of instructions executed */
 static counter_t sim_total_insn = 0;
 
@@ -385,6 +463,19 @@ static struct cache_t *itlb;
 /* data TLB */
 static struct cache_t *dtlb;
 
+/* PC of the instruction accessing the caches and TLBs: the fetched
+   instruction on the I-side, the load or store on the D-side; the level 2
+   caches are accessed from the level 1 miss handlers, so they see the PC
+   of the access that missed */
+static md_addr_t cache_access_PC = 0;
+
+/* current PC as seen by the cache module's PC-indexed prefetchers and SHiP */
+md_addr_t
+get_PC(void)
+{
+  return cache_access_PC;
+}
+
 /* branch predictor */
 static struct bpred_t *pred;
 
@@ -407,14 +498,21 @@ static struct stat_stat_t *pcstat_sdists[MAX_PCSTAT_VARS];
 	 : (panic("bad stat class"), 0))))
 
 
-/* memory access latency, assumed to not cross a page boundary */
+/* memory access latency, assumed to not cross a page boundary; the DRAM
+   model, if any, times writes as well, for the bank and bus time they take */
 static unsigned int			/* total latency of access */
-mem_access_latency(int blk_sz)		/* block size accessed */
+mem_access_latency(enum mem_cmd cmd,	/* Read or Write */
+		   md_addr_t baddr,	/* block address accessed */
+		   int blk_sz,		/* block size accessed */
+		   tick_t now)		/* time of access */
 {
   int chunks = (blk_sz + (mem_bus_width - 1)) / mem_bus_width;
 
   assert(chunks > 0);
 
+  if (dram)
+    return dram_access(dram, cmd, baddr, blk_sz, now);
+
   return (/* first chunk latency */mem_lat[0] +
 	  (/* remainder chunk latency */mem_lat[1] * (chunks - 1)));
 }
@@ -430,7 +528,8 @@ dl1_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
 	      md_addr_t baddr,		/* block address to access */
 	      int bsize,		/* size of block to access */
 	      struct cache_blk_t *blk,	/* ptr to block in upper level */
-	      tick_t now)		/* time of access */
+	      tick_t now,		/* time of access */
+	      int prefetch)		/* 1 if the access is a prefetch */
 {
   unsigned int lat;
 
@@ -438,7 +537,8 @@ dl1_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
     {
       /* access next level of data cache hierarchy */
       lat = cache_access(cache_dl2, cmd, baddr, NULL, bsize,
-			 /* now */now, /* pudata */NULL, /* repl addr */NULL);
+			 /* now */now, /* pudata */NULL, /* repl addr */NULL,
+			 prefetch);
       if (cmd == Read)
 	return lat;
       else
@@ -450,8 +550,9 @@ dl1_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
   else
     {
       /* access main memory */
+      lat = mem_access_latency(cmd, baddr, bsize, now);
       if (cmd == Read)
-	return mem_access_latency(bsize);
+	return lat;
       else
 	{
 	  /* FIXME: unlimited write buffers */
@@ -466,11 +567,15 @@ dl2_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
 	      md_addr_t baddr,		/* block address to access */
 	      int bsize,		/* size of block to access */
 	      struct cache_blk_t *blk,	/* ptr to block in upper level */
-	      tick_t now)		/* time of access */
+	      tick_t now,		/* time of access */
+	      int prefetch)		/* 1 if the access is a prefetch */
 {
+  unsigned int lat;
+
   /* this is a miss to the lowest level, so access main memory */
+  lat = mem_access_latency(cmd, baddr, bsize, now);
   if (cmd == Read)
-    return mem_access_latency(bsize);
+    return lat;
   else
     {
       /* FIXME: unlimited write buffers */
@@ -484,7 +589,8 @@ il1_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
 	      md_addr_t baddr,		/* block address to access */
 	      int bsize,		/* size of block to access */
 	      struct cache_blk_t *blk,	/* ptr to block in upper level */
-	      tick_t now)		/* time of access */
+	      tick_t now,		/* time of access */
+	      int prefetch)		/* 1 if the access is a prefetch */
 {
   unsigned int lat;
 
@@ -492,7 +598,8 @@ if (cache_il2)
     {
       /* access next level of inst cache hierarchy */
       lat = cache_access(cache_il2, cmd, baddr, NULL, bsize,
-			 /* now */now, /* pudata */NULL, /* repl addr */NULL);
+			 /* now */now, /* pudata */NULL, /* repl addr */NULL,
+			 prefetch);
       if (cmd == Read)
 	return lat;
       else
@@ -502,7 +609,7 @@ if (cache_il2)
     {
       /* access main memory */
       if (cmd == Read)
-	return mem_access_latency(bsize);
+	return mem_access_latency(cmd, baddr, bsize, now);
       else
 	panic("writes to instruction memory not supported");
     }
@@ -514,11 +621,12 @@ il2_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
 	      md_addr_t baddr,		/* block address to access */
 	      int bsize,		/* size of block to access */
 	      struct cache_blk_t *blk,	/* ptr to block in upper level */
-	      tick_t now)		/* time of access */
+	      tick_t now,		/* time of access */
+	      int prefetch)		/* 1 if the access is a prefetch */
 {
   /* this is a miss to the lowest level, so access main memory */
   if (cmd == Read)
-    return mem_access_latency(bsize);
+    return mem_access_latency(cmd, baddr, bsize, now);
   else
     panic("writes to instruction memory not supported");
 }
@@ -534,7 +642,8 @@ itlb_access_fn(enum mem_cmd cmd,	/* access cmd, Read or Write */
 	       md_addr_t baddr,		/* block address to access */
 	       int bsize,		/* size of block to access */
 	       struct cache_blk_t *blk,	/* ptr to block in upper level */
-	       tick_t now)		/* time of access */
+	       tick_t now,		/* time of access */
+	       int prefetch)		/* 1 if the access is a prefetch */
 {
   md_addr_t *phy_page_ptr = (md_addr_t *)blk->user_data;
 
@@ -554,7 +663,8 @@ dtlb_access_fn(enum mem_cmd cmd,	/* access cmd, Read or Write */
 	       md_addr_t baddr,	/* block address to access */
 	       int bsize,		/* size of block to access */
 	       struct cache_blk_t *blk,	/* ptr to block in upper level */
-	       tick_t now)		/* time of access */
+	       tick_t now,		/* time of access */
+	       int prefetch)		/* 1 if the access is a prefetch */
 {
   md_addr_t *phy_page_ptr = (md_addr_t *)blk->user_data;
 
@@ -616,6 +726,15 @@ sim_reg_options(struct opt_odb_t *odb)
 "                -ptrace FOOBAR.trc @main:+278\n"
 	       );
 
+  opt_reg_string(odb, "-ipc:file",
+		 "write the cycle every -ipc:interval insts commit to this file",
+		 &ipc_fname, /* default */NULL,
+		 /* print */TRUE, /* format */NULL);
+  opt_reg_int(odb, "-ipc:interval",
+	      "committed insts per interval of the -ipc:file trace",
+	      &ipc_interval, /* default */100000,
+	      /* print */TRUE, /* format */NULL);
+
   /* ifetch options */
 
   opt_reg_int(odb, "-fetch:ifqsize", "instruction fetch queue size (in insts)",
@@ -749,7 +868,8 @@ sim_reg_options(struct opt_odb_t *odb)
 "    <nsets>  - number of sets in the cache\n"
 "    <bsize>  - block size of the cache\n"
 "    <assoc>  - associativity of the cache\n"
-"    <repl>   - block replacement strategy, 'l'-LRU, 'f'-FIFO, 'r'-random\n"
+"    <repl>   - block replacement strategy, 'l'-LRU, 'f'-FIFO, 'r'-random,\n"
+"               's'-SRRIP, 'b'-BRRIP, 'd'-DRRIP, 'h'-SHiP, 'p'-tree-PLRU\n"
 "\n"
 "    Examples:   -cache:dl1 dl1:4096:32:1:l\n"
 "                -dtlb dtlb:128:4096:32:r\n"
@@ -760,6 +880,73 @@ sim_reg_options(struct opt_odb_t *odb)
 	      &cache_dl1_lat, /* default */1,
 	      /* print */TRUE, /* format */NULL);
 
+  opt_reg_string(odb, "-cache:dl1pf",
+		 "l1 data cache prefetcher, i.e., {<name>[:<arg>]|none}",
+		 &cache_dl1_prefetch, "none",
+		 /* print */TRUE, NULL);
+
+  opt_reg_note(odb,
+"  The prefetcher of a data cache is selected by the name it is registered\n"
+"  under in the cache module, optionally followed by a numeric argument:\n"
+"\n"
+"    nextline      - prefetch the next block on every access\n"
+"    stride:<n>    - PC-indexed stride prefetcher with an <n>-entry RPT\n"
+"    openended     - stride prefetcher tracking four strides per PC\n"
+"    ghb[:<n>]     - PC/DC delta correlation over an <n>-entry global history\n"
+"                    buffer (default 256)\n"
+"    bo[:<n>]      - best-offset prefetcher learning over an <n>-entry recent\n"
+"                    requests table (default 256)\n"
+"    sms[:<n>]     - spatial memory streaming, prefetches the blocks of a 2KB\n"
+"                    region touched after the same PC and offset last time,\n"
+"                    over an <n>-entry pattern history table (default 1024)\n"
+"\n"
+"  A prefetcher requests <degree> blocks per trigger, the first <distance>\n"
+"  strides ahead (-cache:dl1pfdist), unless throttling sets them.  Stream\n"
+"  buffers (-cache:dl1sbuf) work alongside the prefetcher: every demand miss\n"
+"  that no buffer holds restarts the least recently used one at the next\n"
+"  block, which then fetches <depth> blocks down the stream.\n"
+"\n"
+"    Examples:   -cache:dl1pf stride:64 -cache:dl2pf nextline\n"
+"                -cache:dl2pf bo -cache:dl2pfdist 4 2 -cache:dl1sbuf 4 8\n"
+	       );
+
+  opt_reg_int(odb, "-cache:dl1mshr",
+	      "l1 data cache MSHRs, i.e., outstanding misses (0 for unlimited)",
+	      &cache_dl1_mshr, /* default */0,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-cache:dl1pfq",
+	      "l1 data cache prefetch queue entries (0 to prefetch at once)",
+	      &cache_dl1_pfq, /* default */0,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-cache:dl1fdp",
+	      "l1 data cache feedback-directed prefetch throttling interval "
+	      "(in evictions, 0 for none)",
+	      &cache_dl1_fdp, /* default */0,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int_list(odb, "-cache:dl1pfdist",
+		   "l1 data cache prefetch distance and degree "
+		   "(<distance> <degree>)",
+		   cache_dl1_pfdist, cache_dl1_pfdist_nelt,
+		   &cache_dl1_pfdist_nelt, /* default */cache_dl1_pfdist,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_int_list(odb, "-cache:dl1sbuf",
+		   "l1 data cache stream buffers (<buffers> <depth>, "
+		   "0 buffers for none)",
+		   cache_dl1_sbuf, cache_dl1_sbuf_nelt, &cache_dl1_sbuf_nelt,
+		   /* default */cache_dl1_sbuf,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_int_list(odb, "-cache:dl1mrc",
+		   "l1 data cache reference stream miss ratio curves "
+		   "(<max sets> <max assoc>, 0 sets for none)",
+		   cache_dl1_mrc, cache_dl1_mrc_nelt, &cache_dl1_mrc_nelt,
+		   /* default */cache_dl1_mrc,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
   opt_reg_string(odb, "-cache:dl2",
 		 "l2 data cache config, i.e., {<config>|none}",
 		 &cache_dl2_opt, "ul2:1024:64:4:l",
@@ -770,6 +957,59 @@ sim_reg_options(struct opt_odb_t *odb)
 	      &cache_dl2_lat, /* default */6,
 	      /* print */TRUE, /* format */NULL);
 
+  opt_reg_string(odb, "-cache:dl2pf",
+		 "l2 data cache prefetcher, i.e., {<name>[:<arg>]|none}",
+		 &cache_dl2_prefetch, "none",
+		 /* print */TRUE, NULL);
+
+  opt_reg_int(odb, "-cache:dl2mshr",
+	      "l2 data cache MSHRs, i.e., outstanding misses (0 for unlimited)",
+	      &cache_dl2_mshr, /* default */0,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-cache:dl2pfq",
+	      "l2 data cache prefetch queue entries (0 to prefetch at once)",
+	      &cache_dl2_pfq, /* default */0,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-cache:dl2fdp",
+	      "l2 data cache feedback-directed prefetch throttling interval "
+	      "(in evictions, 0 for none)",
+	      &cache_dl2_fdp, /* default */0,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int_list(odb, "-cache:dl2pfdist",
+		   "l2 data cache prefetch distance and degree "
+		   "(<distance> <degree>)",
+		   cache_dl2_pfdist, cache_dl2_pfdist_nelt,
+		   &cache_dl2_pfdist_nelt, /* default */cache_dl2_pfdist,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_int_list(odb, "-cache:dl2sbuf",
+		   "l2 data cache stream buffers (<buffers> <depth>, "
+		   "0 buffers for none)",
+		   cache_dl2_sbuf, cache_dl2_sbuf_nelt, &cache_dl2_sbuf_nelt,
+		   /* default */cache_dl2_sbuf,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_int_list(odb, "-cache:dl2mrc",
+		   "l2 data cache reference stream miss ratio curves "
+		   "(<max sets> <max assoc>, 0 sets for none)",
+		   cache_dl2_mrc, cache_dl2_mrc_nelt, &cache_dl2_mrc_nelt,
+		   /* default */cache_dl2_mrc,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_note(odb,
+"  The miss ratio curves (-cache:dl1mrc, -cache:dl2mrc) come from the LRU\n"
+"  stack distances of the regular references that reach the cache, in the\n"
+"  same run: the miss rates of every LRU cache of its block size with 1, 2,\n"
+"  4, .. <max sets> sets and 1, 2, 4, .. <max assoc> ways, and the misses of\n"
+"  fully associative LRU caches of 1, 2, 4, .. blocks, are printed with the\n"
+"  statistics.  The simulated cache itself is unaffected.\n"
+"\n"
+"    Examples:   -cache:dl1mrc 1024 16 -cache:dl2mrc 16384 32\n"
+	       );
+
   opt_reg_string(odb, "-cache:il1",
 		 "l1 inst cache config, i.e., {<config>|dl1|dl2|none}",
 		 &cache_il1_opt, "il1:512:32:1:l",
@@ -812,6 +1052,10 @@ sim_reg_options(struct opt_odb_t *odb)
 	       &compress_icache_addrs, /* default */FALSE,
 	       /* print */TRUE, NULL);
 
+  opt_reg_flag(odb, "-cache:3c",
+	       "classify cache misses as compulsory, capacity or conflict",
+	       &cache_3c, /* default */FALSE, /* print */TRUE, NULL);
+
   /* mem options */
   opt_reg_int_list(odb, "-mem:lat",
 		   "memory access latency (<first_chunk> <inter_chunk>)",
@@ -822,6 +1066,42 @@ sim_reg_options(struct opt_odb_t *odb)
 	      &mem_bus_width, /* default */8,
 	      /* print */TRUE, /* format */NULL);
 
+  opt_reg_string(odb, "-mem:dram",
+		 "DRAM config, i.e., {<config>|none}",
+		 &dram_opt, "none", /* print */TRUE, NULL);
+
+  opt_reg_int_list(odb, "-mem:dramtime",
+		   "DRAM timing (<tRCD> <tCAS> <tRP> <tRAS>)",
+		   dram_time, dram_time_nelt, &dram_time_nelt, dram_time,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_int_list(odb, "-mem:dramrefresh",
+		   "DRAM refresh (<tREFI> <tRFC>), 0 tREFI for none",
+		   dram_refresh, dram_refresh_nelt, &dram_refresh_nelt,
+		   dram_refresh, /* print */TRUE, /* format */NULL,
+		   /* !accrue */FALSE);
+
+  opt_reg_note(odb,
+"  The DRAM config parameter <config> has the following format:\n"
+"\n"
+"    <channels>:<ranks>:<banks>:<row size>:<page>\n"
+"\n"
+"    <channels> - number of channels, each with its own data bus\n"
+"    <ranks>    - ranks per channel\n"
+"    <banks>    - banks per rank\n"
+"    <row size> - bytes per row of a bank\n"
+"    <page>     - row buffer policy, {o|c} = {open page, closed page}\n"
+"\n"
+"    Examples:   -mem:dram 1:2:8:8192:o\n"
+"                -mem:dram 2:1:8:2048:c\n"
+"\n"
+"  With a DRAM, the misses of the last level caches are timed on its banks\n"
+"  (-mem:dramtime, in cycles) and data buses, which move -mem:width bytes\n"
+"  every <inter_chunk> cycles of -mem:lat; every rank is refreshed for\n"
+"  <tRFC> cycles every <tREFI> cycles.  Without one (-mem:dram none), main\n"
+"  memory takes the fixed latency of -mem:lat.\n"
+		 );
+
   /* TLB options */
 
   opt_reg_string(odb, "-tlb:itlb",
@@ -885,6 +1165,9 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
   if (fastfwd_count < 0 || fastfwd_count >= 2147483647)
     fatal("bad fast forward count: %d", fastfwd_count);
 
+  if (ipc_interval < 1)
+    fatal("IPC trace interval must be at least one instruction");
+
   if (ruu_ifq_size < 1 || (ruu_ifq_size & (ruu_ifq_size - 1)) != 0)
     fatal("inst fetch queue size must be positive > 0 and a power of two");
 
@@ -1016,7 +1299,20 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
 	fatal("bad l1 D-cache parms: <name>:<nsets>:<bsize>:<assoc>:<repl>");
       cache_dl1 = cache_create(name, nsets, bsize, /* balloc */FALSE,
 			       /* usize */0, assoc, cache_char2policy(c),
-			       dl1_access_fn, /* hit lat */cache_dl1_lat);
+			       dl1_access_fn, /* hit lat */cache_dl1_lat,
+			       cache_dl1_prefetch);
+      cache_set_mshrs(cache_dl1, cache_dl1_mshr, cache_dl1_pfq);
+      if (cache_dl1_pfdist_nelt != 2)
+	fatal("bad l1 D-cache prefetch parms: <distance> <degree>");
+      cache_set_pf_distance(cache_dl1,
+			    cache_dl1_pfdist[0], cache_dl1_pfdist[1]);
+      cache_set_fdp(cache_dl1, cache_dl1_fdp);
+      if (cache_dl1_sbuf_nelt != 2)
+	fatal("bad l1 D-cache stream buffer parms: <buffers> <depth>");
+      cache_set_sbufs(cache_dl1, cache_dl1_sbuf[0], cache_dl1_sbuf[1]);
+      if (cache_dl1_mrc_nelt != 2)
+	fatal("bad l1 D-cache miss ratio curve parms: <max sets> <max assoc>");
+      cache_set_mrc(cache_dl1, cache_dl1_mrc[0], cache_dl1_mrc[1]);
 
       /* is the level 2 D-cache defined? */
       if (!mystricmp(cache_dl2_opt, "none"))
@@ -1029,7 +1325,21 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
 		  "<name>:<nsets>:<bsize>:<assoc>:<repl>");
 	  cache_dl2 = cache_create(name, nsets, bsize, /* balloc */FALSE,
 				   /* usize */0, assoc, cache_char2policy(c),
-				   dl2_access_fn, /* hit lat */cache_dl2_lat);
+				   dl2_access_fn, /* hit lat */cache_dl2_lat,
+				   cache_dl2_prefetch);
+	  cache_set_mshrs(cache_dl2, cache_dl2_mshr, cache_dl2_pfq);
+	  if (cache_dl2_pfdist_nelt != 2)
+	    fatal("bad l2 D-cache prefetch parms: <distance> <degree>");
+	  cache_set_pf_distance(cache_dl2,
+				cache_dl2_pfdist[0], cache_dl2_pfdist[1]);
+	  cache_set_fdp(cache_dl2, cache_dl2_fdp);
+	  if (cache_dl2_sbuf_nelt != 2)
+	    fatal("bad l2 D-cache stream buffer parms: <buffers> <depth>");
+	  cache_set_sbufs(cache_dl2, cache_dl2_sbuf[0], cache_dl2_sbuf[1]);
+	  if (cache_dl2_mrc_nelt != 2)
+	    fatal("bad l2 D-cache miss ratio curve parms: "
+		  "<max sets> <max assoc>");
+	  cache_set_mrc(cache_dl2, cache_dl2_mrc[0], cache_dl2_mrc[1]);
 	}
     }
 
@@ -1072,7 +1382,8 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
 	fatal("bad l1 I-cache parms: <name>:<nsets>:<bsize>:<assoc>:<repl>");
       cache_il1 = cache_create(name, nsets, bsize, /* balloc */FALSE,
 			       /* usize */0, assoc, cache_char2policy(c),
-			       il1_access_fn, /* hit lat */cache_il1_lat);
+			       il1_access_fn, /* hit lat */cache_il1_lat,
+			       /* prefetch */"none");
 
       /* is the level 2 D-cache defined? */
       if (!mystricmp(cache_il2_opt, "none"))
@@ -1091,7 +1402,8 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
 		  "<name>:<nsets>:<bsize>:<assoc>:<repl>");
 	  cache_il2 = cache_create(name, nsets, bsize, /* balloc */FALSE,
 				   /* usize */0, assoc, cache_char2policy(c),
-				   il2_access_fn, /* hit lat */cache_il2_lat);
+				   il2_access_fn, /* hit lat */cache_il2_lat,
+				   /* prefetch */"none");
 	}
     }
 
@@ -1106,7 +1418,7 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
       itlb = cache_create(name, nsets, bsize, /* balloc */FALSE,
 			  /* usize */sizeof(md_addr_t), assoc,
 			  cache_char2policy(c), itlb_access_fn,
-			  /* hit latency */1);
+			  /* hit latency */1, /* prefetch */"none");
     }
 
   /* use a D-TLB? */
@@ -1120,7 +1432,20 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
       dtlb = cache_create(name, nsets, bsize, /* balloc */FALSE,
 			  /* usize */sizeof(md_addr_t), assoc,
 			  cache_char2policy(c), dtlb_access_fn,
-			  /* hit latency */1);
+			  /* hit latency */1, /* prefetch */"none");
+    }
+
+  /* classify the misses of every cache, shared levels are set up twice */
+  if (cache_3c)
+    {
+      if (cache_dl1)
+	cache_set_3c(cache_dl1, TRUE);
+      if (cache_dl2)
+	cache_set_3c(cache_dl2, TRUE);
+      if (cache_il1)
+	cache_set_3c(cache_il1, TRUE);
+      if (cache_il2)
+	cache_set_3c(cache_il2, TRUE);
     }
 
   if (cache_dl1_lat < 1)
@@ -1144,6 +1469,27 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
   if (mem_bus_width < 1 || (mem_bus_width & (mem_bus_width-1)) != 0)
     fatal("memory bus width must be positive non-zero and a power of two");
 
+  /* use the DRAM model for main memory */
+  if (!mystricmp(dram_opt, "none"))
+    dram = NULL;
+  else
+    {
+      int nchannels, nranks, nbanks, row_size;
+
+      if (sscanf(dram_opt, "%d:%d:%d:%d:%c",
+		 &nchannels, &nranks, &nbanks, &row_size, &c) != 5)
+	fatal("bad DRAM parms: <channels>:<ranks>:<banks>:<row size>:<page>");
+      if (dram_time_nelt != 4)
+	fatal("bad DRAM timing (<tRCD> <tCAS> <tRP> <tRAS>)");
+      if (dram_refresh_nelt != 2)
+	fatal("bad DRAM refresh (<tREFI> <tRFC>)");
+      dram = dram_create("dram", nchannels, nranks, nbanks, row_size,
+			 dram_char2policy(c));
+      dram_set_timing(dram, dram_time[0], dram_time[1], dram_time[2],
+		      dram_time[3], dram_refresh[0], dram_refresh[1],
+		      mem_bus_width, /* inter chunk */mem_lat[1]);
+    }
+
   if (tlb_miss_lat < 1)
     fatal("TLB miss latency must be greater than zero");
 
@@ -1182,7 +1528,8 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
 void
 sim_aux_config(FILE *stream)            /* output stream */
 {
-  /* nada */
+  if (dram)
+    dram_config(dram, stream);
 }
 
 /* register simulator-specific statistics */
@@ -1313,6 +1660,18 @@ sim_reg_stats(struct stat_sdb_t *sdb)   /* stats database */
   if (dtlb)
     cache_reg_stats(dtlb, sdb);
 
+  /* register DRAM stats */
+  if (dram)
+    {
+      char buf[128];
+
+      dram_reg_stats(dram, sdb);
+      sprintf(buf, "dram.bus_busy / (sim_cycle * %d)", dram->nchannels);
+      stat_reg_formula(sdb, "dram.bus_util",
+		       "fraction of cycles the DRAM data buses are busy",
+		       buf, NULL);
+    }
+
   /* debug variable(s) */
   stat_reg_counter(sdb, "sim_invalid_addrs",
 		   "total non-speculative bogus addresses seen (debug var)",
@@ -1424,6 +1783,14 @@ sim_load_prog(char *fname,		/* program to load */
   else
     fatal("bad pipetrace args, use: <fname|stdout|stderr> <range>");
 
+  /* open the interval IPC trace */
+  if (ipc_fname)
+    {
+      ipc_fd = fopen(ipc_fname, "w");
+      if (!ipc_fd)
+	fatal("cannot open IPC trace file `%s'", ipc_fname);
+    }
+
   /* finish initialization of the simulation engine */
   fu_pool = res_create_pool("fu-pool", fu_config, N_ELT(fu_config));
   rslink_init(MAX_RS_LINKS);
@@ -1443,7 +1810,11 @@ sim_load_prog(char *fname,		/* program to load */
 void
 sim_aux_stats(FILE *stream)             /* output stream */
 {
-  /* nada */
+  /* miss ratio curves of the data caches, if requested */
+  if (cache_dl1)
+    cache_mrc_print(cache_dl1, stream);
+  if (cache_dl2)
+    cache_mrc_print(cache_dl2, stream);
 }
 
 /* un-initialize the simulator */
@@ -1452,6 +1823,24 @@ sim_uninit(void)
 {
   if (ptrace_nelt > 0)
     ptrace_close();
+  if (ipc_fd)
+    fclose(ipc_fd);
+
+  /* free the caches and their prefetchers, unified levels only once */
+  if (cache_il2 && cache_il2 != cache_dl2)
+    cache_free(cache_il2);
+  if (cache_il1 && cache_il1 != cache_dl1 && cache_il1 != cache_dl2)
+    cache_free(cache_il1);
+  if (cache_dl2)
+    cache_free(cache_dl2);
+  if (cache_dl1)
+    cache_free(cache_dl1);
+  if (itlb)
+    cache_free(itlb);
+  if (dtlb)
+    cache_free(dtlb);
+  if (dram)
+    dram_free(dram);
 }
 
 
@@ -2182,12 +2571,14 @@ ruu_commit(void)
 		  fu->master->busy = fu->issuelat;
 
 		  /* go to the data cache */
+		  cache_access_PC = LSQ[LSQ_head].PC;
 		  if (cache_dl1)
 		    {
 		      /* commit store value to D-cache */
 		      lat =
 			cache_access(cache_dl1, Write, (LSQ[LSQ_head].addr&~3),
-				     NULL, 4, sim_cycle, NULL, NULL);
+				     NULL, 4, sim_cycle, NULL, NULL,
+				     /* prefetch */0);
 		      if (lat > cache_dl1_lat)
 			events |= PEV_CACHEMISS;
 		    }
@@ -2198,7 +2589,8 @@ ruu_commit(void)
 		      /* access the D-TLB */
 		      lat =
 			cache_access(dtlb, Read, (LSQ[LSQ_head].addr & ~3),
-				     NULL, 4, sim_cycle, NULL, NULL);
+				     NULL, 4, sim_cycle, NULL, NULL,
+				     /* prefetch */0);
 		      if (lat > 1)
 			events |= PEV_TLBMISS;
 		    }
@@ -2265,6 +2657,12 @@ ruu_commit(void)
       /* one more instruction committed to architected state */
       committed++;
 
+      /* record the cycle at the end of every IPC trace interval */
+      sim_num_committed++;
+      if (ipc_fd && sim_num_committed % ipc_interval == 0)
+	fprintf(ipc_fd, "%.0f %.0f\n",
+		(double)sim_num_committed, (double)sim_cycle);
+
       for (i=0; i<MAX_ODEPS; i++)
 	{
 	  if (rs->odep_list[i])
@@ -2718,6 +3116,9 @@ ruu_issue(void)
 				}
 			    }
 
+			  /* the D-cache and D-TLB see the PC of the load */
+			  cache_access_PC = rs->PC;
+
 			  /* was the value store forwared from the LSQ? */
 			  if (!load_lat)
 			    {
@@ -2733,7 +3134,8 @@ ruu_issue(void)
 				  load_lat =
 				    cache_access(cache_dl1, Read,
 						 (rs->addr & ~3), NULL, 4,
-						 sim_cycle, NULL, NULL);
+						 sim_cycle, NULL, NULL,
+						 /* prefetch */0);
 				  if (load_lat > cache_dl1_lat)
 				    events |= PEV_CACHEMISS;
 				}
@@ -2751,7 +3153,8 @@ ruu_issue(void)
 				 initiate speculative TLB misses */
 			      tlb_lat =
 				cache_access(dtlb, Read, (rs->addr & ~3),
-					     NULL, 4, sim_cycle, NULL, NULL);
+					     NULL, 4, sim_cycle, NULL, NULL,
+					     /* prefetch */0);
 			      if (tlb_lat > 1)
 				events |= PEV_TLBMISS;
 
@@ -4227,13 +4630,14 @@ ruu_fetch(void)
 
 	  /* address is within program text, read instruction from memory */
 	  lat = cache_il1_lat;
+	  cache_access_PC = fetch_regs_PC;
 	  if (cache_il1)
 	    {
 	      /* access the I-cache */
 	      lat =
 		cache_access(cache_il1, Read, IACOMPRESS(fetch_regs_PC),
 			     NULL, ISCOMPRESS(sizeof(md_inst_t)), sim_cycle,
-			     NULL, NULL);
+			     NULL, NULL, /* prefetch */0);
 	      if (lat > cache_il1_lat)
 		last_inst_missed = TRUE;
 	    }
@@ -4245,7 +4649,7 @@ ruu_fetch(void)
 	      tlb_lat =
 		cache_access(itlb, Read, IACOMPRESS(fetch_regs_PC),
 			     NULL, ISCOMPRESS(sizeof(md_inst_t)), sim_cycle,
-			     NULL, NULL);
+			     NULL, NULL, /* prefetch */0);
 	      if (tlb_lat > 1)
 		last_inst_tmissed = TRUE;
 
@@ -4596,6 +5000,12 @@ sim_main(void)
       LSQ_count += LSQ_num;
       LSQ_fcount += ((LSQ_num == LSQ_size) ? 1 : 0);
 
+      /* send queued prefetches to the data caches as MSHRs and buses free */
+      if (cache_dl1)
+	cache_issue_prefetches(cache_dl1, sim_cycle);
+      if (cache_dl2)
+	cache_issue_prefetches(cache_dl2, sim_cycle);
+
       /* go to next cycle */
       sim_cycle++;
 